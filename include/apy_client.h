@@ -0,0 +1,118 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APY_CLIENT_H
+#define APY_CLIENT_H
+
+#include <glib.h>
+
+/**
+ * @brief Default maximum number of idle connections kept open to each APY
+ */
+#define APY_POOL_DEFAULT_IDLE 4
+
+/**
+ * @brief Default maximum number of connections in use to each APY at the same time
+ */
+#define APY_POOL_DEFAULT_ACTIVE 8
+
+/**
+ * @brief Weight of an APY whose weight has not been set
+ */
+#define APY_DEFAULT_WEIGHT 1
+
+/**
+ * @brief Orders in which the APYs can be asked to translate
+ */
+typedef enum {
+    /** The order of the APY list */
+    APY_POLICY_ORDER,
+    /** From the fastest healthy APY to the slowest, according to the latencies observed */
+    APY_POLICY_FASTEST,
+    /** Each request starts at the APY after the one the previous request started at */
+    APY_POLICY_ROUND_ROBIN,
+    /** From the APY with the fewest requests in progress to the one with the most */
+    APY_POLICY_LEAST_OUTSTANDING,
+    /** Each request starts at an APY chosen at random, in proportion to the weights of the APYs */
+    APY_POLICY_WEIGHTED
+} apy_policy;
+
+/**
+ * @brief Usage figures of the connections to an APY
+ */
+typedef struct {
+    /** Open connections not in use */
+    guint idle;
+    /** Connections in use */
+    guint active;
+    /** Connections opened */
+    guint64 opened;
+    /** Requests sent on a connection that had already been used */
+    guint64 reused;
+} apy_pool_stats;
+
+void apyInit(void);
+
+void apyFinalize(void);
+
+void apyStopProbes(void);
+
+void apyCancelRequests(void);
+
+void apySetList(char **addresses, int count);
+
+int getAPYAddress(char ***list);
+
+int setAPYAddress(char* address, char* port, int order, int force);
+
+int removeAPYAddress(int position);
+
+int getAllPairs(char**** pairList);
+
+int pairExists(char* source, char* target);
+
+int refreshPairs(void);
+
+void warmUpPair(const char* source, const char* target);
+
+void getAPYPoolStats(const char* address, apy_pool_stats* stats);
+
+void setAPYPoolLimits(unsigned int max_idle, unsigned int max_active);
+
+void getAPYPoolLimits(unsigned int* max_idle, unsigned int* max_active);
+
+void setAPYHedging(int enabled);
+
+int getAPYHedging(void);
+
+void setAPYPolicy(int policy);
+
+int getAPYPolicy(void);
+
+void setAPYWeight(const char* address, unsigned int weight);
+
+unsigned int getAPYWeight(const char* address);
+
+char* translate(char* text, char* source, char* target);
+
+char* translateQuietly(char* text, char* source, char* target);
+
+int translateBatch(char** texts, int count, char* source, char* target, char** translations);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APY_HEALTH_H
+#define APY_HEALTH_H
+
+#include <glib.h>
+
+/**
+ * @brief Error rate above which an APY is considered unhealthy
+ */
+#define APY_HEALTH_MAX_ERROR_RATE 0.5
+
+/**
+ * @brief Default number of consecutive failures after which an APY is no longer asked
+ */
+#define APY_BREAKER_DEFAULT_FAILURES 3
+
+/**
+ * @brief Default seconds an APY is not asked after failing, before a single request checks whether it has recovered
+ */
+#define APY_BREAKER_DEFAULT_COOLDOWN 30
+
+/**
+ * @brief States of the circuit breaker of an APY
+ */
+typedef enum {
+    /** The APY is asked normally */
+    APY_BREAKER_CLOSED,
+    /** The APY failed too many times in a row and is not asked until its cool-down is over */
+    APY_BREAKER_OPEN,
+    /** The cool-down is over and a single request is checking whether the APY has recovered */
+    APY_BREAKER_HALF_OPEN
+} apy_breaker_state;
+
+/**
+ * @brief What has been observed of an APY
+ */
+typedef struct {
+    /** 1 if the APY has ever answered or failed, or 0 otherwise */
+    int known;
+    /** Exponentially weighted moving average of the time, in milliseconds, the APY takes to answer */
+    double latency;
+    /** Exponentially weighted moving average of the share of requests that failed, from 0 to 1 */
+    double error_rate;
+    /** Requests sent to the APY */
+    guint64 requests;
+    /** Requests that failed */
+    guint64 failures;
+    /** Failures since the last request that succeeded */
+    guint consecutive_failures;
+    /** State of the circuit breaker */
+    apy_breaker_state breaker;
+    /** Monotonic time, in microseconds, when the breaker last opened or let a request through while half-open */
+    gint64 breaker_changed;
+} apy_health_stats;
+
+void apy_health_init(void);
+
+int apy_health_record(const char *address, int success, gint64 latency);
+
+void apy_health_get(const char *address, apy_health_stats *stats);
+
+int apy_health_allow(const char *address);
+
+void apy_health_set_breaker(guint failures, guint cooldown);
+
+void apy_health_get_breaker(guint *failures, guint *cooldown);
+
+void apy_health_sort(char **addresses);
+
+void apy_health_forget(const char *address);
+
+void apy_health_shutdown(void);
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUDDY_INDEX_H
+#define BUDDY_INDEX_H
+
+#include <glib.h>
+
+/**
+ * @brief Function called for each user-language_pair binding
+ *
+ * @param user Name of the buddy
+ * @param direction "incoming" or "outgoing"
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param data Data passed to buddy_index_foreach()
+ */
+typedef void (*buddy_index_func)(const char *user, const char *direction, const char *source, const char *target,
+                                 gpointer data);
+
+/**
+ * @brief A copy of the changes to the bindings, taken to write the preference store again
+ */
+typedef struct buddy_index_snapshot buddy_index_snapshot;
+
+void buddy_index_init(void);
+
+int buddy_index_set(const char *user, const char *direction, const char *source, const char *target);
+
+int buddy_index_remove(const char *user, const char *direction, int always);
+
+int buddy_index_lookup(const char *user, const char *direction, const char **source, const char **target);
+
+void buddy_index_foreach(buddy_index_func func, gpointer data);
+
+buddy_index_snapshot* buddy_index_snapshot_new(void);
+
+void buddy_index_snapshot_foreach(buddy_index_snapshot *snapshot, buddy_index_func func, gpointer data);
+
+void buddy_index_snapshot_written(buddy_index_snapshot *snapshot);
+
+void buddy_index_snapshot_free(buddy_index_snapshot *snapshot);
+
+void buddy_index_shutdown(void);
+
+#endif
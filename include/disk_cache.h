@@ -0,0 +1,40 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <glib.h>
+
+/**
+ * @brief Default number of translations the cache file can hold
+ */
+#define DISK_CACHE_DEFAULT_SLOTS 8192
+
+int disk_cache_open(const char *filename, guint slots);
+
+char* disk_cache_lookup(const char *key);
+
+void disk_cache_store(const char *key, const char *value);
+
+void disk_cache_clear(void);
+
+void disk_cache_close(void);
+
+#endif
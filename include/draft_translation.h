@@ -0,0 +1,38 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRAFT_TRANSLATION_H
+#define DRAFT_TRANSLATION_H
+
+#include <glib.h>
+#include "account.h"
+
+/**
+ * @brief Milliseconds the user must stop typing for before the draft is translated
+ */
+#define DRAFT_TRANSLATION_DELAY 400
+
+void draft_translation_init(void *plugin);
+
+char* draft_translation_take(PurpleAccount *account, const char *name, const char *text,
+                             const char *source, const char *target);
+
+void draft_translation_shutdown(void);
+
+#endif
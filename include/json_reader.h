@@ -0,0 +1,52 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <glib.h>
+
+typedef enum {JSON_NULL, JSON_BOOLEAN, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT} json_type;
+
+typedef struct {
+    json_type type;
+    int boolean;
+    double number;
+    char *string;
+    GPtrArray *keys;
+    GPtrArray *values;
+} json_value;
+
+json_value* json_parse(const char *text, gsize length);
+
+void json_free(json_value *value);
+
+json_value* json_object_get(const json_value *object, const char *key);
+
+json_value* json_object_steal(json_value *object, const char *key);
+
+json_value* json_array_get(const json_value *array, guint index);
+
+guint json_length(const json_value *value);
+
+const char* json_get_string(const json_value *value);
+
+double json_get_number(const json_value *value, double default_value);
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAIR_CATALOGUE_H
+#define PAIR_CATALOGUE_H
+
+#include <glib.h>
+
+/**
+ * @brief Seconds the language pairs of an APY are trusted before they are asked for again
+ */
+#define PAIR_CATALOGUE_TTL (24*60*60)
+
+void pair_catalogue_init(const char *filename);
+
+void pair_catalogue_set(const char *address, char **sources, char **targets, guint count);
+
+int pair_catalogue_is_fresh(const char *address);
+
+int pair_catalogue_contains(const char *address, const char *source, const char *target);
+
+int pair_catalogue_get(const char *address, char ***sources, char ***targets);
+
+void pair_catalogue_forget(const char *address);
+
+void pair_catalogue_shutdown(void);
+
+#endif
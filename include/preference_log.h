@@ -0,0 +1,75 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREFERENCE_LOG_H
+#define PREFERENCE_LOG_H
+
+#include <glib.h>
+
+/**
+ * @brief Milliseconds a change may stay written but not synced to disk
+ */
+#define PREFERENCE_LOG_SYNC_DELAY 1000
+
+/**
+ * @brief Number of changes in the log after which the preferences are written whole and the log is emptied
+ */
+#define PREFERENCE_LOG_COMPACT_RECORDS 500
+
+/**
+ * @brief Function called for each change found in the log when it is opened
+ *
+ * @param fields NULL-terminated array with the fields of the change. The first one names the kind of change
+ * @param data Data passed to preference_log_open()
+ */
+typedef void (*preference_log_replay_func)(char **fields, gpointer data);
+
+/**
+ * @brief Function that gathers on the main loop what the snapshot needs, so that it can be written on another thread
+ *
+ * @return Data passed to the snapshot and thaw functions, or NULL if no snapshot may be written now
+ */
+typedef gpointer (*preference_log_freeze_func)(void);
+
+/**
+ * @brief Function that writes every preference to the snapshot, so that the changes in the log can be dropped
+ *
+ * Runs on the thread writing the log
+ * @param snapshot Data returned by the freeze function
+ * @return 1 if the snapshot was written, or 0 otherwise, in which case the log is kept
+ */
+typedef int (*preference_log_snapshot_func)(gpointer snapshot);
+
+/**
+ * @brief Function that picks up the result of the snapshot on the main loop, and frees its data
+ *
+ * @param snapshot Data returned by the freeze function
+ * @param saved 1 if the snapshot was written, or 0 otherwise
+ */
+typedef void (*preference_log_thaw_func)(gpointer snapshot, int saved);
+
+int preference_log_open(const char *filename, preference_log_replay_func replay, gpointer data,
+                        preference_log_freeze_func freeze, preference_log_snapshot_func snapshot,
+                        preference_log_thaw_func thaw);
+
+void preference_log_append(const char **fields);
+
+void preference_log_close(void);
+
+#endif
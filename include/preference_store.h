@@ -0,0 +1,87 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREFERENCE_STORE_H
+#define PREFERENCE_STORE_H
+
+#include <glib.h>
+
+/**
+ * @brief Position of the incoming language pair of a buddy
+ */
+#define PREFERENCE_STORE_INCOMING 0
+
+/**
+ * @brief Position of the outgoing language pair of a buddy
+ */
+#define PREFERENCE_STORE_OUTGOING 1
+
+/**
+ * @brief Function called for each user-language_pair binding in the store
+ *
+ * @param user Name of the buddy
+ * @param direction PREFERENCE_STORE_INCOMING or PREFERENCE_STORE_OUTGOING
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param data Data passed to preference_store_foreach()
+ */
+typedef void (*preference_store_binding_func)(const char *user, int direction, const char *source,
+                                              const char *target, gpointer data);
+
+/**
+ * @brief Function called for each integer setting in the store
+ *
+ * @param key Name of the setting
+ * @param value Value of the setting
+ * @param data Data passed to preference_store_foreach()
+ */
+typedef void (*preference_store_setting_func)(const char *key, gint64 value, gpointer data);
+
+/**
+ * @brief Preferences gathered to be written as a new store
+ */
+typedef struct preference_store_builder preference_store_builder;
+
+int preference_store_open(const char *filename);
+
+int preference_store_lookup(const char *user, int direction, const char **source, const char **target);
+
+int preference_store_get_int(const char *key, gint64 *value);
+
+int preference_store_get_apys(const char ***addresses);
+
+void preference_store_foreach(preference_store_binding_func binding, preference_store_setting_func setting,
+                              gpointer data);
+
+void preference_store_close(void);
+
+preference_store_builder* preference_store_builder_new(void);
+
+void preference_store_builder_add_binding(preference_store_builder *builder, const char *user, int direction,
+                                          const char *source, const char *target);
+
+void preference_store_builder_add_int(preference_store_builder *builder, const char *key, gint64 value);
+
+void preference_store_builder_set_apys(preference_store_builder *builder, char **addresses, int count);
+
+int preference_store_builder_save(preference_store_builder *builder, const char *filename);
+
+void preference_store_builder_free(preference_store_builder *builder);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+void preferencesInit(const char* store_filename, const char* log_filename, int converting_store);
+
+void preferencesConverted(void);
+
+void preferencesFinalize(void);
+
+int updateFileAddresses(void);
+
+const char* getDisplay(void);
+
+int setDisplay(const char* display_mode);
+
+long getIntKey(const char* key, long default_value);
+
+int setIntKey(const char* key, long value);
+
+int dictionaryHasUser(const char* user, const char* direction);
+
+char* dictionaryGetUserLanguage(const char* user, const char* direction, const char* key);
+
+int dictionarySetUserEntry(const char* user, const char* direction, const char* source, const char* target);
+
+int dictionaryRemoveUserEntry(const char* user, char* entry);
+
+int dictionaryRemoveUserEntries(const char* user);
+
+#endif
@@ -20,42 +20,8 @@
 #include <Python.h>
 #include "notifications.h"
 
-void pythonInit(const char* filename);
+void pythonInit(void);
 
 void pythonFinalize(void);
 
-int getAPYAddress(char ***list);
-
-int setAPYAddress(char* address, char* port, int order, int force);
-
-int removeAPYAddress(int position);
-
-int setFileAPYList(PyObject* list);
-
-int updateFileAddresses(void);
-
-const char* getDisplay(void);
-
-int setDisplay(const char* display_mode);
-
-int dictionaryHasUser(const char* user, const char* direction);
-
-char* dictionaryGetUserLanguage(const char* user, const char* direction, const char* key);
-
-int dictionarySetUserEntry(const char* user, const char* direction, const char* source, const char* target);
-
-int dictionaryRemoveUserEntry(const char* user, char* entry);
-
-int dictionaryRemoveUserEntries(const char* user);
-
-PyObject* getDictionary(void);
-
-void setDictionary(PyObject* item);
-
-void saveDictionary(void);
-
-int getAllPairs(char**** pairList);
-
-int pairExists(char* source, char* target);
-
-char* translate(char* text, char* source, char* target);
+int pythonMigratePreferences(const char* filename, const char* store_filename);
@@ -0,0 +1,86 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RETRY_QUEUE_H
+#define RETRY_QUEUE_H
+
+#include <glib.h>
+
+/**
+ * @brief Maximum number of translations waiting to be retried. The ones at the head of the queue are dropped first
+ */
+#define RETRY_QUEUE_MAX_ENTRIES 200
+
+/**
+ * @brief Seconds a translation is retried for before it is dropped
+ */
+#define RETRY_QUEUE_MAX_AGE (24*60*60)
+
+/**
+ * @brief Seconds waited before retrying after the first failure
+ */
+#define RETRY_QUEUE_MIN_DELAY 5
+
+/**
+ * @brief Maximum number of seconds waited between retries
+ */
+#define RETRY_QUEUE_MAX_DELAY 300
+
+/**
+ * @brief A message whose translation failed and must be retried
+ */
+typedef struct {
+    /** Username of the account the message was sent or received on */
+    char *account;
+    /** Protocol ID of the account */
+    char *protocol;
+    /** Username of the buddy the message was sent to or received from */
+    char *name;
+    /** 1 for messages sent by the user, 0 for received ones */
+    int outgoing;
+    /** Source language of the language pair */
+    char *source;
+    /** Target language of the language pair */
+    char *target;
+    /** The message as it was written */
+    char *text;
+    /** Time, in seconds since the epoch, when the translation first failed */
+    gint64 queued;
+} retry_entry;
+
+void retry_queue_init(const char *filename);
+
+void retry_queue_add(const char *account, const char *protocol, const char *name, int outgoing,
+                     const char *source, const char *target, const char *text);
+
+retry_entry* retry_queue_take(void);
+
+void retry_queue_finish(int translated);
+
+guint retry_queue_length(void);
+
+guint retry_queue_delay(void);
+
+void retry_queue_failed(void);
+
+void retry_queue_succeeded(void);
+
+void retry_queue_shutdown(void);
+
+#endif
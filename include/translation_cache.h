@@ -0,0 +1,69 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSLATION_CACHE_H
+#define TRANSLATION_CACHE_H
+
+#include <glib.h>
+
+/**
+ * @brief Default maximum number of translations kept in the cache
+ */
+#define TRANSLATION_CACHE_DEFAULT_ENTRIES 1000
+
+/**
+ * @brief Default maximum size, in bytes, of the translations kept in the cache
+ */
+#define TRANSLATION_CACHE_DEFAULT_BYTES (1024*1024)
+
+/**
+ * @brief Usage figures of the translation cache
+ */
+typedef struct {
+    /** Number of translations in the cache */
+    guint entries;
+    /** Bytes used by the translations in the cache */
+    gsize bytes;
+    /** Maximum number of translations */
+    guint max_entries;
+    /** Maximum number of bytes */
+    gsize max_bytes;
+    /** Lookups that found a translation in memory */
+    guint64 hits;
+    /** Lookups that found a translation only in the cache file */
+    guint64 disk_hits;
+    /** Lookups that did not find a translation */
+    guint64 misses;
+} translation_cache_stats;
+
+void translation_cache_init(guint max_entries, gsize max_bytes);
+
+char* translation_cache_lookup(const char *source, const char *target, const char *text);
+
+void translation_cache_store(const char *source, const char *target, const char *text, const char *translation);
+
+void translation_cache_set_limits(guint max_entries, gsize max_bytes);
+
+void translation_cache_get_stats(translation_cache_stats *stats);
+
+void translation_cache_clear(void);
+
+void translation_cache_shutdown(void);
+
+#endif
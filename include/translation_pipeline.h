@@ -0,0 +1,68 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSLATION_PIPELINE_H
+#define TRANSLATION_PIPELINE_H
+
+#include <glib.h>
+
+/**
+ * @brief Default milliseconds a text waits for others of the same language pair before being sent
+ */
+#define TRANSLATION_BATCH_DEFAULT_WINDOW 30
+
+/**
+ * @brief Default maximum number of texts sent in a single request
+ */
+#define TRANSLATION_BATCH_DEFAULT_TEXTS 16
+
+/**
+ * @brief Default number of bytes of text after which a batch is sent without waiting
+ */
+#define TRANSLATION_BATCH_DEFAULT_BYTES 4096
+
+/**
+ * @brief How texts are gathered in batches
+ */
+typedef struct {
+    /** Milliseconds a text waits for others of the same language pair. 0 disables batching */
+    guint window;
+    /** Maximum number of texts of a batch */
+    guint texts;
+    /** Number of bytes of text after which a batch is sent without waiting */
+    gsize bytes;
+} translation_batching;
+
+typedef void (*translation_ready_func)(char *translation, gpointer data);
+
+void translation_pipeline_init(void);
+
+void translation_pipeline_submit(const char *text, const char *source, const char *target, int priority,
+                                 translation_ready_func ready, gpointer data);
+
+void translation_pipeline_submit_draft(const char *text, const char *source, const char *target,
+                                       translation_ready_func ready, gpointer data);
+
+void translation_pipeline_set_batching(const translation_batching *limits);
+
+void translation_pipeline_get_batching(translation_batching *limits);
+
+void translation_pipeline_shutdown(void);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <glib.h>
+
+/**
+ * @brief Maximum number of background tasks running at the same time
+ */
+#define WORKER_BACKGROUND_THREADS 1
+
+/**
+ * @brief Classes of tasks, from the most urgent to the least
+ */
+typedef enum {
+    /** Translations of the messages the user sends */
+    WORKER_PRIORITY_OUTGOING,
+    /** Translations of the messages the user receives */
+    WORKER_PRIORITY_INCOMING,
+    /** Work nobody is waiting for, such as probing the APYs */
+    WORKER_PRIORITY_BACKGROUND,
+    /** Number of classes */
+    WORKER_PRIORITY_COUNT
+} worker_priority;
+
+typedef void (*worker_task_func)(gpointer data);
+
+void worker_pool_init(int max_threads);
+
+void worker_pool_push(int priority, worker_task_func work, worker_task_func done, gpointer data);
+
+int worker_pool_raise(gpointer data, int priority);
+
+void worker_pool_shutdown(void);
+
+#endif
@@ -0,0 +1,2409 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file apy_client.c
+ * @brief Functions to make requests to the Apertium-APYs
+ *
+ * The requests are made over HTTP with GIO and their answers are parsed in C, so no Python is involved.
+ * Connections are kept alive and reused by later requests to the same APY.
+ * Every APY is probed in the background, so that the latency and error rate of each of them are known (see apy_health.c)
+ * and requests can be sent to the fastest one first.
+ * The language pairs of each APY are kept in the pair catalogue (see pair_catalogue.c), so checking or listing them
+ * only makes requests when the catalogue has expired.
+ * All the functions in this file may be called from any thread
+ */
+
+#include "apy_client.h"
+#include "apy_health.h"
+#include "json_reader.h"
+#include "pair_catalogue.h"
+#include "notifications.h"
+#include "worker_pool.h"
+#include <gio/gio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Address the APY list contains when no other has been set
+ */
+#define APY_DEFAULT_ADDRESS "http://localhost:2737"
+
+/**
+ * @brief Seconds to wait for an APY to connect or answer before giving up on it
+ */
+#define APY_TIMEOUT 10
+
+/**
+ * @brief Largest answer, in bytes, accepted from an APY
+ */
+#define APY_MAX_RESPONSE (16*1024*1024)
+
+/**
+ * @brief Seconds a connection may stay idle before it is closed
+ */
+#define APY_POOL_IDLE_TIMEOUT 30
+
+/**
+ * @brief Seconds between two checks for connections that have been idle for too long
+ */
+#define APY_POOL_REAP_INTERVAL 10
+
+/**
+ * @brief Number of latencies kept for each APY
+ */
+#define APY_LATENCY_SAMPLES 64
+
+/**
+ * @brief Percentile of the latencies of an APY after which the next APY is asked too
+ */
+#define APY_HEDGE_PERCENTILE 95
+
+/**
+ * @brief Number of latencies needed before the percentile is trusted
+ */
+#define APY_HEDGE_MIN_SAMPLES 10
+
+/**
+ * @brief Microseconds to wait for an APY before asking the next one, until enough latencies are known
+ */
+#define APY_HEDGE_DEFAULT_DELAY (1000*1000)
+
+/**
+ * @brief Shortest wait, in microseconds, for an APY before asking the next one
+ */
+#define APY_HEDGE_MIN_DELAY (50*1000)
+
+/**
+ * @brief Maximum number of requests of hedged translations sent at the same time, to all the APYs
+ */
+#define APY_HEDGE_THREADS 8
+
+/**
+ * @brief Seconds between two probes of every APY
+ */
+#define APY_PROBE_INTERVAL 60
+
+/**
+ * @brief Text sent to an APY to have it start the pipeline of a language pair
+ */
+#define APY_WARM_UP_TEXT "a"
+
+/**
+ * @brief Seconds during which a language pair that has been warmed up is not warmed up again
+ */
+#define APY_WARM_UP_INTERVAL 600
+
+/**
+ * @brief Mark placed between the texts of a batch, which the APYs pass through untranslated
+ */
+#define APY_BATCH_MARK "|||"
+
+/**
+ * @brief Padding on each side of APY_BATCH_MARK, so that each text of a batch is a paragraph of its own
+ */
+#define APY_BATCH_PADDING "\n\n"
+
+/**
+ * @brief Separator placed between the texts of a batch
+ */
+#define APY_BATCH_SEPARATOR APY_BATCH_PADDING APY_BATCH_MARK APY_BATCH_PADDING
+
+/**
+ * @brief The ordered list of APY addresses
+ *
+ * Protected by apy_mutex
+ */
+static GPtrArray *apy_list = NULL;
+
+/**
+ * @brief Weights of the APYs for APY_POLICY_WEIGHTED, by address
+ *
+ * APYs not in the table have APY_DEFAULT_WEIGHT. Protected by apy_mutex
+ */
+static GHashTable *weights = NULL;
+
+/**
+ * @brief Mutex protecting apy_list and weights
+ */
+static GMutex apy_mutex;
+
+/**
+ * @brief Where and how an APY address must be reached
+ */
+typedef struct {
+    /** 1 if the connection must use TLS (https), or 0 otherwise */
+    int tls;
+    /** Name or IP of the host */
+    char *host;
+    /** TCP port */
+    guint16 port;
+    /** Path every request path is appended to, without the trailing slash */
+    char *prefix;
+} apy_endpoint;
+
+/**
+ * @brief An open HTTP connection to an APY
+ */
+typedef struct {
+    /** The underlying connection */
+    GSocketConnection *connection;
+    /** Buffered stream the answers are read from */
+    GDataInputStream *input;
+    /** Stream the requests are written to */
+    GOutputStream *output;
+    /** Monotonic time, in microseconds, when the connection was last returned to its pool */
+    gint64 last_used;
+} apy_connection;
+
+/**
+ * @brief The connections to an APY
+ */
+typedef struct {
+    /** Open connections not in use, the most recently used at the head */
+    GQueue idle;
+    /** Usage figures of the pool, except for the number of idle connections, which is the length of idle */
+    apy_pool_stats stats;
+} apy_pool;
+
+/**
+ * @brief Connection pools by APY address
+ *
+ * Protected by pool_mutex
+ */
+static GHashTable *pools = NULL;
+
+/**
+ * @brief Maximum number of idle connections kept open to each APY
+ *
+ * Protected by pool_mutex
+ */
+static guint pool_max_idle = APY_POOL_DEFAULT_IDLE;
+
+/**
+ * @brief Maximum number of connections in use to each APY at the same time, or 0 if there is no limit
+ *
+ * Protected by pool_mutex
+ */
+static guint pool_max_active = APY_POOL_DEFAULT_ACTIVE;
+
+/**
+ * @brief Mutex protecting the connection pools
+ */
+static GMutex pool_mutex;
+
+/**
+ * @brief Signalled whenever a connection is returned to its pool
+ */
+static GCond pool_cond;
+
+/**
+ * @brief ID of the timeout source closing the connections that have been idle for too long
+ */
+static guint reaper_source = 0;
+
+/**
+ * @brief The latest latencies of an APY
+ */
+typedef struct {
+    /** Time, in microseconds, each of the latest translation requests took */
+    gint64 samples[APY_LATENCY_SAMPLES];
+    /** Number of samples stored */
+    guint count;
+    /** Position the next sample will be stored at */
+    guint next;
+} apy_latency;
+
+/**
+ * @brief Latencies by APY address
+ *
+ * Protected by latency_mutex
+ */
+static GHashTable *latencies = NULL;
+
+/**
+ * @brief Mutex protecting latencies
+ */
+static GMutex latency_mutex;
+
+/**
+ * @brief 1 if translation requests are hedged, or 0 otherwise
+ *
+ * Accessed atomically
+ */
+static gint hedging = 0;
+
+/**
+ * @brief A translation request sent to several APYs, of which the first answer is used
+ *
+ * Shared by the thread that waits for the answer and the threads that send the request to each APY
+ */
+typedef struct {
+    /** Number of threads using the request */
+    gint references;
+    /** HTTP method */
+    char *method;
+    /** Path of the request */
+    char *path;
+    /** Form-encoded body of the request, or NULL */
+    char *body;
+    /** The first translation received, or NULL if none has been received yet */
+    char *translation;
+    /** Description of the last error, or NULL */
+    char *error_msg;
+    /** Number of APYs still being asked */
+    int running;
+    /** Position of the last APY asked among the APYs asked */
+    int latest;
+    /** Time after which the next APY is asked, or G_MAXINT64 until the request to the last APY asked has started */
+    gint64 deadline;
+    /** GCancellable of the request to each APY */
+    GPtrArray *cancellables;
+    /** Mutex protecting the request */
+    GMutex mutex;
+    /** Signalled whenever a request to an APY starts, answers or fails */
+    GCond cond;
+} hedged_request;
+
+/**
+ * @brief The request of a hedged_request to one of the APYs
+ */
+typedef struct {
+    /** The hedged request */
+    hedged_request *hedge;
+    /** Address of the APY */
+    char *address;
+    /** Object used to abort the request once another APY has answered */
+    GCancellable *cancellable;
+    /** 0 for the request to the first APY of the hedged request, or its position among the APYs asked */
+    int order;
+    /** Time the APY is given to answer before the next one is asked, in microseconds */
+    gint64 delay;
+    /** Number of the attempt among all the attempts started, used to run them in the order they were started */
+    guint sequence;
+} hedge_attempt;
+
+/**
+ * @brief Threads sending the requests of hedged translations
+ *
+ * Bounded by APY_HEDGE_THREADS, so hedging does not add threads beyond the limits of the worker pool.
+ * Created by the first hedged translation
+ */
+static GThreadPool *hedge_pool = NULL;
+
+/**
+ * @brief Number of hedge_attempts started, accessed atomically
+ */
+static gint hedge_sequence = 0;
+
+/**
+ * @brief Order in which the APYs are asked, one of apy_policy
+ *
+ * Accessed atomically
+ */
+static gint policy = APY_POLICY_ORDER;
+
+/**
+ * @brief Number of requests balanced with APY_POLICY_ROUND_ROBIN
+ *
+ * Accessed atomically
+ */
+static gint round_robin_turn = 0;
+
+/**
+ * @brief ID of the timeout source starting the probes
+ */
+static guint probe_source = 0;
+
+/**
+ * @brief 1 while the probes are queued or running on the worker pool, or 0 otherwise
+ *
+ * Only used from the main loop
+ */
+static int probe_running = 0;
+
+/**
+ * @brief Object used to abort the probes and the warm-ups when the plugin is unloaded
+ */
+static GCancellable *probe_cancellable = NULL;
+
+/**
+ * @brief Object used to abort the translation requests when the plugin is unloaded
+ */
+static GCancellable *request_cancellable = NULL;
+
+/**
+ * @brief Monotonic time, in seconds, at which each language pair ("source|target") was last warmed up
+ *
+ * Only used from the main loop
+ */
+static GHashTable *warmed_pairs = NULL;
+
+/**
+ * @brief A language pair to be warmed up
+ */
+typedef struct {
+    /** Source language of the language pair */
+    char *source;
+    /** Target language of the language pair */
+    char *target;
+} warm_up_task;
+
+/**
+ * @brief Returns a copy of a string allocated with malloc, so that it can be freed by the plugin
+ *
+ * @param text The string to copy
+ * @return The copy
+ */
+static char* copy_string(const char *text){
+    char *copy = malloc(sizeof(char)*(strlen(text)+1));
+
+    sprintf(copy,"%s",text);
+    return copy;
+}
+
+/**
+ * @brief Splits an APY address into its parts
+ *
+ * Addresses look like 'http://host:port/path'. The scheme, port and path are optional
+ * @param address The APY address
+ * @param endpoint Reference to where the parts will be stored. Its strings must be freed with free_endpoint()
+ * @return 1 on success, or 0 if the address is malformed
+ */
+static int parse_address(const char *address, apy_endpoint *endpoint){
+    const char *rest, *path, *host_end;
+    char *port_end;
+    long port;
+
+    endpoint->tls = 0;
+    rest = address;
+
+    if(g_str_has_prefix(address, "https://")){
+        endpoint->tls = 1;
+        rest = address + 8;
+    }
+    else if(g_str_has_prefix(address, "http://")){
+        rest = address + 7;
+    }
+
+    if((path = strchr(rest, '/')) == NULL){
+        path = rest + strlen(rest);
+    }
+
+    if(*rest == '['){
+        // IPv6 literal
+        if((host_end = memchr(rest, ']', path - rest)) == NULL){
+            return 0;
+        }
+        endpoint->host = g_strndup(rest + 1, host_end - rest - 1);
+        host_end++;
+    }
+    else{
+        if((host_end = memchr(rest, ':', path - rest)) == NULL){
+            host_end = path;
+        }
+        endpoint->host = g_strndup(rest, host_end - rest);
+    }
+
+    if(*host_end == ':'){
+        port = strtol(host_end + 1, &port_end, 10);
+        if(port_end != path || port <= 0 || port > 65535){
+            g_free(endpoint->host);
+            return 0;
+        }
+        endpoint->port = (guint16)port;
+    }
+    else if(host_end == path){
+        endpoint->port = endpoint->tls ? 443 : 80;
+    }
+    else{
+        g_free(endpoint->host);
+        return 0;
+    }
+
+    if(*endpoint->host == '\0'){
+        g_free(endpoint->host);
+        return 0;
+    }
+
+    endpoint->prefix = g_strdup(path);
+    if(g_str_has_suffix(endpoint->prefix, "/")){
+        endpoint->prefix[strlen(endpoint->prefix) - 1] = '\0';
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Frees the strings of an endpoint filled by parse_address()
+ *
+ * @param endpoint The endpoint
+ */
+static void free_endpoint(apy_endpoint *endpoint){
+    g_free(endpoint->host);
+    g_free(endpoint->prefix);
+}
+
+/**
+ * @brief Opens a connection to an APY
+ *
+ * @param endpoint The APY to connect to
+ * @param cancellable Object that can be used to abort the connection, or NULL
+ * @param error Reference to where the error will be stored on failure
+ * @return The new connection, or NULL on failure
+ */
+static apy_connection* apy_connect(const apy_endpoint *endpoint, GCancellable *cancellable, GError **error){
+    GSocketClient *client;
+    GSocketConnection *socket_connection;
+    apy_connection *connection;
+
+    client = g_socket_client_new();
+    g_socket_client_set_timeout(client, APY_TIMEOUT);
+    g_socket_client_set_tls(client, endpoint->tls);
+
+    socket_connection = g_socket_client_connect_to_host(client, endpoint->host, endpoint->port, cancellable, error);
+    g_object_unref(client);
+
+    if(socket_connection == NULL){
+        return NULL;
+    }
+
+    connection = g_new0(apy_connection, 1);
+    connection->connection = socket_connection;
+    connection->input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(socket_connection)));
+    connection->output = g_io_stream_get_output_stream(G_IO_STREAM(socket_connection));
+    g_data_input_stream_set_newline_type(connection->input, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+
+    return connection;
+}
+
+/**
+ * @brief Closes a connection opened by apy_connect() and frees it
+ *
+ * @param connection The connection
+ */
+static void apy_disconnect(apy_connection *connection){
+    g_object_unref(connection->input);
+    g_io_stream_close(G_IO_STREAM(connection->connection), NULL, NULL);
+    g_object_unref(connection->connection);
+    g_free(connection);
+}
+
+/**
+ * @brief Reads a line of the HTTP header
+ *
+ * @param connection The connection to read from
+ * @param cancellable Object that can be used to abort the reading, or NULL
+ * @param error Reference to where the error will be stored on failure
+ * @return The line without its line break, which must be freed with g_free(), or NULL on failure
+ */
+static char* read_header_line(apy_connection *connection, GCancellable *cancellable, GError **error){
+    char *line;
+
+    line = g_data_input_stream_read_line(connection->input, NULL, cancellable, error);
+
+    if(line == NULL && error != NULL && *error == NULL){
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED, "The APY closed the connection");
+    }
+
+    return line;
+}
+
+/**
+ * @brief Appends exactly length bytes from the connection to a buffer
+ *
+ * @param connection The connection to read from
+ * @param buffer Buffer the bytes are appended to
+ * @param length Number of bytes to read
+ * @param cancellable Object that can be used to abort the reading, or NULL
+ * @param error Reference to where the error will be stored on failure
+ * @return 1 on success, or 0 otherwise
+ */
+static int read_body_bytes(apy_connection *connection, GString *buffer, gsize length, GCancellable *cancellable,
+                           GError **error){
+    gsize bytes_read, offset = buffer->len;
+
+    if(offset + length > APY_MAX_RESPONSE){
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "The answer from the APY is too long");
+        return 0;
+    }
+
+    g_string_set_size(buffer, offset + length);
+
+    if(!g_input_stream_read_all(G_INPUT_STREAM(connection->input), buffer->str + offset, length, &bytes_read, cancellable, error)){
+        return 0;
+    }
+    if(bytes_read != length){
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED, "The APY closed the connection");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Reads an HTTP answer
+ *
+ * Bodies delimited by Content-Length, chunked or ended by closing the connection are all understood
+ * @param connection The connection to read from
+ * @param status Reference to where the HTTP status code will be stored
+ * @param keep_alive Reference to where 1 will be stored if the connection can be used for another request, or 0 otherwise
+ * @param cancellable Object that can be used to abort the reading, or NULL
+ * @param error Reference to where the error will be stored on failure
+ * @return The body of the answer, which must be freed with g_free(), or NULL on failure
+ */
+static char* read_response(apy_connection *connection, int *status, int *keep_alive, GCancellable *cancellable,
+                           GError **error){
+    char *line, *value, buffer[4096];
+    int chunked = 0, major, minor;
+    gint64 content_length = -1;
+    guint64 chunk_length;
+    gssize bytes_read;
+    GString *body;
+
+    if((line = read_header_line(connection, cancellable, error)) == NULL){
+        return NULL;
+    }
+    if(sscanf(line, "HTTP/%d.%d %d", &major, &minor, status) != 3){
+        g_free(line);
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "The APY did not answer with HTTP");
+        return NULL;
+    }
+    g_free(line);
+
+    // HTTP/1.1 connections stay open unless told otherwise, older ones only if told so
+    *keep_alive = major > 1 || (major == 1 && minor >= 1);
+
+    while((line = read_header_line(connection, cancellable, error)) != NULL && *line != '\0'){
+        if((value = strchr(line, ':')) != NULL){
+            *value++ = '\0';
+            g_strstrip(value);
+
+            if(!g_ascii_strcasecmp(line, "Content-Length")){
+                content_length = g_ascii_strtoll(value, NULL, 10);
+            }
+            else if(!g_ascii_strcasecmp(line, "Transfer-Encoding") && strstr(value, "chunked") != NULL){
+                chunked = 1;
+            }
+            else if(!g_ascii_strcasecmp(line, "Connection")){
+                if(!g_ascii_strcasecmp(value, "close")){
+                    *keep_alive = 0;
+                }
+                else if(!g_ascii_strcasecmp(value, "keep-alive")){
+                    *keep_alive = 1;
+                }
+            }
+        }
+        g_free(line);
+    }
+    if(line == NULL){
+        return NULL;
+    }
+    g_free(line);
+
+    body = g_string_new(NULL);
+
+    if(chunked){
+        do{
+            if((line = read_header_line(connection, cancellable, error)) == NULL){
+                g_string_free(body, TRUE);
+                return NULL;
+            }
+            chunk_length = g_ascii_strtoull(line, NULL, 16);
+            g_free(line);
+
+            if(chunk_length > 0){
+                if(!read_body_bytes(connection, body, chunk_length, cancellable, error) ||
+                   (line = read_header_line(connection, cancellable, error)) == NULL){
+                    g_string_free(body, TRUE);
+                    return NULL;
+                }
+                g_free(line);
+            }
+        } while(chunk_length > 0);
+
+        // Trailer, ended by an empty line
+        while((line = read_header_line(connection, cancellable, error)) != NULL && *line != '\0'){
+            g_free(line);
+        }
+        if(line == NULL){
+            g_string_free(body, TRUE);
+            return NULL;
+        }
+        g_free(line);
+    }
+    else if(content_length >= 0){
+        if(!read_body_bytes(connection, body, content_length, cancellable, error)){
+            g_string_free(body, TRUE);
+            return NULL;
+        }
+    }
+    else{
+        // The body lasts until the connection is closed, so it cannot be used again
+        *keep_alive = 0;
+
+        while((bytes_read = g_input_stream_read(G_INPUT_STREAM(connection->input), buffer, sizeof(buffer), cancellable, error)) > 0){
+            if(body->len + bytes_read > APY_MAX_RESPONSE){
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "The answer from the APY is too long");
+                g_string_free(body, TRUE);
+                return NULL;
+            }
+            g_string_append_len(body, buffer, bytes_read);
+        }
+        if(bytes_read < 0){
+            g_string_free(body, TRUE);
+            return NULL;
+        }
+    }
+
+    return g_string_free(body, FALSE);
+}
+
+/**
+ * @brief Returns the connection pool of an APY, creating it if needed
+ *
+ * The caller must hold pool_mutex
+ * @param address Address of the APY
+ * @return The pool
+ */
+static apy_pool* get_pool(const char *address){
+    apy_pool *pool;
+
+    if((pool = g_hash_table_lookup(pools, address)) == NULL){
+        pool = g_new0(apy_pool, 1);
+        g_queue_init(&pool->idle);
+        g_hash_table_insert(pools, g_strdup(address), pool);
+    }
+
+    return pool;
+}
+
+/**
+ * @brief Closes every connection of a queue
+ *
+ * @param connections Queue of apy_connections, which is left empty
+ */
+static void close_connections(GQueue *connections){
+    apy_connection *connection;
+
+    while((connection = g_queue_pop_head(connections)) != NULL){
+        apy_disconnect(connection);
+    }
+}
+
+/**
+ * @brief Frees a connection pool and closes its idle connections
+ *
+ * Used as the value destroy function of the pools table
+ * @param data The apy_pool
+ */
+static void free_pool(gpointer data){
+    apy_pool *pool = data;
+
+    close_connections(&pool->idle);
+    g_free(pool);
+}
+
+/**
+ * @brief Takes a connection to an APY from its pool, opening a new one if there is no idle connection
+ *
+ * Waits for another request to finish if the APY already has pool_max_active connections in use
+ * @param address Address of the APY
+ * @param endpoint Where the APY must be reached
+ * @param reused Reference to where 1 will be stored if the connection had already been used, or 0 otherwise
+ * @param cancellable Object that can be used to abort the connection, or NULL
+ * @param error Reference to where the error will be stored on failure
+ * @return The connection, which must be given back with pool_release(), or NULL on failure
+ */
+static apy_connection* pool_acquire(const char *address, const apy_endpoint *endpoint, int *reused,
+                                    GCancellable *cancellable, GError **error){
+    gint64 deadline;
+    apy_pool *pool;
+    apy_connection *connection;
+
+    deadline = g_get_monotonic_time() + APY_TIMEOUT * G_TIME_SPAN_SECOND;
+
+    g_mutex_lock(&pool_mutex);
+
+    pool = get_pool(address);
+    while(pool_max_active > 0 && pool->stats.active >= pool_max_active){
+        if(!g_cond_wait_until(&pool_cond, &pool_mutex, deadline)){
+            g_mutex_unlock(&pool_mutex);
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "Too many requests to the APY at the same time");
+            return NULL;
+        }
+    }
+
+    pool->stats.active++;
+    if((connection = g_queue_pop_head(&pool->idle)) != NULL){
+        pool->stats.reused++;
+    }
+
+    g_mutex_unlock(&pool_mutex);
+
+    *reused = connection != NULL;
+    if(connection != NULL){
+        return connection;
+    }
+
+    connection = apy_connect(endpoint, cancellable, error);
+
+    // Pools are only freed by apyFinalize(), so the pointer is still good
+    g_mutex_lock(&pool_mutex);
+    if(connection != NULL){
+        pool->stats.opened++;
+    }
+    else{
+        pool->stats.active--;
+        g_cond_broadcast(&pool_cond);
+    }
+    g_mutex_unlock(&pool_mutex);
+
+    return connection;
+}
+
+/**
+ * @brief Gives a connection taken with pool_acquire() back to its pool
+ *
+ * The connection is closed if it cannot be used again or the pool already has enough idle connections
+ * @param address Address of the APY
+ * @param connection The connection
+ * @param reusable 1 if the connection can be used for another request, or 0 otherwise
+ */
+static void pool_release(const char *address, apy_connection *connection, int reusable){
+    apy_pool *pool;
+
+    g_mutex_lock(&pool_mutex);
+
+    pool = get_pool(address);
+    pool->stats.active--;
+
+    if(reusable && g_queue_get_length(&pool->idle) < pool_max_idle){
+        connection->last_used = g_get_monotonic_time();
+        g_queue_push_head(&pool->idle, connection);
+        connection = NULL;
+    }
+
+    g_cond_broadcast(&pool_cond);
+    g_mutex_unlock(&pool_mutex);
+
+    if(connection != NULL){
+        apy_disconnect(connection);
+    }
+}
+
+/**
+ * @brief Closes the idle connections to an APY
+ *
+ * Used when one of them turns out to have been closed by the APY, as the others probably have been too
+ * @param address Address of the APY
+ */
+static void pool_discard_idle(const char *address){
+    GQueue connections = G_QUEUE_INIT;
+    apy_pool *pool;
+
+    g_mutex_lock(&pool_mutex);
+
+    if((pool = g_hash_table_lookup(pools, address)) != NULL){
+        connections = pool->idle;
+        g_queue_init(&pool->idle);
+    }
+
+    g_mutex_unlock(&pool_mutex);
+
+    close_connections(&connections);
+}
+
+/**
+ * @brief Closes the connections that have been idle for more than APY_POOL_IDLE_TIMEOUT seconds
+ *
+ * Runs on the main loop
+ * @param unused Not used
+ * @return TRUE, so that the timeout source is kept
+ */
+static gboolean reap_idle_connections(gpointer unused){
+    GQueue expired = G_QUEUE_INIT;
+    GHashTableIter iter;
+    gpointer value;
+    gint64 oldest;
+    apy_pool *pool;
+    apy_connection *connection;
+
+    oldest = g_get_monotonic_time() - APY_POOL_IDLE_TIMEOUT * G_TIME_SPAN_SECOND;
+
+    g_mutex_lock(&pool_mutex);
+
+    g_hash_table_iter_init(&iter, pools);
+    while(g_hash_table_iter_next(&iter, NULL, &value)){
+        pool = value;
+        while((connection = g_queue_peek_tail(&pool->idle)) != NULL && connection->last_used < oldest){
+            g_queue_push_tail(&expired, g_queue_pop_tail(&pool->idle));
+        }
+    }
+
+    g_mutex_unlock(&pool_mutex);
+
+    close_connections(&expired);
+
+    return TRUE;
+}
+
+/**
+ * @brief Sends an HTTP request to an APY and waits for its answer
+ *
+ * The connection is taken from the pool of the APY and given back afterwards, so that it can be kept alive.
+ * A request that fails on a reused connection is sent again on a new one, as the APY may have closed it meanwhile
+ * @param address Address of the APY
+ * @param method HTTP method ("GET" or "POST")
+ * @param path Path of the request, relative to the APY address (e.g. "/listPairs")
+ * @param body Form-encoded body of the request, or NULL if there is none
+ * @param status Reference to where the HTTP status code will be stored
+ * @param cancellable Object that can be used to abort the request, or NULL
+ * @param error Reference to where the error will be stored on failure
+ * @return The body of the answer, which must be freed with g_free(), or NULL on failure
+ */
+static char* http_request(const char *address, const char *method, const char *path, const char *body,
+                          int *status, GCancellable *cancellable, GError **error){
+    int reused, keep_alive;
+    char *response = NULL;
+    GString *request;
+    GError *request_error;
+    apy_endpoint endpoint;
+    apy_connection *connection;
+
+    if(!parse_address(address, &endpoint)){
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Malformed APY address");
+        return NULL;
+    }
+
+    request = g_string_new(NULL);
+    g_string_append_printf(request, "%s %s%s HTTP/1.1\r\n", method, endpoint.prefix, path);
+    if(strchr(endpoint.host, ':') != NULL){
+        g_string_append_printf(request, "Host: [%s]:%u\r\n", endpoint.host, endpoint.port);
+    }
+    else{
+        g_string_append_printf(request, "Host: %s:%u\r\n", endpoint.host, endpoint.port);
+    }
+    g_string_append(request, "Accept: application/json\r\n");
+    g_string_append(request, "Connection: keep-alive\r\n");
+    if(body != NULL){
+        g_string_append(request, "Content-Type: application/x-www-form-urlencoded; charset=UTF-8\r\n");
+        g_string_append_printf(request, "Content-Length: %u\r\n", (unsigned int)strlen(body));
+    }
+    g_string_append(request, "\r\n");
+    if(body != NULL){
+        g_string_append(request, body);
+    }
+
+    do{
+        request_error = NULL;
+        keep_alive = 0;
+
+        if((connection = pool_acquire(address, &endpoint, &reused, cancellable, &request_error)) == NULL){
+            break;
+        }
+
+        if(g_output_stream_write_all(connection->output, request->str, request->len, NULL, cancellable, &request_error)){
+            response = read_response(connection, status, &keep_alive, cancellable, &request_error);
+        }
+
+        pool_release(address, connection, response != NULL && keep_alive);
+
+        if(response == NULL && reused && !g_cancellable_is_cancelled(cancellable)){
+            pool_discard_idle(address);
+            g_clear_error(&request_error);
+        }
+    } while(response == NULL && reused && request_error == NULL);
+
+    if(request_error != NULL){
+        g_propagate_error(error, request_error);
+    }
+
+    g_string_free(request, TRUE);
+    free_endpoint(&endpoint);
+
+    return response;
+}
+
+/**
+ * @brief Records the outcome of a request in the health of an APY
+ *
+ * The user is told once when the circuit breaker of the APY opens and once when it closes again, instead of
+ * every message failing while it is open being reported
+ * @param address Address of the APY
+ * @param success 1 if the APY answered, or 0 otherwise
+ * @param latency Time, in microseconds, the request took. Ignored if it failed
+ */
+static void record_health(const char *address, int success, gint64 latency){
+    char *text;
+    guint failures, cooldown;
+
+    switch(apy_health_record(address, success, latency)){
+        case 1:
+            apy_health_get_breaker(&failures, &cooldown);
+            text = g_strdup_printf("Server at %s is not answering and will not be asked again for %u seconds",
+                                   address, cooldown);
+            notify_error(text);
+            g_free(text);
+            break;
+        case -1:
+            text = g_strdup_printf("Server at %s is answering again", address);
+            notify_info(text);
+            g_free(text);
+            break;
+    }
+}
+
+/**
+ * @brief Makes a request to an APY and checks that the APY could handle it
+ *
+ * APYs whose circuit breaker is open fail at once, without any request being sent
+ * @param address Address of the APY
+ * @param method HTTP method ("GET" or "POST")
+ * @param path Path of the request, relative to the APY address (e.g. "/translate")
+ * @param body Form-encoded body of the request, or NULL if there is none
+ * @param cancellable Object that can be used to abort the request, or NULL
+ * @param record 1 to record the outcome and the time taken in the health of the APY, or 0 for requests that say
+ * nothing about how it usually answers, such as warm-ups
+ * @param error_msg Reference to where a description of the error will be stored on failure. It must be freed with g_free()
+ * @return The 'responseData' member of the answer, which must be freed with json_free(), or NULL on failure
+ */
+static json_value* apy_call(const char *address, const char *method, const char *path, const char *body,
+                            GCancellable *cancellable, int record, char **error_msg){
+    char *text;
+    const char *details;
+    int status = 0;
+    gint64 start;
+    json_value *response, *data;
+    GError *error = NULL;
+
+    if(!apy_health_allow(address)){
+        *error_msg = g_strdup_printf("Server at %s is not answering and will not be asked again for a while", address);
+        return NULL;
+    }
+
+    start = g_get_monotonic_time();
+
+    if((text = http_request(address, method, path, body, &status, cancellable, &error)) == NULL){
+        // Requests aborted on purpose say nothing about the APY
+        if(record && !g_cancellable_is_cancelled(cancellable)){
+            record_health(address, 0, 0);
+        }
+        *error_msg = g_strdup_printf("No response from server at %s: %s", address, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    response = json_parse(text, strlen(text));
+    g_free(text);
+
+    if(response == NULL){
+        if(record){
+            record_health(address, 0, 0);
+        }
+        *error_msg = g_strdup_printf("Malformed answer from server at %s (HTTP status %d)", address, status);
+        return NULL;
+    }
+
+    // Errors reported by the APY itself (e.g. an unknown pair) still mean that it is up
+    if(record){
+        record_health(address, 1, g_get_monotonic_time() - start);
+    }
+
+    if(json_get_number(json_object_get(response, "responseStatus"), status) != 200){
+        details = json_get_string(json_object_get(response, "responseDetails"));
+        *error_msg = g_strdup_printf("Error from server at %s: %s", address, details != NULL ? details : "unknown error");
+        json_free(response);
+        return NULL;
+    }
+
+    data = json_object_steal(response, "responseData");
+    json_free(response);
+
+    if(data == NULL){
+        *error_msg = g_strdup_printf("Malformed answer from server at %s", address);
+    }
+
+    return data;
+}
+
+/**
+ * @brief Returns a copy of the APY list, so that it can be walked without holding the lock
+ *
+ * @return A NULL-terminated array of addresses, which must be freed with g_strfreev()
+ */
+static char** copy_apy_list(void){
+    guint i;
+    char **addresses;
+
+    g_mutex_lock(&apy_mutex);
+
+    addresses = g_new(char*, apy_list->len + 1);
+    for(i=0; i<apy_list->len; i++){
+        addresses[i] = g_strdup(g_ptr_array_index(apy_list, i));
+    }
+    addresses[apy_list->len] = NULL;
+
+    g_mutex_unlock(&apy_mutex);
+
+    return addresses;
+}
+
+/**
+ * @brief Stores in the pair catalogue the language pairs sent by an APY
+ *
+ * @param address Address of the APY
+ * @param pairs The list of pairs as sent by the APY
+ */
+static void store_pairs(const char *address, json_value *pairs){
+    guint i, count = 0;
+    char **sources, **targets;
+    const char *source, *target;
+    json_value *pair;
+
+    sources = g_new(char*, json_length(pairs) + 1);
+    targets = g_new(char*, json_length(pairs) + 1);
+
+    for(i=0; i<json_length(pairs); i++){
+        pair = json_array_get(pairs, i);
+        source = json_get_string(json_object_get(pair, "sourceLanguage"));
+        target = json_get_string(json_object_get(pair, "targetLanguage"));
+
+        if(source != NULL && target != NULL){
+            sources[count] = (char*)source;
+            targets[count] = (char*)target;
+            count++;
+        }
+    }
+
+    pair_catalogue_set(address, sources, targets, count);
+
+    g_free(sources);
+    g_free(targets);
+}
+
+/**
+ * @brief Asks an APY for its language pairs and stores them in the pair catalogue
+ *
+ * @param address Address of the APY
+ * @param cancellable Object that can be used to abort the request, or NULL
+ * @param error_msg Reference to where a description of the error will be stored on failure. It must be freed with g_free()
+ * @return 1 on success, or 0 otherwise
+ */
+static int fetch_pairs(const char *address, GCancellable *cancellable, char **error_msg){
+    json_value *pairs;
+
+    if((pairs = apy_call(address, "GET", "/listPairs", NULL, cancellable, 1, error_msg)) == NULL){
+        return 0;
+    }
+
+    store_pairs(address, pairs);
+    json_free(pairs);
+
+    return 1;
+}
+
+/**
+ * @brief Makes sure the pair catalogue knows the language pairs of an APY
+ *
+ * The APY is only asked if its pairs are unknown or expired. If it cannot be reached, expired pairs are kept
+ * @param address Address of the APY
+ * @param error_msg Reference to where a description of the error will be stored on failure. It must be freed with g_free()
+ * @return 1 if the pairs of the APY are known, or 0 otherwise
+ */
+static int ensure_pairs(const char *address, char **error_msg){
+    int fresh;
+    char *fetch_error = NULL;
+
+    if((fresh = pair_catalogue_is_fresh(address)) == 1 || fetch_pairs(address, NULL, &fetch_error)){
+        return 1;
+    }
+
+    if(fresh == 0){
+        g_free(fetch_error);
+        return 1;
+    }
+
+    g_free(*error_msg);
+    *error_msg = fetch_error;
+    return 0;
+}
+
+/**
+ * @brief Asks every APY for its language pairs, which refreshes both their figures and the pair catalogue
+ *
+ * Runs on a worker thread, as a background task
+ * @param unused Not used
+ */
+static void probe_apys(gpointer unused){
+    int i;
+    char **addresses, *error_msg;
+
+    addresses = copy_apy_list();
+
+    for(i=0; addresses[i] != NULL && !g_cancellable_is_cancelled(probe_cancellable); i++){
+        error_msg = NULL;
+        fetch_pairs(addresses[i], probe_cancellable, &error_msg);
+        g_free(error_msg);
+    }
+
+    g_strfreev(addresses);
+}
+
+/**
+ * @brief Allows the next probes to start
+ *
+ * Runs on the main loop
+ * @param unused Not used
+ */
+static void probe_apys_done(gpointer unused){
+    probe_running = 0;
+}
+
+/**
+ * @brief Starts probing the APYs, unless the previous probes have not finished yet
+ *
+ * Runs on the main loop
+ * @param unused Not used
+ * @return TRUE, so that the timeout source is kept
+ */
+static gboolean start_probes(gpointer unused){
+    if(probe_running){
+        return TRUE;
+    }
+
+    probe_running = 1;
+    worker_pool_push(WORKER_PRIORITY_BACKGROUND, probe_apys, probe_apys_done, NULL);
+
+    return TRUE;
+}
+
+/**
+ * @brief Initializes the APY list with its default address
+ *
+ * Must be called before any other function in this file
+ */
+void apyInit(void){
+    apy_list = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(apy_list, g_strdup(APY_DEFAULT_ADDRESS));
+
+    pools = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_pool);
+    latencies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    weights = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    warmed_pairs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    apy_health_init();
+    probe_cancellable = g_cancellable_new();
+    request_cancellable = g_cancellable_new();
+    probe_source = g_timeout_add_seconds(APY_PROBE_INTERVAL, start_probes, NULL);
+    reaper_source = g_timeout_add_seconds(APY_POOL_REAP_INTERVAL, reap_idle_connections, NULL);
+}
+
+/**
+ * @brief Stops probing the APYs and aborts the probes and warm-ups in progress
+ *
+ * Must be called from the main loop before the worker pool is shut down, so that it does not wait for them
+ */
+void apyStopProbes(void){
+    if(probe_source != 0){
+        g_source_remove(probe_source);
+        probe_source = 0;
+    }
+
+    g_cancellable_cancel(probe_cancellable);
+}
+
+/**
+ * @brief Aborts the translation requests in progress, and makes the next ones fail at once
+ *
+ * Must be called from the main loop before the worker pool is shut down, so that it does not wait for an APY that
+ * is not answering
+ */
+void apyCancelRequests(void){
+    g_cancellable_cancel(request_cancellable);
+}
+
+/**
+ * @brief Frees the APY list and closes every connection
+ *
+ * No other thread may be making requests when this function is called
+ */
+void apyFinalize(void){
+    apyStopProbes();
+    g_object_unref(probe_cancellable);
+    probe_cancellable = NULL;
+    g_object_unref(request_cancellable);
+    request_cancellable = NULL;
+
+    // Requests cancelled by hedging may still be finishing
+    if(hedge_pool != NULL){
+        g_thread_pool_free(hedge_pool, FALSE, TRUE);
+        hedge_pool = NULL;
+    }
+
+    g_source_remove(reaper_source);
+    reaper_source = 0;
+
+    g_hash_table_destroy(pools);
+    pools = NULL;
+
+    g_hash_table_destroy(latencies);
+    latencies = NULL;
+
+    g_hash_table_destroy(weights);
+    weights = NULL;
+
+    g_hash_table_destroy(warmed_pairs);
+    warmed_pairs = NULL;
+
+    apy_health_shutdown();
+
+    g_ptr_array_free(apy_list, TRUE);
+    apy_list = NULL;
+}
+
+/**
+ * @brief Replaces the APY list
+ *
+ * Used to restore the list stored in the preferences file. The addresses are not checked
+ * @param addresses Array with the new addresses, in order. The strings are copied
+ * @param count Number of addresses
+ */
+void apySetList(char **addresses, int count){
+    int i;
+
+    g_mutex_lock(&apy_mutex);
+
+    g_ptr_array_set_size(apy_list, 0);
+    for(i=0; i<count; i++){
+        if(addresses[i] != NULL){
+            g_ptr_array_add(apy_list, g_strdup(addresses[i]));
+        }
+    }
+
+    g_mutex_unlock(&apy_mutex);
+}
+
+/**
+ * @brief Retrieves a list with all the APYs
+ *
+ * @param list References to a 2-level char array where the apy list will be stored
+ * Both the list parameter and each of its strings must be freed after their use
+ * @return The number of addresses returned or -1 if an error occured
+ */
+int getAPYAddress(char ***list){
+    int i, size;
+
+    g_mutex_lock(&apy_mutex);
+
+    size = apy_list->len;
+    *list = malloc(sizeof(char*)*(size > 0 ? size : 1));
+    for(i=0; i<size; i++){
+        (*list)[i] = copy_string(g_ptr_array_index(apy_list, i));
+    }
+
+    g_mutex_unlock(&apy_mutex);
+
+    return size;
+}
+
+/**
+ * @brief Adds an address to the list of APYs the requests will be sent to
+ *
+ * The address will not be set if there is no response from an APY server at it.
+ * If the address was already in the list, it is moved to its new position
+ * @param address Pointer to a string with the new address
+ * @param port Pointer to a string with the new port. NULL if no port is needed
+ * @param order Position this address will take in the list. Negative value to append at the end
+ * @param force Any number that is not 0 indicates the function to forcefully change the address,
+ * despite not receiving an answer from the server
+ * @return 1 if the call was successful and the address was set, or 0 otherwise
+ */
+int setAPYAddress(char* address, char* port, int order, int force){
+    char *new_address, *error_msg;
+    guint i;
+    json_value *pairs;
+
+    if(port != NULL){
+        new_address = g_strdup_printf("%s:%s", address, port);
+    }
+    else{
+        new_address = g_strdup(address);
+    }
+
+    if(!force){
+        if((pairs = apy_call(new_address, "GET", "/listPairs", NULL, NULL, 1, &error_msg)) == NULL){
+            notify_error(error_msg);
+            g_free(error_msg);
+            g_free(new_address);
+            return 0;
+        }
+        // The answer is as good as any later one, so the catalogue need not ask again
+        store_pairs(new_address, pairs);
+        json_free(pairs);
+    }
+
+    g_mutex_lock(&apy_mutex);
+
+    for(i=0; i<apy_list->len; i++){
+        if(!strcmp(g_ptr_array_index(apy_list, i), new_address)){
+            g_ptr_array_remove_index(apy_list, i);
+            break;
+        }
+    }
+
+    if(order < 0 || (guint)order > apy_list->len){
+        g_ptr_array_add(apy_list, new_address);
+    }
+    else{
+        g_ptr_array_insert(apy_list, order, new_address);
+    }
+
+    g_mutex_unlock(&apy_mutex);
+
+    return 1;
+}
+
+/**
+ * @brief Removes the APY address at the given position in the APY list
+ *
+ * @param position Position in the list of the address to be removed
+ * @return 1 on success, or 0 otherwise
+ */
+int removeAPYAddress(int position){
+    char *address = NULL;
+
+    g_mutex_lock(&apy_mutex);
+
+    if(position >= 0 && (guint)position < apy_list->len){
+        address = g_strdup(g_ptr_array_index(apy_list, position));
+        g_ptr_array_remove_index(apy_list, position);
+    }
+
+    g_mutex_unlock(&apy_mutex);
+
+    if(address == NULL){
+        return 0;
+    }
+
+    pair_catalogue_forget(address);
+    apy_health_forget(address);
+    pool_discard_idle(address);
+    g_free(address);
+
+    return 1;
+}
+
+/**
+ * @brief Retrieves the usage figures of the connection pool of an APY
+ *
+ * @param address Address of the APY
+ * @param stats Reference to where the figures will be stored
+ */
+void getAPYPoolStats(const char* address, apy_pool_stats* stats){
+    apy_pool *pool;
+
+    memset(stats, 0, sizeof(*stats));
+
+    g_mutex_lock(&pool_mutex);
+
+    if((pool = g_hash_table_lookup(pools, address)) != NULL){
+        *stats = pool->stats;
+        stats->idle = g_queue_get_length(&pool->idle);
+    }
+
+    g_mutex_unlock(&pool_mutex);
+}
+
+/**
+ * @brief Changes how many connections are kept open to each APY
+ *
+ * Idle connections beyond the new limit are closed when they are next used
+ * @param max_idle Maximum number of idle connections kept open to each APY. 0 closes every connection after its request
+ * @param max_active Maximum number of connections in use to each APY at the same time. 0 means no limit
+ */
+void setAPYPoolLimits(unsigned int max_idle, unsigned int max_active){
+    g_mutex_lock(&pool_mutex);
+
+    pool_max_idle = max_idle;
+    pool_max_active = max_active;
+    g_cond_broadcast(&pool_cond);
+
+    g_mutex_unlock(&pool_mutex);
+}
+
+/**
+ * @brief Retrieves how many connections are kept open to each APY
+ *
+ * @param max_idle Reference to where the maximum number of idle connections will be stored
+ * @param max_active Reference to where the maximum number of connections in use will be stored
+ */
+void getAPYPoolLimits(unsigned int* max_idle, unsigned int* max_active){
+    g_mutex_lock(&pool_mutex);
+
+    *max_idle = pool_max_idle;
+    *max_active = pool_max_active;
+
+    g_mutex_unlock(&pool_mutex);
+}
+
+/**
+ * @brief Retrieves a list of all the available language pairs
+ *
+ * The pairs of every APY in the list are merged. They are taken from the pair catalogue, so the APYs are only asked
+ * if their pairs have expired
+ * @param pairList Reference to a 3-level char pointer where the pairs will be stored. <br>
+ * Pair 'n' is stored in pairList[n] and its two languages are pairList[n][0] (source) and pairList[n][1] (target). <br>
+ * pairList[x][y], pairList[x] and pairList must all be freed after their use.
+ * @return Number of language pairs if the call was successful, or 0 otherwise<br>
+ */
+int getAllPairs(char**** pairList){
+    int i, j, count, known = 0;
+    char **addresses, **sources, **targets, *key, *error_msg = NULL;
+    GHashTable *seen;
+    GPtrArray *pairs;
+
+    seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    pairs = g_ptr_array_new();
+    addresses = copy_apy_list();
+
+    for(i=0; addresses[i] != NULL; i++){
+        if(!ensure_pairs(addresses[i], &error_msg) ||
+           (count = pair_catalogue_get(addresses[i], &sources, &targets)) < 0){
+            continue;
+        }
+        known = 1;
+
+        for(j=0; j<count; j++){
+            key = g_strdup_printf("%s\t%s", sources[j], targets[j]);
+
+            if(g_hash_table_contains(seen, key)){
+                g_free(key);
+                continue;
+            }
+            g_hash_table_add(seen, key);
+
+            g_ptr_array_add(pairs, copy_string(sources[j]));
+            g_ptr_array_add(pairs, copy_string(targets[j]));
+        }
+
+        g_strfreev(sources);
+        g_strfreev(targets);
+    }
+
+    if(!known){
+        notify_error(error_msg != NULL ? error_msg : "The APY list is empty");
+    }
+
+    count = pairs->len / 2;
+    if(count > 0){
+        *pairList = malloc(sizeof(char**)*count);
+        for(i=0; i<count; i++){
+            (*pairList)[i] = malloc(sizeof(char*)*2);
+            (*pairList)[i][0] = g_ptr_array_index(pairs, 2*i);
+            (*pairList)[i][1] = g_ptr_array_index(pairs, 2*i+1);
+        }
+    }
+
+    g_ptr_array_free(pairs, TRUE);
+    g_hash_table_destroy(seen);
+    g_strfreev(addresses);
+    g_free(error_msg);
+
+    return count;
+}
+
+/**
+ * @brief Checks if a given language pair is available
+ *
+ * The pair catalogue is looked up, so the APYs are only asked if their pairs have expired
+ * @param source String containing the source language
+ * @param target String containing the target language
+ * @return 1 if the call was successful and the language pair exists, or 0 otherwise
+ */
+int pairExists(char* source, char* target){
+    int i, exists = 0, known = 0;
+    char **addresses, *error_msg = NULL;
+
+    addresses = copy_apy_list();
+
+    for(i=0; addresses[i] != NULL && !exists; i++){
+        if(ensure_pairs(addresses[i], &error_msg)){
+            known = 1;
+            exists = pair_catalogue_contains(addresses[i], source, target) == 1;
+        }
+    }
+
+    if(!known){
+        notify_error(error_msg != NULL ? error_msg : "The APY list is empty");
+    }
+    else if(!exists){
+        notify_error("Pair does not exist");
+    }
+
+    g_strfreev(addresses);
+    g_free(error_msg);
+
+    return exists;
+}
+
+/**
+ * @brief Asks every APY for its language pairs, even if the ones in the pair catalogue have not expired
+ *
+ * @return The number of APYs that answered
+ */
+int refreshPairs(void){
+    int i, answered = 0;
+    char **addresses, *error_msg = NULL;
+
+    addresses = copy_apy_list();
+
+    for(i=0; addresses[i] != NULL; i++){
+        g_free(error_msg);
+        error_msg = NULL;
+
+        answered += fetch_pairs(addresses[i], request_cancellable, &error_msg);
+    }
+
+    if(answered == 0){
+        notify_error(error_msg != NULL ? error_msg : "The APY list is empty");
+    }
+
+    g_strfreev(addresses);
+    g_free(error_msg);
+
+    return answered;
+}
+
+/**
+ * @brief Records how long an APY took to translate a text
+ *
+ * @param address Address of the APY
+ * @param latency Time the request took, in microseconds
+ */
+static void record_latency(const char *address, gint64 latency){
+    apy_latency *samples;
+
+    g_mutex_lock(&latency_mutex);
+
+    if((samples = g_hash_table_lookup(latencies, address)) == NULL){
+        samples = g_new0(apy_latency, 1);
+        g_hash_table_insert(latencies, g_strdup(address), samples);
+    }
+
+    samples->samples[samples->next] = latency;
+    samples->next = (samples->next + 1) % APY_LATENCY_SAMPLES;
+    if(samples->count < APY_LATENCY_SAMPLES){
+        samples->count++;
+    }
+
+    g_mutex_unlock(&latency_mutex);
+}
+
+/**
+ * @brief Compares two latencies, for qsort()
+ *
+ * @param a The first latency
+ * @param b The second latency
+ * @return A negative number, zero or a positive number if a is lower than, equal to or greater than b
+ */
+static int compare_latencies(const void *a, const void *b){
+    gint64 first = *(const gint64*)a, second = *(const gint64*)b;
+
+    return first < second ? -1 : first > second;
+}
+
+/**
+ * @brief Returns how long to wait for an APY before asking the next one too
+ *
+ * The delay is the APY_HEDGE_PERCENTILE percentile of the latest latencies of the APY, so only its slowest
+ * requests are hedged
+ * @param address Address of the APY
+ * @return The delay, in microseconds
+ */
+static gint64 hedge_delay(const char *address){
+    gint64 sorted[APY_LATENCY_SAMPLES], delay = APY_HEDGE_DEFAULT_DELAY;
+    guint count = 0;
+    apy_latency *samples;
+
+    g_mutex_lock(&latency_mutex);
+
+    if((samples = g_hash_table_lookup(latencies, address)) != NULL){
+        count = samples->count;
+        memcpy(sorted, samples->samples, sizeof(gint64)*count);
+    }
+
+    g_mutex_unlock(&latency_mutex);
+
+    if(count >= APY_HEDGE_MIN_SAMPLES){
+        qsort(sorted, count, sizeof(gint64), compare_latencies);
+        delay = sorted[(count - 1) * APY_HEDGE_PERCENTILE / 100];
+    }
+
+    return CLAMP(delay, APY_HEDGE_MIN_DELAY, APY_TIMEOUT * G_TIME_SPAN_SECOND);
+}
+
+/**
+ * @brief Asks an APY to translate a text
+ *
+ * The time the APY took is recorded if it succeeds
+ * @param address Address of the APY
+ * @param method HTTP method ("GET" or "POST")
+ * @param path Path of the request, relative to the APY address
+ * @param body Form-encoded body of the request, or NULL if there is none
+ * @param cancellable Object that can be used to abort the request, or NULL
+ * @param error_msg Reference to where a description of the error will be stored on failure. It must be freed with g_free()
+ * @return The translated text, which must be freed with g_free(), or NULL on failure
+ */
+static char* try_translation(const char *address, const char *method, const char *path, const char *body,
+                             GCancellable *cancellable, char **error_msg){
+    char *translation = NULL;
+    const char *result;
+    gint64 start;
+    json_value *data;
+
+    start = g_get_monotonic_time();
+
+    if((data = apy_call(address, method, path, body, cancellable, 1, error_msg)) != NULL){
+        if((result = json_get_string(json_object_get(data, "translatedText"))) != NULL){
+            translation = g_strdup(result);
+            record_latency(address, g_get_monotonic_time() - start);
+        }
+        else{
+            *error_msg = g_strdup_printf("Malformed answer from server at %s", address);
+        }
+        json_free(data);
+    }
+
+    return translation;
+}
+
+/**
+ * @brief Releases a reference to a hedged request, freeing it when it was the last one
+ *
+ * @param hedge The hedged request
+ */
+static void hedge_unref(hedged_request *hedge){
+    if(!g_atomic_int_dec_and_test(&hedge->references)){
+        return;
+    }
+
+    g_ptr_array_free(hedge->cancellables, TRUE);
+    g_mutex_clear(&hedge->mutex);
+    g_cond_clear(&hedge->cond);
+    g_free(hedge->method);
+    g_free(hedge->path);
+    g_free(hedge->body);
+    g_free(hedge->translation);
+    g_free(hedge->error_msg);
+    g_free(hedge);
+}
+
+/**
+ * @brief Aborts a hedge_attempt when the translation requests are cancelled
+ *
+ * @param unused The cancelled object
+ * @param data The GCancellable of the attempt
+ */
+static void cancel_hedge_attempt(GCancellable *unused, gpointer data){
+    g_cancellable_cancel(data);
+}
+
+/**
+ * @brief Sends a hedged request to one of the APYs and hands the result to the thread waiting for it
+ *
+ * The delay before the next APY is asked only starts to run here, so that the time the request waited for a thread
+ * is not held against the APY. The first translation received cancels the requests still running. Runs on a
+ * thread of hedge_pool
+ * @param data The hedge_attempt
+ * @param unused Not used
+ */
+static void hedge_attempt_run(gpointer data, gpointer unused){
+    hedge_attempt *attempt = data;
+    hedged_request *hedge = attempt->hedge;
+    char *translation, *error_msg = NULL;
+    gulong handler;
+    guint i;
+
+    g_mutex_lock(&hedge->mutex);
+    if(attempt->order == hedge->latest){
+        hedge->deadline = g_get_monotonic_time() + attempt->delay;
+        g_cond_broadcast(&hedge->cond);
+    }
+    g_mutex_unlock(&hedge->mutex);
+
+    handler = g_cancellable_connect(request_cancellable, G_CALLBACK(cancel_hedge_attempt), attempt->cancellable, NULL);
+
+    translation = try_translation(attempt->address, hedge->method, hedge->path, hedge->body,
+                                  attempt->cancellable, &error_msg);
+
+    g_cancellable_disconnect(request_cancellable, handler);
+
+    g_mutex_lock(&hedge->mutex);
+
+    hedge->running--;
+    if(translation != NULL && hedge->translation == NULL){
+        hedge->translation = translation;
+        translation = NULL;
+
+        for(i=0; i<hedge->cancellables->len; i++){
+            if(g_ptr_array_index(hedge->cancellables, i) != attempt->cancellable){
+                g_cancellable_cancel(g_ptr_array_index(hedge->cancellables, i));
+            }
+        }
+    }
+    else if(translation == NULL && !g_cancellable_is_cancelled(attempt->cancellable)){
+        g_free(hedge->error_msg);
+        hedge->error_msg = error_msg;
+        error_msg = NULL;
+    }
+
+    g_cond_broadcast(&hedge->cond);
+    g_mutex_unlock(&hedge->mutex);
+
+    g_free(translation);
+    g_free(error_msg);
+    g_free(attempt->address);
+    g_free(attempt);
+    hedge_unref(hedge);
+}
+
+/**
+ * @brief Orders the hedge_attempts waiting for a thread of hedge_pool
+ *
+ * The request to the first APY of a hedged translation goes before the requests to the next ones, so that a
+ * translation never waits behind the hedges of the others
+ * @param a A hedge_attempt
+ * @param b Another hedge_attempt
+ * @param unused Not used
+ * @return A negative value if a goes first, or a positive value otherwise
+ */
+static gint compare_hedge_attempts(gconstpointer a, gconstpointer b, gpointer unused){
+    const hedge_attempt *first = a, *second = b;
+
+    if((first->order == 0) != (second->order == 0)){
+        return first->order == 0 ? -1 : 1;
+    }
+
+    return first->sequence < second->sequence ? -1 : 1;
+}
+
+/**
+ * @brief Starts sending a hedged request to an APY
+ *
+ * The caller must hold the mutex of the hedged request
+ * @param hedge The hedged request
+ * @param address Address of the APY
+ * @param order Position of the APY among the APYs asked by the hedged request, starting at 0
+ * @param delay Time the APY is given to answer once its request has started, in microseconds
+ */
+static void hedge_start(hedged_request *hedge, const char *address, int order, gint64 delay){
+    hedge_attempt *attempt;
+    GThreadPool *pool;
+
+    if(g_once_init_enter(&hedge_pool)){
+        pool = g_thread_pool_new(hedge_attempt_run, NULL, APY_HEDGE_THREADS, FALSE, NULL);
+        g_thread_pool_set_sort_function(pool, compare_hedge_attempts, NULL);
+        g_once_init_leave(&hedge_pool, pool);
+    }
+
+    attempt = g_new(hedge_attempt, 1);
+    attempt->hedge = hedge;
+    attempt->address = g_strdup(address);
+    attempt->cancellable = g_cancellable_new();
+    attempt->order = order;
+    attempt->delay = delay;
+    attempt->sequence = (guint)g_atomic_int_add(&hedge_sequence, 1);
+
+    g_ptr_array_add(hedge->cancellables, attempt->cancellable);
+    g_atomic_int_inc(&hedge->references);
+    hedge->running++;
+    hedge->latest = order;
+    hedge->deadline = G_MAXINT64;
+
+    g_thread_pool_push(hedge_pool, attempt, NULL);
+}
+
+/**
+ * @brief Asks the APYs to translate a text, asking the next APY too whenever the previous ones are slow
+ *
+ * The APYs are asked in order. The next one is asked as soon as the previous ones have failed, or when the last one
+ * asked has not answered within its hedge_delay() of its request starting. The first translation received is used
+ * @param addresses NULL-terminated array with the addresses of the APYs
+ * @param method HTTP method ("GET" or "POST")
+ * @param path Path of the request, relative to the APY address
+ * @param body Form-encoded body of the request, or NULL if there is none
+ * @param error_msg Reference to where a description of the error will be stored on failure. It must be freed with g_free()
+ * @return The translated text, which must be freed with g_free(), or NULL on failure
+ */
+static char* hedged_translation(char **addresses, const char *method, const char *path, const char *body,
+                                char **error_msg){
+    int next = 0;
+    char *translation;
+    hedged_request *hedge;
+
+    hedge = g_new0(hedged_request, 1);
+    hedge->references = 1;
+    hedge->method = g_strdup(method);
+    hedge->path = g_strdup(path);
+    hedge->body = g_strdup(body);
+    hedge->cancellables = g_ptr_array_new_with_free_func(g_object_unref);
+    g_mutex_init(&hedge->mutex);
+    g_cond_init(&hedge->cond);
+
+    g_mutex_lock(&hedge->mutex);
+
+    while(hedge->translation == NULL){
+        if(addresses[next] != NULL && (hedge->running == 0 || g_get_monotonic_time() >= hedge->deadline)){
+            hedge_start(hedge, addresses[next], next, hedge_delay(addresses[next]));
+            next++;
+        }
+        else if(hedge->running == 0){
+            break;
+        }
+        else if(addresses[next] != NULL && hedge->deadline != G_MAXINT64){
+            g_cond_wait_until(&hedge->cond, &hedge->mutex, hedge->deadline);
+        }
+        else{
+            g_cond_wait(&hedge->cond, &hedge->mutex);
+        }
+    }
+
+    translation = hedge->translation;
+    hedge->translation = NULL;
+    *error_msg = translation == NULL ? g_strdup(hedge->error_msg) : NULL;
+
+    g_mutex_unlock(&hedge->mutex);
+    hedge_unref(hedge);
+
+    return translation;
+}
+
+/**
+ * @brief Returns the APYs that may translate a language pair
+ *
+ * APYs whose pairs are known but do not include this one are left out. APYs whose pairs are not known yet are kept
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @return A NULL-terminated array of addresses in the order of the APY list, which must be freed with g_strfreev()
+ */
+static char** route_pair(const char *source, const char *target){
+    int i, kept = 0;
+    char **addresses;
+
+    addresses = copy_apy_list();
+
+    for(i=0; addresses[i] != NULL; i++){
+        if(pair_catalogue_contains(addresses[i], source, target) != 0){
+            addresses[kept++] = addresses[i];
+        }
+        else{
+            g_free(addresses[i]);
+        }
+    }
+    addresses[kept] = NULL;
+
+    return addresses;
+}
+
+/**
+ * @brief Returns the number of requests in progress to an APY
+ *
+ * @param address Address of the APY
+ * @return The number of connections to the APY in use
+ */
+static guint outstanding_requests(const char *address){
+    apy_pool_stats stats;
+
+    getAPYPoolStats(address, &stats);
+    return stats.active;
+}
+
+/**
+ * @brief Moves an APY to the front of a list, keeping the order of the others
+ *
+ * @param addresses NULL-terminated array of addresses
+ * @param position Position of the APY to move
+ */
+static void move_to_front(char **addresses, int position){
+    char *address = addresses[position];
+
+    memmove(addresses + 1, addresses, position * sizeof(char*));
+    addresses[0] = address;
+}
+
+/**
+ * @brief Reorders the APYs a request will be sent to according to the policy
+ *
+ * The APYs after the first one are still asked if it fails, so every policy keeps the failover of the list
+ * @param addresses NULL-terminated array of addresses, in the order of the APY list
+ */
+static void balance_apys(char **addresses){
+    int i, j, count;
+    guint total = 0, pick;
+    guint *load;
+    char *address;
+
+    for(count=0; addresses[count] != NULL; count++);
+    if(count < 2){
+        return;
+    }
+
+    switch(g_atomic_int_get(&policy)){
+        case APY_POLICY_FASTEST:
+            apy_health_sort(addresses);
+            break;
+
+        case APY_POLICY_ROUND_ROBIN:
+            // Rotating the whole list keeps the APYs after the first one in the order of the list
+            pick = (guint)g_atomic_int_add(&round_robin_turn, 1) % count;
+            for(i=0; (guint)i<pick; i++){
+                move_to_front(addresses, count - 1);
+            }
+            break;
+
+        case APY_POLICY_LEAST_OUTSTANDING:
+            // Stable insertion sort, so that ties keep the order of the list
+            load = g_new(guint, count);
+            for(i=0; i<count; i++){
+                load[i] = outstanding_requests(addresses[i]);
+            }
+            for(i=1; i<count; i++){
+                pick = load[i];
+                address = addresses[i];
+                for(j=i; j>0 && load[j-1] > pick; j--){
+                    load[j] = load[j-1];
+                    addresses[j] = addresses[j-1];
+                }
+                load[j] = pick;
+                addresses[j] = address;
+            }
+            g_free(load);
+            break;
+
+        case APY_POLICY_WEIGHTED:
+            load = g_new(guint, count);
+            for(i=0; i<count; i++){
+                load[i] = getAPYWeight(addresses[i]);
+                total += load[i];
+            }
+            // APYs with weight 0 are only asked when the others fail
+            if(total > 0){
+                pick = (guint)g_random_int_range(0, (gint32)total);
+                for(i=0; pick >= load[i]; i++){
+                    pick -= load[i];
+                }
+                move_to_front(addresses, i);
+            }
+            g_free(load);
+            break;
+    }
+}
+
+/**
+ * @brief Checks whether the circuit breakers of every APY of a list are open
+ *
+ * @param addresses NULL-terminated array of addresses
+ * @return 1 if no APY of the list is asked normally, or 0 otherwise
+ */
+static int breakers_open(char **addresses){
+    int i;
+    apy_health_stats stats;
+
+    for(i=0; addresses[i] != NULL; i++){
+        apy_health_get(addresses[i], &stats);
+        if(stats.breaker == APY_BREAKER_CLOSED){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Asks the APYs in order to translate a text, until one of them does
+ *
+ * Only the APYs that offer the language pair are asked (see route_pair()). They are asked in the order
+ * given by the policy (see balance_apys()).
+ * If hedging is enabled, slow APYs do not hold back the next ones (see hedged_translation())
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param method HTTP method ("GET" or "POST")
+ * @param path Path of the request, relative to the APY address
+ * @param body Form-encoded body of the request, or NULL if there is none
+ * @param error_msg Reference to where a description of the error will be stored on failure. It must be freed with g_free().
+ * NULL is stored instead if the breakers of every APY of the pair are open, as the user was told when they opened
+ * @return The translated text, which must be freed with g_free(), or NULL on failure
+ */
+static char* request_translation(const char *source, const char *target, const char *method, const char *path,
+                                 const char *body, char **error_msg){
+    int i;
+    char **addresses, *translation = NULL;
+
+    *error_msg = NULL;
+    addresses = route_pair(source, target);
+
+    if(addresses[0] == NULL){
+        *error_msg = g_strdup_printf("No APY offers the pair %s-%s", source, target);
+        g_strfreev(addresses);
+        return NULL;
+    }
+
+    balance_apys(addresses);
+
+    if(g_atomic_int_get(&hedging) && addresses[0] != NULL && addresses[1] != NULL){
+        translation = hedged_translation(addresses, method, path, body, error_msg);
+    }
+    else{
+        for(i=0; addresses[i] != NULL && translation == NULL; i++){
+            g_free(*error_msg);
+            *error_msg = NULL;
+
+            translation = try_translation(addresses[i], method, path, body, request_cancellable, error_msg);
+        }
+    }
+
+    if(translation == NULL && *error_msg == NULL){
+        *error_msg = g_strdup("The APY list is empty");
+    }
+
+    if(translation == NULL && breakers_open(addresses)){
+        g_free(*error_msg);
+        *error_msg = NULL;
+    }
+
+    g_strfreev(addresses);
+    return translation;
+}
+
+/**
+ * @brief Sends a tiny translation of a language pair to every APY that offers it
+ *
+ * The first request of a pair makes an APY start the pipeline of the pair, which takes much longer than a
+ * translation, and leaves an open connection in the pool. Nothing is recorded in the health of the APYs, as the
+ * time taken is not that of a translation, so APYs whose breaker is not closed are skipped: a warm-up would use up
+ * the single request that checks whether they have recovered. Runs on a worker thread, as a background task
+ * @param data The warm_up_task
+ */
+static void warm_up_run(gpointer data){
+    warm_up_task *task = data;
+    int i;
+    char *pair, *escaped_pair, *path, **addresses, *error_msg;
+    json_value *result;
+    apy_health_stats stats;
+
+    pair = g_strdup_printf("%s|%s", task->source, task->target);
+    escaped_pair = g_uri_escape_string(pair, NULL, FALSE);
+    path = g_strdup_printf("/translate?langpair=%s&q=%s", escaped_pair, APY_WARM_UP_TEXT);
+
+    addresses = route_pair(task->source, task->target);
+
+    for(i=0; addresses[i] != NULL && !g_cancellable_is_cancelled(probe_cancellable); i++){
+        apy_health_get(addresses[i], &stats);
+        if(stats.breaker != APY_BREAKER_CLOSED){
+            continue;
+        }
+
+        error_msg = NULL;
+        if((result = apy_call(addresses[i], "GET", path, NULL, probe_cancellable, 0, &error_msg)) != NULL){
+            json_free(result);
+        }
+        g_free(error_msg);
+    }
+
+    g_strfreev(addresses);
+    g_free(path);
+    g_free(escaped_pair);
+    g_free(pair);
+}
+
+/**
+ * @brief Frees a warm-up task
+ *
+ * Runs on the main loop
+ * @param data The warm_up_task
+ */
+static void warm_up_done(gpointer data){
+    warm_up_task *task = data;
+
+    g_free(task->source);
+    g_free(task->target);
+    g_free(task);
+}
+
+/**
+ * @brief Has every APY that offers a language pair get ready to translate it, in the background
+ *
+ * Nothing is done if the pair has been warmed up in the last APY_WARM_UP_INTERVAL seconds.
+ * Must be called from the main loop
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ */
+void warmUpPair(const char* source, const char* target){
+    char *pair;
+    gint64 now, *last;
+    warm_up_task *task;
+
+    pair = g_strdup_printf("%s|%s", source, target);
+    now = g_get_monotonic_time() / G_USEC_PER_SEC;
+
+    if((last = g_hash_table_lookup(warmed_pairs, pair)) != NULL && now - *last < APY_WARM_UP_INTERVAL){
+        g_free(pair);
+        return;
+    }
+
+    last = g_new(gint64, 1);
+    *last = now;
+    g_hash_table_insert(warmed_pairs, pair, last);
+
+    task = g_new(warm_up_task, 1);
+    task->source = g_strdup(source);
+    task->target = g_strdup(target);
+    worker_pool_push(WORKER_PRIORITY_BACKGROUND, warm_up_run, warm_up_done, task);
+}
+
+/**
+ * @brief Enables or disables hedged translation requests
+ *
+ * While enabled, a translation request is also sent to the next APY in the list whenever the previous ones take
+ * longer than usual to answer, and the first translation received is used
+ * @param enabled 1 to enable hedging, or 0 to disable it
+ */
+void setAPYHedging(int enabled){
+    g_atomic_int_set(&hedging, enabled != 0);
+}
+
+/**
+ * @brief Checks whether hedged translation requests are enabled
+ *
+ * @return 1 if hedging is enabled, or 0 otherwise
+ */
+int getAPYHedging(void){
+    return g_atomic_int_get(&hedging);
+}
+
+/**
+ * @brief Changes the order in which the APYs are asked to translate
+ *
+ * @param new_policy One of apy_policy
+ */
+void setAPYPolicy(int new_policy){
+    g_atomic_int_set(&policy, new_policy);
+}
+
+/**
+ * @brief Retrieves the order in which the APYs are asked to translate
+ *
+ * @return One of apy_policy
+ */
+int getAPYPolicy(void){
+    return g_atomic_int_get(&policy);
+}
+
+/**
+ * @brief Changes the weight of an APY for APY_POLICY_WEIGHTED
+ *
+ * An APY with twice the weight of another is asked first twice as often. APYs with weight 0 are only asked
+ * when the others fail
+ * @param address Address of the APY
+ * @param weight The new weight
+ */
+void setAPYWeight(const char* address, unsigned int weight){
+    g_mutex_lock(&apy_mutex);
+
+    if(weight == APY_DEFAULT_WEIGHT){
+        g_hash_table_remove(weights, address);
+    }
+    else{
+        g_hash_table_insert(weights, g_strdup(address), GUINT_TO_POINTER(weight));
+    }
+
+    g_mutex_unlock(&apy_mutex);
+}
+
+/**
+ * @brief Retrieves the weight of an APY for APY_POLICY_WEIGHTED
+ *
+ * @param address Address of the APY
+ * @return The weight of the APY
+ */
+unsigned int getAPYWeight(const char* address){
+    gpointer weight;
+    unsigned int result = APY_DEFAULT_WEIGHT;
+
+    g_mutex_lock(&apy_mutex);
+
+    if(g_hash_table_lookup_extended(weights, address, NULL, &weight)){
+        result = GPOINTER_TO_UINT(weight);
+    }
+
+    g_mutex_unlock(&apy_mutex);
+
+    return result;
+}
+
+/**
+ * @brief Translates a given text, reporting the error to the user if it fails
+ *
+ * @param text String containing the text to be translated
+ * @param source String containing the source language to translate the text from
+ * @param target String containing the target language to translate the text to
+ * @param report 1 to notify the user if the translation fails, or 0 otherwise
+ * @return A newly allocated string containing the translated text if the call was successful, or NULL otherwise.
+ * The returned string must be freed after its use
+ */
+static char* translate_text(char* text, char* source, char* target, int report){
+    char *pair, *escaped_pair, *escaped_text, *body, *result, *error_msg, *translation = NULL;
+
+    pair = g_strdup_printf("%s|%s", source, target);
+    escaped_pair = g_uri_escape_string(pair, NULL, FALSE);
+    escaped_text = g_uri_escape_string(text, NULL, FALSE);
+
+    // The text goes in the body, as a long message would not fit in the URL
+    body = g_strdup_printf("langpair=%s&q=%s", escaped_pair, escaped_text);
+
+    if((result = request_translation(source, target, "POST", "/translate", body, &error_msg)) != NULL){
+        translation = copy_string(result);
+        g_free(result);
+    }
+    else{
+        // Nothing is reported for the requests aborted because the plugin is being unloaded
+        if(report && error_msg != NULL && !g_cancellable_is_cancelled(request_cancellable)){
+            notify_error(error_msg);
+        }
+        g_free(error_msg);
+    }
+
+    g_free(body);
+    g_free(escaped_text);
+    g_free(escaped_pair);
+    g_free(pair);
+
+    return translation;
+}
+
+/**
+ * @brief Translates a given text
+ *
+ * The APYs that offer the language pair are asked in order until one of them translates the text
+ * @param text String containing the text to be translated
+ * @param source String containing the source language to translate the text from
+ * @param target String containing the target language to translate the text to
+ * @return A newly allocated string containing the translated text if the call was successful, or NULL otherwise.
+ * The returned string must be freed after its use
+ */
+char* translate(char* text, char* source, char* target){
+    return translate_text(text, source, target, 1);
+}
+
+/**
+ * @brief Translates a given text like translate(), without telling the user if it fails
+ *
+ * Used for translations nobody has asked for yet, such as those of the drafts
+ * @param text String containing the text to be translated
+ * @param source String containing the source language to translate the text from
+ * @param target String containing the target language to translate the text to
+ * @return A newly allocated string containing the translated text if the call was successful, or NULL otherwise.
+ * The returned string must be freed after its use
+ */
+char* translateQuietly(char* text, char* source, char* target){
+    return translate_text(text, source, target, 0);
+}
+
+/**
+ * @brief Translates several texts of the same language pair with a single request
+ *
+ * The texts are joined with APY_BATCH_SEPARATOR, which the APYs leave untouched, and the translation is split
+ * back at it. If a text contains the separator or the translation does not split into as many parts as texts
+ * were sent, nothing is returned and the texts must be translated one by one
+ * @param texts The texts to be translated
+ * @param count Number of texts
+ * @param source String containing the source language to translate the texts from
+ * @param target String containing the target language to translate the texts to
+ * @param translations Array of count elements where the translated texts will be stored on success.
+ * Each of them must be freed after its use
+ * @return 1 on success, 0 if the texts must be translated one by one, or -1 if no APY could translate them
+ */
+int translateBatch(char** texts, int count, char* source, char* target, char** translations){
+    int i, parts;
+    gsize length;
+    char *pair, *escaped_pair, *escaped_text, *body, *result, **pieces, *start, *error_msg;
+    GString *joined;
+
+    joined = g_string_new(NULL);
+    for(i=0; i<count; i++){
+        if(strstr(texts[i], APY_BATCH_MARK) != NULL){
+            g_string_free(joined, TRUE);
+            return 0;
+        }
+        if(i > 0){
+            g_string_append(joined, APY_BATCH_SEPARATOR);
+        }
+        g_string_append(joined, texts[i]);
+    }
+
+    pair = g_strdup_printf("%s|%s", source, target);
+    escaped_pair = g_uri_escape_string(pair, NULL, FALSE);
+    escaped_text = g_uri_escape_string(joined->str, NULL, FALSE);
+    body = g_strdup_printf("langpair=%s&q=%s", escaped_pair, escaped_text);
+
+    result = request_translation(source, target, "POST", "/translate", body, &error_msg);
+
+    g_free(body);
+    g_free(escaped_text);
+    g_free(escaped_pair);
+    g_free(pair);
+    g_string_free(joined, TRUE);
+
+    if(result == NULL){
+        if(error_msg != NULL && !g_cancellable_is_cancelled(request_cancellable)){
+            notify_error(error_msg);
+        }
+        g_free(error_msg);
+        return -1;
+    }
+
+    pieces = g_strsplit(result, APY_BATCH_MARK, -1);
+    parts = g_strv_length(pieces);
+    g_free(result);
+
+    if(parts != count){
+        g_strfreev(pieces);
+        return 0;
+    }
+
+    // Only the padding of the separator is removed, so each text keeps its own leading and trailing whitespace
+    for(i=0; i<count; i++){
+        start = pieces[i];
+        length = strlen(start);
+        if(i > 0 && g_str_has_prefix(start, APY_BATCH_PADDING)){
+            start += strlen(APY_BATCH_PADDING);
+            length -= strlen(APY_BATCH_PADDING);
+        }
+        if(i < count - 1 && length >= strlen(APY_BATCH_PADDING) && g_str_has_suffix(start, APY_BATCH_PADDING)){
+            length -= strlen(APY_BATCH_PADDING);
+        }
+        start[length] = '\0';
+        translations[i] = copy_string(start);
+    }
+
+    g_strfreev(pieces);
+    return 1;
+}
@@ -0,0 +1,320 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file apy_health.c
+ * @brief Latency and error rate observed for each APY, used to send requests to the fastest healthy one
+ *
+ * Both figures are exponentially weighted moving averages, so recent requests weigh more than older ones.<br>
+ * Each APY also has a circuit breaker: after a number of failures in a row the APY is skipped at once instead of
+ * being waited for, until a cool-down is over and a single request finds it has recovered.
+ * All the functions in this file may be called from any thread
+ */
+
+#include "apy_health.h"
+#include <string.h>
+
+/**
+ * @brief Weight of the latest request in the moving averages
+ */
+#define APY_HEALTH_WEIGHT 0.2
+
+/**
+ * @brief Figures by APY address
+ *
+ * Protected by health_mutex
+ */
+static GHashTable *health = NULL;
+
+/**
+ * @brief Consecutive failures after which the breaker of an APY opens, or 0 if breakers never open
+ *
+ * Protected by health_mutex
+ */
+static guint breaker_failures = APY_BREAKER_DEFAULT_FAILURES;
+
+/**
+ * @brief Seconds the breaker of an APY stays open before letting a request through
+ *
+ * Protected by health_mutex
+ */
+static guint breaker_cooldown = APY_BREAKER_DEFAULT_COOLDOWN;
+
+/**
+ * @brief Mutex protecting every variable in this file
+ */
+static GMutex health_mutex;
+
+/**
+ * @brief Creates the table of figures
+ *
+ * Must be called before any other function in this file
+ */
+void apy_health_init(void){
+    health = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+/**
+ * @brief Returns the figures of an APY, creating them if needed
+ *
+ * The caller must hold health_mutex
+ * @param address Address of the APY
+ * @return The figures
+ */
+static apy_health_stats* get_stats(const char *address){
+    apy_health_stats *stats;
+
+    if((stats = g_hash_table_lookup(health, address)) == NULL){
+        stats = g_new0(apy_health_stats, 1);
+        g_hash_table_insert(health, g_strdup(address), stats);
+    }
+
+    return stats;
+}
+
+/**
+ * @brief Records the outcome of a request to an APY
+ *
+ * A failure opens the breaker of the APY if it was half-open or if it makes too many in a row, and a success closes it
+ * @param address Address of the APY
+ * @param success 1 if the APY answered, or 0 otherwise
+ * @param latency Time, in microseconds, the request took. Ignored if it failed
+ * @return 1 if the breaker of the APY opened after being closed, -1 if it closed after being open or half-open,
+ * or 0 otherwise
+ */
+int apy_health_record(const char *address, int success, gint64 latency){
+    int changed = 0;
+    apy_health_stats *stats;
+
+    g_mutex_lock(&health_mutex);
+
+    if(health != NULL){
+        stats = get_stats(address);
+
+        stats->requests++;
+        if(success){
+            stats->consecutive_failures = 0;
+            if(stats->breaker != APY_BREAKER_CLOSED){
+                stats->breaker = APY_BREAKER_CLOSED;
+                changed = -1;
+            }
+        }
+        else{
+            stats->failures++;
+            stats->consecutive_failures++;
+
+            if(stats->breaker == APY_BREAKER_HALF_OPEN ||
+               (breaker_failures > 0 && stats->consecutive_failures >= breaker_failures)){
+                if(stats->breaker == APY_BREAKER_CLOSED){
+                    changed = 1;
+                }
+                stats->breaker = APY_BREAKER_OPEN;
+                stats->breaker_changed = g_get_monotonic_time();
+            }
+        }
+
+        if(!stats->known){
+            stats->known = 1;
+            stats->error_rate = success ? 0 : 1;
+            stats->latency = success ? latency / 1000.0 : 0;
+        }
+        else{
+            stats->error_rate += APY_HEALTH_WEIGHT * ((success ? 0 : 1) - stats->error_rate);
+            if(success){
+                stats->latency += APY_HEALTH_WEIGHT * (latency / 1000.0 - stats->latency);
+            }
+        }
+    }
+
+    g_mutex_unlock(&health_mutex);
+
+    return changed;
+}
+
+/**
+ * @brief Retrieves the figures of an APY
+ *
+ * @param address Address of the APY
+ * @param stats Reference to where the figures will be stored. Its known member is 0 if nothing has been observed yet
+ */
+void apy_health_get(const char *address, apy_health_stats *stats){
+    apy_health_stats *found;
+
+    memset(stats, 0, sizeof(*stats));
+
+    g_mutex_lock(&health_mutex);
+
+    if(health != NULL && (found = g_hash_table_lookup(health, address)) != NULL){
+        *stats = *found;
+    }
+
+    g_mutex_unlock(&health_mutex);
+}
+
+/**
+ * @brief Checks whether a request may be sent to an APY, according to its circuit breaker
+ *
+ * Once the cool-down of an open breaker is over, a single request is let through and the breaker becomes half-open.
+ * If that request never reports its outcome, another one is let through after a new cool-down
+ * @param address Address of the APY
+ * @return 1 if the request may be sent, or 0 if the APY must be skipped
+ */
+int apy_health_allow(const char *address){
+    int allowed = 1;
+    gint64 now;
+    apy_health_stats *stats;
+
+    now = g_get_monotonic_time();
+
+    g_mutex_lock(&health_mutex);
+
+    if(health != NULL && (stats = g_hash_table_lookup(health, address)) != NULL && stats->breaker != APY_BREAKER_CLOSED){
+        if(now - stats->breaker_changed >= (gint64)breaker_cooldown * G_TIME_SPAN_SECOND){
+            stats->breaker = APY_BREAKER_HALF_OPEN;
+            stats->breaker_changed = now;
+        }
+        else{
+            allowed = 0;
+        }
+    }
+
+    g_mutex_unlock(&health_mutex);
+
+    return allowed;
+}
+
+/**
+ * @brief Changes when the circuit breakers open and for how long
+ *
+ * Breakers already open keep their state
+ * @param failures Consecutive failures after which the breaker of an APY opens. 0 disables the breakers
+ * @param cooldown Seconds a breaker stays open before letting a request through
+ */
+void apy_health_set_breaker(guint failures, guint cooldown){
+    GHashTableIter iter;
+    gpointer value;
+
+    g_mutex_lock(&health_mutex);
+
+    breaker_failures = failures;
+    breaker_cooldown = cooldown;
+
+    // Disabling the breakers must not leave any APY skipped
+    if(failures == 0 && health != NULL){
+        g_hash_table_iter_init(&iter, health);
+        while(g_hash_table_iter_next(&iter, NULL, &value)){
+            ((apy_health_stats*)value)->breaker = APY_BREAKER_CLOSED;
+        }
+    }
+
+    g_mutex_unlock(&health_mutex);
+}
+
+/**
+ * @brief Retrieves when the circuit breakers open and for how long
+ *
+ * @param failures Reference to where the number of consecutive failures will be stored
+ * @param cooldown Reference to where the cool-down, in seconds, will be stored
+ */
+void apy_health_get_breaker(guint *failures, guint *cooldown){
+    g_mutex_lock(&health_mutex);
+
+    *failures = breaker_failures;
+    *cooldown = breaker_cooldown;
+
+    g_mutex_unlock(&health_mutex);
+}
+
+/**
+ * @brief Ranks an APY for apy_health_sort()
+ *
+ * @param stats Figures of the APY
+ * @return 0 for healthy APYs whose latency is known, 1 for APYs nothing is known about, or 2 for unhealthy APYs,
+ * including those whose breaker is not closed
+ */
+static int health_rank(const apy_health_stats *stats){
+    if(!stats->known){
+        return 1;
+    }
+    return stats->error_rate > APY_HEALTH_MAX_ERROR_RATE || stats->latency <= 0 || stats->breaker != APY_BREAKER_CLOSED ? 2 : 0;
+}
+
+/**
+ * @brief Sorts APYs so that the fastest healthy ones come first
+ *
+ * Healthy APYs are sorted by latency, followed by those nothing is known about and then by the unhealthy ones.
+ * APYs that tie keep their order
+ * @param addresses NULL-terminated array of addresses, which is sorted in place
+ */
+void apy_health_sort(char **addresses){
+    int i, j, count;
+    char *address;
+    apy_health_stats *stats, key;
+
+    for(count=0; addresses[count] != NULL; count++);
+
+    stats = g_new(apy_health_stats, count);
+    for(i=0; i<count; i++){
+        apy_health_get(addresses[i], &stats[i]);
+    }
+
+    // Insertion sort, as the list is short and ties must keep their order
+    for(i=1; i<count; i++){
+        key = stats[i];
+        address = addresses[i];
+
+        for(j=i-1; j>=0 && (health_rank(&stats[j]) > health_rank(&key) ||
+                           (health_rank(&stats[j]) == 0 && health_rank(&key) == 0 && stats[j].latency > key.latency)); j--){
+            stats[j+1] = stats[j];
+            addresses[j+1] = addresses[j];
+        }
+
+        stats[j+1] = key;
+        addresses[j+1] = address;
+    }
+
+    g_free(stats);
+}
+
+/**
+ * @brief Drops the figures of an APY
+ *
+ * @param address Address of the APY
+ */
+void apy_health_forget(const char *address){
+    g_mutex_lock(&health_mutex);
+
+    if(health != NULL){
+        g_hash_table_remove(health, address);
+    }
+
+    g_mutex_unlock(&health_mutex);
+}
+
+/**
+ * @brief Frees the table of figures
+ */
+void apy_health_shutdown(void){
+    g_mutex_lock(&health_mutex);
+
+    g_hash_table_destroy(health);
+    health = NULL;
+
+    g_mutex_unlock(&health_mutex);
+}
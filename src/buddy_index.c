@@ -0,0 +1,386 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file buddy_index.c
+ * @brief The user-language_pair bindings, made of the preference store and the changes made since it was written
+ *
+ * Only the buddies whose bindings changed since the preference store was written are kept in memory, so the
+ * index costs nothing to build. A change in one direction hides the store in that direction only, and a removed
+ * binding is kept as a change without a language pair, so that the one in the store stays hidden.
+ * The functions in this file must be called from the main loop, except buddy_index_snapshot_foreach(), which
+ * only reads a copy of the changes so that the store can be written again on another thread
+ */
+
+#include "buddy_index.h"
+#include "preference_store.h"
+#include <string.h>
+
+/**
+ * @brief Positions of each direction in the arrays of buddy_pairs
+ */
+typedef enum {INCOMING = PREFERENCE_STORE_INCOMING, OUTGOING = PREFERENCE_STORE_OUTGOING, DIRECTIONS} pair_direction;
+
+/**
+ * @brief The changes to the language pairs bound to a buddy
+ */
+typedef struct {
+    /** 1 for each direction whose binding changed since the store was written, or 0 otherwise */
+    int changed[DIRECTIONS];
+    /** Source language for each changed direction, or NULL if the binding was removed */
+    char *source[DIRECTIONS];
+    /** Target language for each changed direction, or NULL if the binding was removed */
+    char *target[DIRECTIONS];
+} buddy_pairs;
+
+/**
+ * @brief Changed language pairs by buddy name
+ */
+static GHashTable *buddies = NULL;
+
+/**
+ * @brief A copy of the changes, taken to write the preference store again
+ */
+struct buddy_index_snapshot {
+    /** Copy of the changed language pairs by buddy name */
+    GHashTable *buddies;
+};
+
+/**
+ * @brief Function and data passed to buddy_index_foreach()
+ */
+typedef struct {
+    /** Changed language pairs the bindings of the store are overridden with */
+    GHashTable *buddies;
+    /** The function */
+    buddy_index_func func;
+    /** Data passed to the function */
+    gpointer data;
+} foreach_call;
+
+/**
+ * @brief Names of the directions, by position
+ */
+static const char *direction_names[DIRECTIONS] = {"incoming", "outgoing"};
+
+/**
+ * @brief Translates the name of a direction into its position
+ *
+ * @param direction "incoming" or "outgoing"
+ * @return The position of the direction, or DIRECTIONS if the name is not valid
+ */
+static pair_direction parse_direction(const char *direction){
+    if(!strcmp(direction, "incoming")){
+        return INCOMING;
+    }
+    if(!strcmp(direction, "outgoing")){
+        return OUTGOING;
+    }
+    return DIRECTIONS;
+}
+
+/**
+ * @brief Frees the language pairs of a buddy
+ *
+ * Used as the value destroy function of the index
+ * @param data The buddy_pairs
+ */
+static void free_pairs(gpointer data){
+    buddy_pairs *pairs = data;
+    int i;
+
+    for(i=0; i<DIRECTIONS; i++){
+        g_free(pairs->source[i]);
+        g_free(pairs->target[i]);
+    }
+    g_free(pairs);
+}
+
+/**
+ * @brief Creates the empty index, which shows the bindings of the preference store
+ *
+ * Must be called before any other function in this file
+ */
+void buddy_index_init(void){
+    buddies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_pairs);
+}
+
+/**
+ * @brief Binds a language pair to a buddy, replacing the one previously bound in the same direction
+ *
+ * @param user Name of the buddy
+ * @param direction "incoming" or "outgoing"
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @return 1 on success, or 0 if the direction is not valid
+ */
+int buddy_index_set(const char *user, const char *direction, const char *source, const char *target){
+    pair_direction position = parse_direction(direction);
+    buddy_pairs *pairs;
+
+    if(position == DIRECTIONS){
+        return 0;
+    }
+
+    if((pairs = g_hash_table_lookup(buddies, user)) == NULL){
+        pairs = g_new0(buddy_pairs, 1);
+        g_hash_table_insert(buddies, g_strdup(user), pairs);
+    }
+
+    g_free(pairs->source[position]);
+    g_free(pairs->target[position]);
+    pairs->changed[position] = 1;
+    pairs->source[position] = g_strdup(source);
+    pairs->target[position] = g_strdup(target);
+
+    return 1;
+}
+
+/**
+ * @brief Removes the language pair bound to a buddy
+ *
+ * @param user Name of the buddy
+ * @param direction "incoming" or "outgoing", or NULL to remove both
+ * @param always 1 to record the removal even if no language pair is bound, for while the preference store that
+ * may hold it is not open yet, or 0 otherwise
+ * @return 1 if a language pair was removed or the removal was recorded, or 0 otherwise
+ */
+int buddy_index_remove(const char *user, const char *direction, int always){
+    pair_direction position;
+    buddy_pairs *pairs;
+    int removed = 0;
+
+    for(position=INCOMING; position<DIRECTIONS; position++){
+        if((direction != NULL && position != parse_direction(direction)) ||
+           (!always && !buddy_index_lookup(user, direction_names[position], NULL, NULL))){
+            continue;
+        }
+
+        if((pairs = g_hash_table_lookup(buddies, user)) == NULL){
+            pairs = g_new0(buddy_pairs, 1);
+            g_hash_table_insert(buddies, g_strdup(user), pairs);
+        }
+
+        g_free(pairs->source[position]);
+        g_free(pairs->target[position]);
+        pairs->changed[position] = 1;
+        pairs->source[position] = NULL;
+        pairs->target[position] = NULL;
+        removed = 1;
+    }
+
+    return removed;
+}
+
+/**
+ * @brief Finds the language pair bound to a buddy
+ *
+ * Nothing is allocated. The returned strings belong to the index or to the preference store and are valid until
+ * the binding changes or the store is written again
+ * @param user Name of the buddy
+ * @param direction "incoming" or "outgoing"
+ * @param source Reference to where the source language will be stored. May be NULL
+ * @param target Reference to where the target language will be stored. May be NULL
+ * @return 1 if there is a language pair bound, or 0 otherwise
+ */
+int buddy_index_lookup(const char *user, const char *direction, const char **source, const char **target){
+    pair_direction position = parse_direction(direction);
+    buddy_pairs *pairs;
+
+    if(buddies == NULL || position == DIRECTIONS){
+        return 0;
+    }
+
+    if((pairs = g_hash_table_lookup(buddies, user)) == NULL || !pairs->changed[position]){
+        return preference_store_lookup(user, position, source, target);
+    }
+
+    if(pairs->source[position] == NULL){
+        return 0;
+    }
+
+    if(source != NULL){
+        *source = pairs->source[position];
+    }
+    if(target != NULL){
+        *target = pairs->target[position];
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Passes a binding of the preference store to the function of buddy_index_foreach(), unless it has changed
+ *
+ * @param user Name of the buddy
+ * @param direction Position of the direction
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param data The foreach_call
+ */
+static void foreach_stored(const char *user, int direction, const char *source, const char *target, gpointer data){
+    foreach_call *call = data;
+    buddy_pairs *pairs;
+
+    if((pairs = g_hash_table_lookup(call->buddies, user)) == NULL || !pairs->changed[direction]){
+        call->func(user, direction_names[direction], source, target, call->data);
+    }
+}
+
+/**
+ * @brief Calls a function for every binding of the preference store overridden with some changes
+ *
+ * @param changes Changed language pairs by buddy name
+ * @param func The function
+ * @param data Data passed to the function
+ */
+static void foreach_binding(GHashTable *changes, buddy_index_func func, gpointer data){
+    GHashTableIter iter;
+    gpointer user, value;
+    buddy_pairs *pairs;
+    pair_direction position;
+    foreach_call call;
+
+    call.buddies = changes;
+    call.func = func;
+    call.data = data;
+    preference_store_foreach(foreach_stored, NULL, &call);
+
+    g_hash_table_iter_init(&iter, changes);
+    while(g_hash_table_iter_next(&iter, &user, &value)){
+        pairs = value;
+        for(position=INCOMING; position<DIRECTIONS; position++){
+            if(pairs->changed[position] && pairs->source[position] != NULL){
+                func(user, direction_names[position], pairs->source[position], pairs->target[position], data);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Calls a function for every user-language_pair binding
+ *
+ * The index must not be changed by the function
+ * @param func The function
+ * @param data Data passed to the function
+ */
+void buddy_index_foreach(buddy_index_func func, gpointer data){
+    foreach_binding(buddies, func, data);
+}
+
+/**
+ * @brief Copies the changes, so that the preference store can be written again with them on another thread
+ *
+ * Only the changes are copied, so this does not depend on the number of bindings in the store
+ * @return The copy, which must be freed with buddy_index_snapshot_free()
+ */
+buddy_index_snapshot* buddy_index_snapshot_new(void){
+    GHashTableIter iter;
+    gpointer user, value;
+    buddy_pairs *pairs, *copy;
+    pair_direction position;
+    buddy_index_snapshot *snapshot;
+
+    snapshot = g_new(buddy_index_snapshot, 1);
+    snapshot->buddies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_pairs);
+
+    g_hash_table_iter_init(&iter, buddies);
+    while(g_hash_table_iter_next(&iter, &user, &value)){
+        pairs = value;
+        copy = g_new0(buddy_pairs, 1);
+        for(position=INCOMING; position<DIRECTIONS; position++){
+            copy->changed[position] = pairs->changed[position];
+            copy->source[position] = g_strdup(pairs->source[position]);
+            copy->target[position] = g_strdup(pairs->target[position]);
+        }
+        g_hash_table_insert(snapshot->buddies, g_strdup(user), copy);
+    }
+
+    return snapshot;
+}
+
+/**
+ * @brief Calls a function for every user-language_pair binding of a copy of the index
+ *
+ * May be called from any thread, as long as the preference store is not opened again meanwhile
+ * @param snapshot The copy
+ * @param func The function
+ * @param data Data passed to the function
+ */
+void buddy_index_snapshot_foreach(buddy_index_snapshot *snapshot, buddy_index_func func, gpointer data){
+    foreach_binding(snapshot->buddies, func, data);
+}
+
+/**
+ * @brief Forgets the changes of a copy, once the preference store has been written again with them
+ *
+ * The changes made after the copy was taken are kept
+ * @param snapshot The copy
+ */
+void buddy_index_snapshot_written(buddy_index_snapshot *snapshot){
+    GHashTableIter iter;
+    gpointer user, value;
+    buddy_pairs *written, *pairs;
+    pair_direction position;
+    int changed;
+
+    g_hash_table_iter_init(&iter, snapshot->buddies);
+    while(g_hash_table_iter_next(&iter, &user, &value)){
+        written = value;
+        if((pairs = g_hash_table_lookup(buddies, user)) == NULL){
+            continue;
+        }
+
+        changed = 0;
+        for(position=INCOMING; position<DIRECTIONS; position++){
+            if(pairs->changed[position] && written->changed[position] &&
+               !g_strcmp0(pairs->source[position], written->source[position]) &&
+               !g_strcmp0(pairs->target[position], written->target[position])){
+                g_free(pairs->source[position]);
+                g_free(pairs->target[position]);
+                pairs->changed[position] = 0;
+                pairs->source[position] = NULL;
+                pairs->target[position] = NULL;
+            }
+            changed |= pairs->changed[position];
+        }
+
+        if(!changed){
+            g_hash_table_remove(buddies, user);
+        }
+    }
+}
+
+/**
+ * @brief Frees a copy of the index
+ *
+ * @param snapshot The copy
+ */
+void buddy_index_snapshot_free(buddy_index_snapshot *snapshot){
+    g_hash_table_destroy(snapshot->buddies);
+    g_free(snapshot);
+}
+
+/**
+ * @brief Frees the index
+ */
+void buddy_index_shutdown(void){
+    g_hash_table_destroy(buddies);
+    buddies = NULL;
+}
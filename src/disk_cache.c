@@ -0,0 +1,361 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file disk_cache.c
+ * @brief Translation cache stored in a memory-mapped file, so that translations survive restarts
+ *
+ * The file is a fixed-size hash table: a header followed by slots of DISK_CACHE_SLOT_SIZE bytes, grouped in
+ * sets of DISK_CACHE_WAYS. A key can only live in the set its hash points to, and storing into a full set
+ * evicts its least recently used slot, so the file never grows. Opening it does not require any parsing.<br>
+ * Each slot carries a sequence counter that is odd while the slot is being written. Readers never lock:
+ * they copy the slot and retry the lookup as a miss if the counter changed meanwhile. Writers are serialized
+ * with a mutex and, against other processes sharing the file, with flock().<br>
+ * All the functions in this file may be called from any thread
+ */
+
+#include "disk_cache.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Identifies a cache file
+ */
+#define DISK_CACHE_MAGIC "APTCACHE"
+
+/**
+ * @brief Version of the file layout. Files with any other version are discarded
+ */
+#define DISK_CACHE_VERSION 1
+
+/**
+ * @brief Size, in bytes, of each slot
+ */
+#define DISK_CACHE_SLOT_SIZE 512
+
+/**
+ * @brief Number of slots a key may be stored in
+ */
+#define DISK_CACHE_WAYS 8
+
+/**
+ * @brief Header at the beginning of the cache file
+ */
+typedef struct {
+    /** DISK_CACHE_MAGIC, without its terminating null */
+    char magic[8];
+    /** DISK_CACHE_VERSION */
+    guint32 version;
+    /** Size of each slot */
+    guint32 slot_size;
+    /** Number of slots in the file */
+    guint32 slot_count;
+    /** Counter increased on every use of a slot, used to find the least recently used one */
+    gint clock;
+    /** Unused, keeps the slots aligned */
+    char reserved[40];
+} disk_cache_header;
+
+/**
+ * @brief A slot of the cache file
+ */
+typedef struct {
+    /** Sequence counter, odd while the slot is being written */
+    gint sequence;
+    /** Hash of the key, or 0 if the slot is empty */
+    guint32 hash;
+    /** Value of the clock the last time the slot was used */
+    gint stamp;
+    /** Length of the key */
+    guint16 key_length;
+    /** Length of the value */
+    guint16 value_length;
+    /** The key followed by the value, neither of them null-terminated */
+    char data[DISK_CACHE_SLOT_SIZE - 16];
+} disk_cache_slot;
+
+/**
+ * @brief Descriptor of the open cache file, or -1 if there is none
+ */
+static int cache_fd = -1;
+
+/**
+ * @brief Memory the cache file is mapped to, or NULL if there is none
+ */
+static disk_cache_header *header = NULL;
+
+/**
+ * @brief First slot of the mapped file
+ */
+static disk_cache_slot *slots = NULL;
+
+/**
+ * @brief Size, in bytes, of the mapped file
+ */
+static gsize mapped_size = 0;
+
+/**
+ * @brief Mutex serializing the writers of this process
+ */
+static GMutex write_mutex;
+
+/**
+ * @brief Hashes a key with 32-bit FNV-1a
+ *
+ * @param key The key
+ * @return The hash, which is never 0 so that it cannot be mistaken for an empty slot
+ */
+static guint32 hash_key(const char *key){
+    guint32 hash = 2166136261u;
+
+    for(; *key != '\0'; key++){
+        hash ^= (guchar)*key;
+        hash *= 16777619u;
+    }
+
+    return hash != 0 ? hash : 1;
+}
+
+/**
+ * @brief Returns the first slot of the set a hash belongs to
+ *
+ * @param hash Hash of a key
+ * @return The first of the DISK_CACHE_WAYS slots of the set
+ */
+static disk_cache_slot* find_set(guint32 hash){
+    return slots + (hash % (header->slot_count / DISK_CACHE_WAYS)) * DISK_CACHE_WAYS;
+}
+
+/**
+ * @brief Checks that a mapped file is a cache file this code can use
+ *
+ * @param slot_count Number of slots the file must have
+ * @return 1 if the file is valid, or 0 otherwise
+ */
+static int header_is_valid(guint32 slot_count){
+    return !memcmp(header->magic, DISK_CACHE_MAGIC, sizeof(header->magic)) &&
+           header->version == DISK_CACHE_VERSION &&
+           header->slot_size == DISK_CACHE_SLOT_SIZE &&
+           header->slot_count == slot_count;
+}
+
+/**
+ * @brief Opens the cache file, creating it if needed
+ *
+ * A file that is not a valid cache file of the requested size is emptied and reinitialized
+ * @param filename Name of the cache file
+ * @param slot_count Number of translations the file can hold. It is rounded up to a multiple of DISK_CACHE_WAYS
+ * @return 1 on success, or 0 otherwise, in which case the other functions in this file do nothing
+ */
+int disk_cache_open(const char *filename, guint slot_count){
+    struct stat info;
+    gsize size;
+
+    slot_count = ((slot_count + DISK_CACHE_WAYS - 1) / DISK_CACHE_WAYS) * DISK_CACHE_WAYS;
+    if(slot_count == 0){
+        return 0;
+    }
+
+    size = sizeof(disk_cache_header) + (gsize)slot_count * sizeof(disk_cache_slot);
+
+    if((cache_fd = open(filename, O_RDWR | O_CREAT, 0600)) < 0){
+        return 0;
+    }
+
+    flock(cache_fd, LOCK_EX);
+
+    if(fstat(cache_fd, &info) < 0 || ((gsize)info.st_size != size && ftruncate(cache_fd, size) < 0)){
+        flock(cache_fd, LOCK_UN);
+        close(cache_fd);
+        cache_fd = -1;
+        return 0;
+    }
+
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache_fd, 0);
+    if(header == MAP_FAILED){
+        header = NULL;
+        flock(cache_fd, LOCK_UN);
+        close(cache_fd);
+        cache_fd = -1;
+        return 0;
+    }
+
+    mapped_size = size;
+    slots = (disk_cache_slot*)(header + 1);
+
+    if(!header_is_valid(slot_count)){
+        memset(header, 0, size);
+        memcpy(header->magic, DISK_CACHE_MAGIC, sizeof(header->magic));
+        header->version = DISK_CACHE_VERSION;
+        header->slot_size = DISK_CACHE_SLOT_SIZE;
+        header->slot_count = slot_count;
+    }
+
+    flock(cache_fd, LOCK_UN);
+
+    return 1;
+}
+
+/**
+ * @brief Looks up the value stored under a key
+ *
+ * @param key The key
+ * @return A newly allocated string containing the value, which must be freed with g_free(), or NULL if there is none
+ */
+char* disk_cache_lookup(const char *key){
+    int i;
+    gint sequence;
+    guint32 hash;
+    gsize key_length, value_length;
+    char data[sizeof(((disk_cache_slot*)NULL)->data)];
+    disk_cache_slot *slot;
+
+    if(header == NULL){
+        return NULL;
+    }
+
+    hash = hash_key(key);
+    key_length = strlen(key);
+    slot = find_set(hash);
+
+    for(i=0; i<DISK_CACHE_WAYS; i++, slot++){
+        sequence = g_atomic_int_get(&slot->sequence);
+        if(sequence & 1 || slot->hash != hash || slot->key_length != key_length){
+            continue;
+        }
+
+        value_length = slot->value_length;
+        if(key_length + value_length > sizeof(data)){
+            continue;
+        }
+        memcpy(data, slot->data, key_length + value_length);
+
+        // The copy is only good if no writer touched the slot meanwhile
+        if(g_atomic_int_get(&slot->sequence) != sequence || memcmp(data, key, key_length)){
+            continue;
+        }
+
+        g_atomic_int_set(&slot->stamp, g_atomic_int_add(&header->clock, 1));
+        return g_strndup(data + key_length, value_length);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Stores a value under a key, evicting the least recently used entry of its set if needed
+ *
+ * Pairs too long to fit in a slot are not stored
+ * @param key The key
+ * @param value The value
+ */
+void disk_cache_store(const char *key, const char *value){
+    int i;
+    guint32 hash;
+    gsize key_length, value_length;
+    disk_cache_slot *slot, *victim = NULL;
+
+    if(header == NULL){
+        return;
+    }
+
+    key_length = strlen(key);
+    value_length = strlen(value);
+    if(key_length + value_length > sizeof(victim->data)){
+        return;
+    }
+
+    hash = hash_key(key);
+
+    g_mutex_lock(&write_mutex);
+    flock(cache_fd, LOCK_EX);
+
+    slot = find_set(hash);
+    for(i=0; i<DISK_CACHE_WAYS; i++, slot++){
+        if(slot->hash == hash && slot->key_length == key_length && !memcmp(slot->data, key, key_length)){
+            victim = slot;
+            break;
+        }
+        if(victim == NULL || (victim->hash != 0 && (slot->hash == 0 || (gint)((guint32)slot->stamp - (guint32)victim->stamp) < 0))){
+            victim = slot;
+        }
+    }
+
+    g_atomic_int_inc(&victim->sequence);
+
+    victim->hash = hash;
+    victim->key_length = key_length;
+    victim->value_length = value_length;
+    memcpy(victim->data, key, key_length);
+    memcpy(victim->data + key_length, value, value_length);
+    victim->stamp = g_atomic_int_add(&header->clock, 1);
+
+    g_atomic_int_inc(&victim->sequence);
+
+    flock(cache_fd, LOCK_UN);
+    g_mutex_unlock(&write_mutex);
+}
+
+/**
+ * @brief Removes every entry from the cache file
+ */
+void disk_cache_clear(void){
+    guint i;
+
+    if(header == NULL){
+        return;
+    }
+
+    g_mutex_lock(&write_mutex);
+    flock(cache_fd, LOCK_EX);
+
+    for(i=0; i<header->slot_count; i++){
+        g_atomic_int_inc(&slots[i].sequence);
+        slots[i].hash = 0;
+        g_atomic_int_inc(&slots[i].sequence);
+    }
+
+    flock(cache_fd, LOCK_UN);
+    g_mutex_unlock(&write_mutex);
+}
+
+/**
+ * @brief Unmaps and closes the cache file
+ *
+ * No other thread may be using the cache when this function is called
+ */
+void disk_cache_close(void){
+    if(header == NULL){
+        return;
+    }
+
+    munmap(header, mapped_size);
+    close(cache_fd);
+
+    header = NULL;
+    slots = NULL;
+    mapped_size = 0;
+    cache_fd = -1;
+}
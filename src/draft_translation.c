@@ -0,0 +1,344 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file draft_translation.c
+ * @brief Translation of the message being typed, so that it is usually ready by the time it is sent
+ *
+ * Whenever the user stops typing for DRAFT_TRANSLATION_DELAY milliseconds in a conversation with a buddy that has
+ * an outgoing language pair, the draft is translated in the background. When the message is sent, its translation
+ * is used only if the text and the language pair match the draft exactly. A draft still being translated when it
+ * is sent is not requested again, as the pipeline shares identical requests in flight.<br>
+ * Drafts can only be read from the Pidgin entry box, so nothing is done unless the plugin is built with Pidgin
+ * (HAVE_PIDGIN). All the functions in this file must be called from the main loop
+ */
+
+#include "draft_translation.h"
+
+#ifdef HAVE_PIDGIN
+
+#include "preferences.h"
+#include "translation_pipeline.h"
+#include "blist.h"
+#include "conversation.h"
+#include "signals.h"
+#include "gtkconv.h"
+#include "gtkimhtml.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief The draft of a conversation
+ */
+typedef struct {
+    /** The conversation */
+    PurpleConversation *conv;
+    /** Entry buffer the changed handler is connected to */
+    gpointer buffer;
+    /** ID of the timeout source that will translate the draft, or 0 if there is none */
+    guint timer;
+    /** Text of the last draft sent to be translated, or NULL if there is none */
+    char *text;
+    /** Source language of the language pair the draft was translated with */
+    char *source;
+    /** Target language of the language pair the draft was translated with */
+    char *target;
+    /** Translation of the draft, or NULL if it is not available yet */
+    char *translation;
+} draft_slot;
+
+/**
+ * @brief A draft translation request
+ */
+typedef struct {
+    /** Conversation the draft belongs to */
+    PurpleConversation *conv;
+    /** Text of the draft */
+    char *text;
+} draft_request;
+
+/**
+ * @brief Drafts by conversation
+ */
+static GHashTable *slots = NULL;
+
+/**
+ * @brief Forgets the translated draft of a slot
+ *
+ * @param slot The slot
+ */
+static void clear_draft(draft_slot *slot){
+    g_free(slot->text);
+    g_free(slot->source);
+    g_free(slot->target);
+    free(slot->translation);
+
+    slot->text = NULL;
+    slot->source = NULL;
+    slot->target = NULL;
+    slot->translation = NULL;
+}
+
+/**
+ * @brief Stores the translation of a draft in its slot
+ *
+ * @param translation The translation, or NULL if it failed
+ * @param data The draft_request
+ */
+static void draft_ready_cb(char *translation, gpointer data){
+    draft_request *request = data;
+    draft_slot *slot;
+
+    // The conversation may have been closed, or the draft changed, meanwhile
+    if(slots != NULL && (slot = g_hash_table_lookup(slots, request->conv)) != NULL &&
+       slot->text != NULL && !strcmp(slot->text, request->text) && slot->translation == NULL){
+        slot->translation = translation;
+        translation = NULL;
+    }
+
+    free(translation);
+    g_free(request->text);
+    g_free(request);
+}
+
+/**
+ * @brief Translates the draft of a conversation once the user has stopped typing
+ *
+ * @param data The draft_slot
+ * @return FALSE, so that the timeout source is removed
+ */
+static gboolean translate_draft(gpointer data){
+    draft_slot *slot = data;
+    PidginConversation *gtkconv;
+    PurpleBuddy *buddy;
+    const char *username;
+    char *text;
+    draft_request *request;
+
+    slot->timer = 0;
+
+    buddy = purple_find_buddy(purple_conversation_get_account(slot->conv), purple_conversation_get_name(slot->conv));
+    if(buddy == NULL){
+        return FALSE;
+    }
+
+    username = purple_buddy_get_name(buddy);
+    if(!dictionaryHasUser(username, "outgoing")){
+        return FALSE;
+    }
+
+    gtkconv = PIDGIN_CONVERSATION(slot->conv);
+    text = gtk_imhtml_get_markup(GTK_IMHTML(gtkconv->entry));
+
+    if(*text == '\0' || (slot->text != NULL && !strcmp(slot->text, text))){
+        g_free(text);
+        return FALSE;
+    }
+
+    clear_draft(slot);
+    slot->text = text;
+    slot->source = g_strdup(dictionaryGetUserLanguage(username, "outgoing", "source"));
+    slot->target = g_strdup(dictionaryGetUserLanguage(username, "outgoing", "target"));
+
+    request = g_new(draft_request, 1);
+    request->conv = slot->conv;
+    request->text = g_strdup(text);
+
+    translation_pipeline_submit_draft(text, slot->source, slot->target, draft_ready_cb, request);
+
+    return FALSE;
+}
+
+/**
+ * @brief Called whenever the text of an entry buffer changes. Waits for the user to stop typing
+ *
+ * @param buffer The entry buffer
+ * @param data The draft_slot of its conversation
+ */
+static void draft_changed_cb(gpointer buffer, gpointer data){
+    draft_slot *slot = data;
+
+    if(slot->timer != 0){
+        g_source_remove(slot->timer);
+    }
+
+    slot->timer = g_timeout_add(DRAFT_TRANSLATION_DELAY, translate_draft, slot);
+}
+
+/**
+ * @brief Frees a slot and stops watching its entry buffer
+ *
+ * Used as the value destroy function of the slots table
+ * @param data The draft_slot
+ */
+static void free_slot(gpointer data){
+    draft_slot *slot = data;
+
+    if(slot->timer != 0){
+        g_source_remove(slot->timer);
+    }
+
+    g_signal_handlers_disconnect_by_func(slot->buffer, draft_changed_cb, slot);
+
+    clear_draft(slot);
+    g_free(slot);
+}
+
+/**
+ * @brief Starts watching the drafts of a conversation
+ *
+ * Only IM conversations shown by Pidgin are watched
+ * @param conv The conversation
+ */
+static void watch_conversation(PurpleConversation *conv){
+    PidginConversation *gtkconv;
+    draft_slot *slot;
+
+    if(purple_conversation_get_type(conv) != PURPLE_CONV_TYPE_IM || !PIDGIN_IS_PIDGIN_CONVERSATION(conv) ||
+       g_hash_table_lookup(slots, conv) != NULL){
+        return;
+    }
+
+    gtkconv = PIDGIN_CONVERSATION(conv);
+
+    slot = g_new0(draft_slot, 1);
+    slot->conv = conv;
+    slot->buffer = gtkconv->entry_buffer;
+    g_signal_connect(slot->buffer, "changed", G_CALLBACK(draft_changed_cb), slot);
+
+    g_hash_table_insert(slots, conv, slot);
+}
+
+/**
+ * @brief Called when Pidgin shows a conversation
+ *
+ * @param gtkconv The Pidgin conversation
+ * @param data Not used
+ */
+static void conversation_displayed_cb(PidginConversation *gtkconv, gpointer data){
+    watch_conversation(gtkconv->active_conv);
+}
+
+/**
+ * @brief Called when a conversation is about to be destroyed
+ *
+ * @param conv The conversation
+ * @param data Not used
+ */
+static void deleting_conversation_cb(PurpleConversation *conv, gpointer data){
+    g_hash_table_remove(slots, conv);
+}
+
+/**
+ * @brief Starts watching the drafts of every conversation
+ *
+ * @param plugin Plugin handle, used to connect to the conversation signals
+ */
+void draft_translation_init(void *plugin){
+    GList *link;
+
+    slots = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_slot);
+
+    purple_signal_connect(pidgin_conversations_get_handle(), "conversation-displayed",
+                          plugin, PURPLE_CALLBACK(conversation_displayed_cb), NULL);
+    purple_signal_connect(purple_conversations_get_handle(), "deleting-conversation",
+                          plugin, PURPLE_CALLBACK(deleting_conversation_cb), NULL);
+
+    for(link = purple_get_ims(); link != NULL; link = link->next){
+        watch_conversation(link->data);
+    }
+}
+
+/**
+ * @brief Takes the translation of the draft of a conversation, if it is the message being sent
+ *
+ * @param account Account the message is sent on
+ * @param name Username of the buddy the message is sent to
+ * @param text The message being sent
+ * @param source Source language of the language pair the message is translated with
+ * @param target Target language of the language pair the message is translated with
+ * @return A newly allocated string containing the translation, which must be freed after its use,
+ * or NULL if the draft does not match the message or its translation is not available
+ */
+char* draft_translation_take(PurpleAccount *account, const char *name, const char *text,
+                             const char *source, const char *target){
+    PurpleConversation *conv;
+    draft_slot *slot;
+    char *translation = NULL;
+
+    if(slots == NULL ||
+       (conv = purple_find_conversation_with_account(PURPLE_CONV_TYPE_IM, name, account)) == NULL ||
+       (slot = g_hash_table_lookup(slots, conv)) == NULL){
+        return NULL;
+    }
+
+    if(slot->translation != NULL && !strcmp(slot->text, text) &&
+       !strcmp(slot->source, source) && !strcmp(slot->target, target)){
+        translation = slot->translation;
+        slot->translation = NULL;
+    }
+
+    // The draft has been sent, so the next one starts anew
+    clear_draft(slot);
+
+    return translation;
+}
+
+/**
+ * @brief Stops watching the drafts
+ *
+ * Translations still in flight are discarded when they finish
+ */
+void draft_translation_shutdown(void){
+    g_hash_table_destroy(slots);
+    slots = NULL;
+}
+
+#else
+
+/**
+ * @brief Does nothing, as drafts cannot be read without Pidgin
+ *
+ * @param plugin Not used
+ */
+void draft_translation_init(void *plugin){
+}
+
+/**
+ * @brief Does nothing, as drafts cannot be read without Pidgin
+ *
+ * @param account Not used
+ * @param name Not used
+ * @param text Not used
+ * @param source Not used
+ * @param target Not used
+ * @return NULL
+ */
+char* draft_translation_take(PurpleAccount *account, const char *name, const char *text,
+                             const char *source, const char *target){
+    return NULL;
+}
+
+/**
+ * @brief Does nothing, as drafts cannot be read without Pidgin
+ */
+void draft_translation_shutdown(void){
+}
+
+#endif
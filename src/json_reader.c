@@ -0,0 +1,448 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file json_reader.c
+ * @brief Minimal JSON parser for the answers sent by the APYs
+ */
+
+#include "json_reader.h"
+#include <string.h>
+
+/**
+ * @brief Maximum nesting of arrays and objects accepted by the parser
+ */
+#define JSON_MAX_DEPTH 32
+
+/**
+ * @brief State of the parser while it walks through a text
+ */
+typedef struct {
+    /** Next character to be read */
+    const char *position;
+    /** End of the text */
+    const char *end;
+} json_parser;
+
+static json_value* parse_value(json_parser *parser, int depth);
+
+/**
+ * @brief Skips any whitespace before the next token
+ *
+ * @param parser The parser state
+ */
+static void skip_whitespace(json_parser *parser){
+    while(parser->position < parser->end && g_ascii_isspace(*parser->position)){
+        parser->position++;
+    }
+}
+
+/**
+ * @brief Consumes the given literal if the text continues with it
+ *
+ * @param parser The parser state
+ * @param literal The literal to look for
+ * @return 1 if the literal was consumed, or 0 otherwise
+ */
+static int consume_literal(json_parser *parser, const char *literal){
+    gsize length = strlen(literal);
+
+    if((gsize)(parser->end - parser->position) < length || strncmp(parser->position, literal, length)){
+        return 0;
+    }
+
+    parser->position += length;
+    return 1;
+}
+
+/**
+ * @brief Reads the 4 hexadecimal digits of a \\u escape sequence
+ *
+ * @param parser The parser state, placed right after the 'u'
+ * @param code Reference to where the code unit will be stored
+ * @return 1 on success, or 0 otherwise
+ */
+static int parse_hex4(json_parser *parser, guint32 *code){
+    int i;
+
+    if(parser->end - parser->position < 4){
+        return 0;
+    }
+
+    *code = 0;
+    for(i=0; i<4; i++){
+        if(!g_ascii_isxdigit(parser->position[i])){
+            return 0;
+        }
+        *code = (*code << 4) | g_ascii_xdigit_value(parser->position[i]);
+    }
+
+    parser->position += 4;
+    return 1;
+}
+
+/**
+ * @brief Parses a string, with the parser placed on its opening quote
+ *
+ * @param parser The parser state
+ * @return A newly allocated UTF-8 string, or NULL if the string is malformed
+ */
+static char* parse_string(json_parser *parser){
+    char utf8[6];
+    const char *pair;
+    guint32 code, low;
+    GString *string = g_string_new(NULL);
+
+    parser->position++;
+
+    while(parser->position < parser->end && *parser->position != '"'){
+        if(*parser->position != '\\'){
+            g_string_append_c(string, *parser->position++);
+            continue;
+        }
+
+        if(++parser->position >= parser->end){
+            break;
+        }
+
+        switch(*parser->position++){
+            case '"': g_string_append_c(string, '"'); break;
+            case '\\': g_string_append_c(string, '\\'); break;
+            case '/': g_string_append_c(string, '/'); break;
+            case 'b': g_string_append_c(string, '\b'); break;
+            case 'f': g_string_append_c(string, '\f'); break;
+            case 'n': g_string_append_c(string, '\n'); break;
+            case 'r': g_string_append_c(string, '\r'); break;
+            case 't': g_string_append_c(string, '\t'); break;
+            case 'u':
+                if(!parse_hex4(parser, &code)){
+                    g_string_free(string, TRUE);
+                    return NULL;
+                }
+                // Characters outside the BMP come as a surrogate pair
+                if(code >= 0xD800 && code <= 0xDBFF){
+                    pair = parser->position;
+                    if(consume_literal(parser, "\\u") && parse_hex4(parser, &low) && low >= 0xDC00 && low <= 0xDFFF){
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    else{
+                        // A lone surrogate is not a character, and what follows it is parsed on its own
+                        parser->position = pair;
+                        code = 0xFFFD;
+                    }
+                }
+                // A NUL would cut the string short for everyone reading it as a C string
+                else if((code >= 0xDC00 && code <= 0xDFFF) || code == 0){
+                    code = 0xFFFD;
+                }
+                g_string_append_len(string, utf8, g_unichar_to_utf8(code, utf8));
+                break;
+            default:
+                g_string_free(string, TRUE);
+                return NULL;
+        }
+    }
+
+    if(parser->position >= parser->end){
+        g_string_free(string, TRUE);
+        return NULL;
+    }
+
+    parser->position++;
+    return g_string_free(string, FALSE);
+}
+
+/**
+ * @brief Parses an array or an object, with the parser placed on its opening bracket
+ *
+ * @param parser The parser state
+ * @param value The value to fill. Its type must already be JSON_ARRAY or JSON_OBJECT
+ * @param depth Current nesting level
+ * @return 1 on success, or 0 otherwise
+ */
+static int parse_container(json_parser *parser, json_value *value, int depth){
+    char *key, closing = value->type == JSON_OBJECT ? '}' : ']';
+    json_value *item;
+
+    parser->position++;
+    skip_whitespace(parser);
+
+    if(parser->position < parser->end && *parser->position == closing){
+        parser->position++;
+        return 1;
+    }
+
+    while(parser->position < parser->end){
+        if(value->type == JSON_OBJECT){
+            if(*parser->position != '"' || (key = parse_string(parser)) == NULL){
+                return 0;
+            }
+            g_ptr_array_add(value->keys, key);
+
+            skip_whitespace(parser);
+            if(!consume_literal(parser, ":")){
+                return 0;
+            }
+        }
+
+        if((item = parse_value(parser, depth + 1)) == NULL){
+            return 0;
+        }
+        g_ptr_array_add(value->values, item);
+
+        skip_whitespace(parser);
+        if(consume_literal(parser, ",")){
+            skip_whitespace(parser);
+            continue;
+        }
+        if(parser->position < parser->end && *parser->position == closing){
+            parser->position++;
+            return 1;
+        }
+        return 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parses any JSON value
+ *
+ * @param parser The parser state
+ * @param depth Current nesting level
+ * @return The parsed value, or NULL if the text is malformed
+ */
+static json_value* parse_value(json_parser *parser, int depth){
+    char *number_end;
+    json_value *value;
+
+    skip_whitespace(parser);
+
+    if(parser->position >= parser->end || depth > JSON_MAX_DEPTH){
+        return NULL;
+    }
+
+    value = g_new0(json_value, 1);
+
+    switch(*parser->position){
+        case '{':
+            value->type = JSON_OBJECT;
+            value->keys = g_ptr_array_new_with_free_func(g_free);
+            value->values = g_ptr_array_new_with_free_func((GDestroyNotify)json_free);
+            if(!parse_container(parser, value, depth)){
+                json_free(value);
+                return NULL;
+            }
+            return value;
+        case '[':
+            value->type = JSON_ARRAY;
+            value->values = g_ptr_array_new_with_free_func((GDestroyNotify)json_free);
+            if(!parse_container(parser, value, depth)){
+                json_free(value);
+                return NULL;
+            }
+            return value;
+        case '"':
+            value->type = JSON_STRING;
+            if((value->string = parse_string(parser)) == NULL){
+                json_free(value);
+                return NULL;
+            }
+            return value;
+    }
+
+    if(consume_literal(parser, "null")){
+        value->type = JSON_NULL;
+        return value;
+    }
+    if(consume_literal(parser, "true")){
+        value->type = JSON_BOOLEAN;
+        value->boolean = 1;
+        return value;
+    }
+    if(consume_literal(parser, "false")){
+        value->type = JSON_BOOLEAN;
+        value->boolean = 0;
+        return value;
+    }
+
+    value->type = JSON_NUMBER;
+    value->number = g_ascii_strtod(parser->position, &number_end);
+    if(number_end == parser->position || number_end > parser->end){
+        json_free(value);
+        return NULL;
+    }
+    parser->position = number_end;
+
+    return value;
+}
+
+/**
+ * @brief Parses a JSON text
+ *
+ * @param text The text to be parsed. There must be a null character right after its last byte
+ * @param length Length of the text in bytes
+ * @return The parsed value, which must be freed with json_free(), or NULL if the text is not valid JSON
+ */
+json_value* json_parse(const char *text, gsize length){
+    json_parser parser;
+    json_value *value;
+
+    parser.position = text;
+    parser.end = text + length;
+
+    if((value = parse_value(&parser, 0)) == NULL){
+        return NULL;
+    }
+
+    skip_whitespace(&parser);
+    if(parser.position != parser.end){
+        json_free(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+/**
+ * @brief Frees a value returned by json_parse() and everything it contains
+ *
+ * @param value The value to be freed. May be NULL
+ */
+void json_free(json_value *value){
+    if(value == NULL){
+        return;
+    }
+
+    if(value->keys != NULL){
+        g_ptr_array_free(value->keys, TRUE);
+    }
+    if(value->values != NULL){
+        g_ptr_array_free(value->values, TRUE);
+    }
+    g_free(value->string);
+    g_free(value);
+}
+
+/**
+ * @brief Looks up a member of an object
+ *
+ * @param object The object. May be NULL or not be an object
+ * @param key Name of the member
+ * @return The member, or NULL if it does not exist
+ */
+json_value* json_object_get(const json_value *object, const char *key){
+    guint i;
+
+    if(object == NULL || object->type != JSON_OBJECT){
+        return NULL;
+    }
+
+    for(i=0; i<object->keys->len; i++){
+        if(!strcmp(g_ptr_array_index(object->keys, i), key)){
+            return g_ptr_array_index(object->values, i);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Removes a member from an object without freeing it
+ *
+ * @param object The object. May be NULL or not be an object
+ * @param key Name of the member
+ * @return The member, which must now be freed with json_free(), or NULL if it does not exist
+ */
+json_value* json_object_steal(json_value *object, const char *key){
+    guint i;
+    json_value *member;
+
+    if(object == NULL || object->type != JSON_OBJECT){
+        return NULL;
+    }
+
+    for(i=0; i<object->keys->len; i++){
+        if(!strcmp(g_ptr_array_index(object->keys, i), key)){
+            member = g_ptr_array_index(object->values, i);
+            object->values->pdata[i] = NULL;
+            return member;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Returns an element of an array
+ *
+ * @param array The array. May be NULL or not be an array
+ * @param index Position of the element
+ * @return The element, or NULL if it does not exist
+ */
+json_value* json_array_get(const json_value *array, guint index){
+    if(array == NULL || array->type != JSON_ARRAY || index >= array->values->len){
+        return NULL;
+    }
+
+    return g_ptr_array_index(array->values, index);
+}
+
+/**
+ * @brief Returns the number of elements of an array or members of an object
+ *
+ * @param value The array or object. May be NULL
+ * @return The number of elements, or 0 if value is not an array nor an object
+ */
+guint json_length(const json_value *value){
+    if(value == NULL || value->values == NULL){
+        return 0;
+    }
+
+    return value->values->len;
+}
+
+/**
+ * @brief Returns the contents of a string value
+ *
+ * @param value The value. May be NULL
+ * @return The string, owned by the value, or NULL if value is not a string
+ */
+const char* json_get_string(const json_value *value){
+    if(value == NULL || value->type != JSON_STRING){
+        return NULL;
+    }
+
+    return value->string;
+}
+
+/**
+ * @brief Returns the contents of a number value
+ *
+ * @param value The value. May be NULL
+ * @param default_value Value to return if value is not a number
+ * @return The number
+ */
+double json_get_number(const json_value *value, double default_value){
+    if(value == NULL || value->type != JSON_NUMBER){
+        return default_value;
+    }
+
+    return value->number;
+}
@@ -29,6 +29,23 @@
  */
 typedef enum {DIALOG, PRINT, NONE} info_display_mode;
 
+/**
+ * @brief Describes the different notification functions, so that they can be called later from the main loop
+ */
+typedef enum {INFO, INFO_POPUP, ERROR, ERROR_POPUP} notification_type;
+
+/**
+ * @brief A notification issued from a thread other than the main one
+ */
+typedef struct {
+    /** Which notification function must be called */
+    notification_type type;
+    /** Title of the notification. May be NULL */
+    char *title;
+    /** Main body of the notification */
+    char *text;
+} deferred_notification;
+
 /**
  * @brief The plugin handle
  *
@@ -53,14 +70,79 @@ info_display_mode info_mode = DIALOG;
  */
 int errors_on = 1;
 
+/**
+ * @brief The thread running the main loop
+ *
+ * libpurple may only be used from this thread, so notifications from any other thread are deferred to it
+ */
+GThread *main_thread = NULL;
+
+/**
+ * @brief Calls the notification function for a deferred notification
+ *
+ * Runs on the main loop
+ * @param data The deferred_notification to display
+ * @return FALSE, so that the idle source is removed
+ */
+static gboolean show_deferred_notification(gpointer data){
+    deferred_notification *notification = data;
+
+    switch(notification->type){
+        case INFO:
+            notify_info(notification->text);
+            break;
+        case INFO_POPUP:
+            notify_info_popup(notification->title, notification->text);
+            break;
+        case ERROR:
+            notify_error(notification->text);
+            break;
+        case ERROR_POPUP:
+            notify_error_popup(notification->text);
+            break;
+    }
+
+    g_free(notification->title);
+    g_free(notification->text);
+    g_free(notification);
+
+    return FALSE;
+}
+
+/**
+ * @brief Defers a notification to the main loop if the calling thread is not the main one
+ *
+ * @param type Notification function to be called
+ * @param title Title of the notification. May be NULL
+ * @param text Main body of the notification
+ * @return 1 if the notification was deferred, or 0 if the caller may display it right away
+ */
+static int defer_notification(notification_type type, const char* title, const char* text){
+    deferred_notification *notification;
+
+    if(main_thread == NULL || g_thread_self() == main_thread){
+        return 0;
+    }
+
+    notification = g_new(deferred_notification, 1);
+    notification->type = type;
+    notification->title = g_strdup(title);
+    notification->text = g_strdup(text);
+
+    g_idle_add(show_deferred_notification, notification);
+
+    return 1;
+}
+
 /**
  * @brief Sets the plugin handle variable
  *
- * This function must be called before any other in this file, or else the handle will be NULL, producing an error
+ * This function must be called from the main loop before any other in this file, or else the handle will be NULL, producing an error
  * @param plugin Plugin handle to assign
  */
 void set_translator_plugin(PurplePlugin* plugin){
 	translator_plugin_handle = plugin;
+	main_thread = g_thread_self();
 }
 
 /**
@@ -112,13 +194,18 @@ void notifications_off(void){
 /**
  * @brief Displays an information notification on the current conversation
  *
- * The plugin handle must have been set (set_translator_plugin called) before calling this function
+ * The plugin handle must have been set (set_translator_plugin called) before calling this function.
+ * It may be called from any thread
  * @param text Text string containing the main body of the notification
  */
 void notify_info(const char* text){
 	time_t current;
     time (&current);
 
+    if(defer_notification(INFO, NULL, text)){
+        return;
+    }
+
     if(current_conversation != NULL){
     	purple_conversation_write(current_conversation, "Information", text, PURPLE_MESSAGE_NOTIFY, current);
     }
@@ -127,7 +214,8 @@ void notify_info(const char* text){
 /**
  * @brief Displays an information notification inside a pop-up window
  *
- * The plugin handle must have been set (set_translator_plugin called) before calling this function
+ * The plugin handle must have been set (set_translator_plugin called) before calling this function.
+ * It may be called from any thread
  * @param title Text string containing the title for the notification
  * @param text Text string containing the main body of the notification
  */
@@ -135,6 +223,10 @@ void notify_info_popup(const char* title, const char* text){
 	time_t current;
     time (&current);
 
+    if(defer_notification(INFO_POPUP, title, text)){
+        return;
+    }
+
 	switch(info_mode){
 		case DIALOG:
 			purple_notify_message (translator_plugin_handle, PURPLE_NOTIFY_MSG_INFO,
@@ -153,13 +245,18 @@ void notify_info_popup(const char* title, const char* text){
 /**
  * @brief Displays an error notification on the current conversation
  *
- * The plugin handle must have been set (set_translator_plugin called) before calling this function
+ * The plugin handle must have been set (set_translator_plugin called) before calling this function.
+ * It may be called from any thread
  * @param text Text string containing the main body of the notification
  */
 void notify_error(const char* text){
 	time_t current;
     time (&current);
 
+    if(defer_notification(ERROR, NULL, text)){
+        return;
+    }
+
     if(current_conversation != NULL && errors_on){
     	purple_conversation_write(current_conversation, "Error", text, PURPLE_MESSAGE_ERROR, current);
 	}
@@ -168,13 +265,18 @@ void notify_error(const char* text){
 /**
  * @brief Displays an error notification inside a pop-up window
  *
- * The plugin handle must have been set (set_translator_plugin called) before calling this function
+ * The plugin handle must have been set (set_translator_plugin called) before calling this function.
+ * It may be called from any thread
  * @param text Text string containing the main body of the notification (generally, the cause of the error)
  */
 void notify_error_popup(const char* text){
 	time_t current;
     time (&current);
 
+    if(defer_notification(ERROR_POPUP, NULL, text)){
+        return;
+    }
+
 	if(errors_on){
 		switch(info_mode){
 			case DIALOG:
@@ -0,0 +1,343 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file pair_catalogue.c
+ * @brief Language pairs offered by each APY, so that checking or listing them needs no request
+ *
+ * The pairs of an APY are trusted for PAIR_CATALOGUE_TTL seconds after they were received. They are also written
+ * to the catalogue file, so a new session starts with the pairs received by the previous one.
+ * All the functions in this file may be called from any thread
+ */
+
+#include "pair_catalogue.h"
+#include <string.h>
+
+/**
+ * @brief The language pairs of an APY
+ */
+typedef struct {
+    /** Time, in seconds since the epoch, when the pairs were received */
+    gint64 fetched;
+    /** Source language of each pair, in the order the APY sent them */
+    GPtrArray *sources;
+    /** Target language of each pair, in the order the APY sent them */
+    GPtrArray *targets;
+    /** Set of the pairs, as "source\ttarget" */
+    GHashTable *pairs;
+} apy_catalogue;
+
+/**
+ * @brief Catalogues by APY address
+ *
+ * Protected by catalogue_mutex
+ */
+static GHashTable *catalogues = NULL;
+
+/**
+ * @brief Name of the catalogue file
+ */
+static char *catalogue_file = NULL;
+
+/**
+ * @brief Mutex protecting every variable in this file
+ */
+static GMutex catalogue_mutex;
+
+/**
+ * @brief Frees the catalogue of an APY
+ *
+ * Used as the value destroy function of the catalogues table
+ * @param data The apy_catalogue
+ */
+static void free_catalogue(gpointer data){
+    apy_catalogue *catalogue = data;
+
+    g_ptr_array_free(catalogue->sources, TRUE);
+    g_ptr_array_free(catalogue->targets, TRUE);
+    g_hash_table_destroy(catalogue->pairs);
+    g_free(catalogue);
+}
+
+/**
+ * @brief Creates the catalogue of an APY and adds it to the catalogues table, replacing the previous one
+ *
+ * The caller must hold catalogue_mutex
+ * @param address Address of the APY
+ * @param fetched Time, in seconds since the epoch, when the pairs were received
+ * @param sources Source language of each pair
+ * @param targets Target language of each pair
+ * @param count Number of pairs
+ */
+static void insert_catalogue(const char *address, gint64 fetched, char **sources, char **targets, guint count){
+    guint i;
+    apy_catalogue *catalogue;
+
+    catalogue = g_new(apy_catalogue, 1);
+    catalogue->fetched = fetched;
+    catalogue->sources = g_ptr_array_new_with_free_func(g_free);
+    catalogue->targets = g_ptr_array_new_with_free_func(g_free);
+    catalogue->pairs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for(i=0; i<count; i++){
+        g_ptr_array_add(catalogue->sources, g_strdup(sources[i]));
+        g_ptr_array_add(catalogue->targets, g_strdup(targets[i]));
+        g_hash_table_add(catalogue->pairs, g_strdup_printf("%s\t%s", sources[i], targets[i]));
+    }
+
+    g_hash_table_replace(catalogues, g_strdup(address), catalogue);
+}
+
+/**
+ * @brief Writes every catalogue to the catalogue file
+ *
+ * Each APY is stored in its own group, as addresses may contain characters group names cannot.
+ * The caller must hold catalogue_mutex
+ */
+static void save_catalogues(void){
+    int group = 0;
+    char *name, *data;
+    gsize length;
+    GKeyFile *file;
+    GHashTableIter iter;
+    gpointer address, value;
+    apy_catalogue *catalogue;
+
+    if(catalogue_file == NULL){
+        return;
+    }
+
+    file = g_key_file_new();
+
+    g_hash_table_iter_init(&iter, catalogues);
+    while(g_hash_table_iter_next(&iter, &address, &value)){
+        catalogue = value;
+        name = g_strdup_printf("APY %d", group++);
+
+        g_key_file_set_string(file, name, "address", address);
+        g_key_file_set_int64(file, name, "fetched", catalogue->fetched);
+        g_key_file_set_string_list(file, name, "sources",
+                                   (const gchar* const*)catalogue->sources->pdata, catalogue->sources->len);
+        g_key_file_set_string_list(file, name, "targets",
+                                   (const gchar* const*)catalogue->targets->pdata, catalogue->targets->len);
+
+        g_free(name);
+    }
+
+    data = g_key_file_to_data(file, &length, NULL);
+    g_file_set_contents(catalogue_file, data, length, NULL);
+
+    g_free(data);
+    g_key_file_free(file);
+}
+
+/**
+ * @brief Reads the catalogues stored in the catalogue file
+ *
+ * Groups that are incomplete are skipped. The caller must hold catalogue_mutex
+ */
+static void load_catalogues(void){
+    gsize i, groups_length, sources_length, targets_length;
+    char **groups, *address, **sources, **targets;
+    gint64 fetched;
+    GKeyFile *file;
+
+    file = g_key_file_new();
+
+    if(!g_key_file_load_from_file(file, catalogue_file, G_KEY_FILE_NONE, NULL)){
+        g_key_file_free(file);
+        return;
+    }
+
+    groups = g_key_file_get_groups(file, &groups_length);
+
+    for(i=0; i<groups_length; i++){
+        address = g_key_file_get_string(file, groups[i], "address", NULL);
+        fetched = g_key_file_get_int64(file, groups[i], "fetched", NULL);
+        sources = g_key_file_get_string_list(file, groups[i], "sources", &sources_length, NULL);
+        targets = g_key_file_get_string_list(file, groups[i], "targets", &targets_length, NULL);
+
+        if(address != NULL && sources != NULL && targets != NULL && sources_length == targets_length){
+            insert_catalogue(address, fetched, sources, targets, sources_length);
+        }
+
+        g_free(address);
+        g_strfreev(sources);
+        g_strfreev(targets);
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(file);
+}
+
+/**
+ * @brief Creates the catalogues and fills them with the pairs stored in the catalogue file
+ *
+ * Must be called before any other function in this file
+ * @param filename Name of the catalogue file
+ */
+void pair_catalogue_init(const char *filename){
+    g_mutex_lock(&catalogue_mutex);
+
+    catalogues = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_catalogue);
+    catalogue_file = g_strdup(filename);
+    load_catalogues();
+
+    g_mutex_unlock(&catalogue_mutex);
+}
+
+/**
+ * @brief Replaces the language pairs of an APY with the ones it has just sent
+ *
+ * The catalogue file is updated
+ * @param address Address of the APY
+ * @param sources Source language of each pair
+ * @param targets Target language of each pair
+ * @param count Number of pairs
+ */
+void pair_catalogue_set(const char *address, char **sources, char **targets, guint count){
+    g_mutex_lock(&catalogue_mutex);
+
+    if(catalogues != NULL){
+        insert_catalogue(address, g_get_real_time() / G_USEC_PER_SEC, sources, targets, count);
+        save_catalogues();
+    }
+
+    g_mutex_unlock(&catalogue_mutex);
+}
+
+/**
+ * @brief Checks whether the language pairs of an APY are recent enough to be trusted
+ *
+ * @param address Address of the APY
+ * @return 1 if the pairs were received less than PAIR_CATALOGUE_TTL seconds ago, 0 if they have expired,
+ * or -1 if they are not known
+ */
+int pair_catalogue_is_fresh(const char *address){
+    int fresh = -1;
+    gint64 now;
+    apy_catalogue *catalogue;
+
+    now = g_get_real_time() / G_USEC_PER_SEC;
+
+    g_mutex_lock(&catalogue_mutex);
+
+    if(catalogues != NULL && (catalogue = g_hash_table_lookup(catalogues, address)) != NULL){
+        fresh = catalogue->fetched <= now && now - catalogue->fetched < PAIR_CATALOGUE_TTL;
+    }
+
+    g_mutex_unlock(&catalogue_mutex);
+
+    return fresh;
+}
+
+/**
+ * @brief Checks whether an APY offers a language pair
+ *
+ * Expired pairs are also looked up, so that an APY that cannot be reached is judged by its last answer
+ * @param address Address of the APY
+ * @param source Source language of the pair
+ * @param target Target language of the pair
+ * @return 1 if the APY offers the pair, 0 if it does not, or -1 if its pairs are not known
+ */
+int pair_catalogue_contains(const char *address, const char *source, const char *target){
+    int result = -1;
+    char *key;
+    apy_catalogue *catalogue;
+
+    key = g_strdup_printf("%s\t%s", source, target);
+
+    g_mutex_lock(&catalogue_mutex);
+
+    if(catalogues != NULL && (catalogue = g_hash_table_lookup(catalogues, address)) != NULL){
+        result = g_hash_table_contains(catalogue->pairs, key);
+    }
+
+    g_mutex_unlock(&catalogue_mutex);
+
+    g_free(key);
+    return result;
+}
+
+/**
+ * @brief Retrieves the language pairs of an APY
+ *
+ * Expired pairs are also returned
+ * @param address Address of the APY
+ * @param sources Reference to where the source language of each pair will be stored, as a NULL-terminated array
+ * @param targets Reference to where the target language of each pair will be stored, as a NULL-terminated array.
+ * Both arrays must be freed with g_strfreev()
+ * @return The number of pairs, or -1 if the pairs of the APY are not known, in which case nothing is stored
+ */
+int pair_catalogue_get(const char *address, char ***sources, char ***targets){
+    int count = -1;
+    guint i;
+    apy_catalogue *catalogue;
+
+    g_mutex_lock(&catalogue_mutex);
+
+    if(catalogues != NULL && (catalogue = g_hash_table_lookup(catalogues, address)) != NULL){
+        count = catalogue->sources->len;
+        *sources = g_new(char*, count + 1);
+        *targets = g_new(char*, count + 1);
+
+        for(i=0; i<catalogue->sources->len; i++){
+            (*sources)[i] = g_strdup(g_ptr_array_index(catalogue->sources, i));
+            (*targets)[i] = g_strdup(g_ptr_array_index(catalogue->targets, i));
+        }
+        (*sources)[count] = NULL;
+        (*targets)[count] = NULL;
+    }
+
+    g_mutex_unlock(&catalogue_mutex);
+
+    return count;
+}
+
+/**
+ * @brief Drops the language pairs of an APY, both from memory and from the catalogue file
+ *
+ * @param address Address of the APY
+ */
+void pair_catalogue_forget(const char *address){
+    g_mutex_lock(&catalogue_mutex);
+
+    if(catalogues != NULL && g_hash_table_remove(catalogues, address)){
+        save_catalogues();
+    }
+
+    g_mutex_unlock(&catalogue_mutex);
+}
+
+/**
+ * @brief Frees the catalogues
+ *
+ * The catalogue file is left untouched, as it is always up to date
+ */
+void pair_catalogue_shutdown(void){
+    g_mutex_lock(&catalogue_mutex);
+
+    g_hash_table_destroy(catalogues);
+    catalogues = NULL;
+
+    g_free(catalogue_file);
+    catalogue_file = NULL;
+
+    g_mutex_unlock(&catalogue_mutex);
+}
@@ -0,0 +1,447 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file preference_log.c
+ * @brief Append-only log of the changes to the preferences, so that they are kept without rewriting the whole file
+ *
+ * Each change is a line of tab-separated fields, escaped with g_strescape(). The lines are written by a thread of
+ * their own, which syncs them to disk at most PREFERENCE_LOG_SYNC_DELAY milliseconds after they are written, so
+ * a change costs the main loop no disk access. Once the log holds PREFERENCE_LOG_COMPACT_RECORDS changes, the
+ * preferences are written whole by the snapshot function on the writer thread and the log is emptied. The main
+ * loop only gathers what the snapshot needs beforehand and picks up the new snapshot afterwards.<br>
+ * When the log is opened, its changes are replayed on top of the snapshot. A line cut short by a crash is dropped.
+ * The functions in this file must be called from the main loop
+ */
+
+#include "preference_log.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief Kinds of work for the writer thread
+ */
+typedef enum {
+    /** Append a line to the log */
+    LOG_WRITE,
+    /** Write the snapshot and empty the log, as its changes are in the snapshot */
+    LOG_SNAPSHOT,
+    /** Sync the pending lines and exit */
+    LOG_STOP
+} log_operation;
+
+/**
+ * @brief A snapshot of the preferences handed to the writer thread
+ */
+typedef struct {
+    /** Data returned by the freeze function */
+    gpointer data;
+    /** Number of changes in the log when the snapshot was taken */
+    guint records;
+    /** 1 if the snapshot was written, or 0 otherwise */
+    int saved;
+} log_snapshot;
+
+/**
+ * @brief Work for the writer thread
+ */
+typedef struct {
+    /** What to do */
+    log_operation operation;
+    /** Line to append, ending with a newline, for LOG_WRITE */
+    char *line;
+    /** Snapshot to write, for LOG_SNAPSHOT */
+    log_snapshot *snapshot;
+} log_item;
+
+/**
+ * @brief File descriptor of the log, or -1 if it is not open
+ */
+static int log_fd = -1;
+
+/**
+ * @brief The thread writing the log
+ */
+static GThread *writer = NULL;
+
+/**
+ * @brief Work waiting for the writer thread, in order
+ */
+static GAsyncQueue *pending = NULL;
+
+/**
+ * @brief Function gathering on the main loop what the snapshot needs
+ */
+static preference_log_freeze_func freeze_func = NULL;
+
+/**
+ * @brief Function writing the snapshot of the preferences on the writer thread
+ */
+static preference_log_snapshot_func snapshot_func = NULL;
+
+/**
+ * @brief Function picking up the result of the snapshot on the main loop
+ */
+static preference_log_thaw_func thaw_func = NULL;
+
+/**
+ * @brief Number of changes in the log since the last snapshot
+ */
+static guint records = 0;
+
+/**
+ * @brief ID of the idle source taking the snapshot, or 0 if there is none
+ */
+static guint compact_source = 0;
+
+/**
+ * @brief 1 while a snapshot is waiting for the writer thread or being written, or 0 otherwise
+ */
+static int snapshotting = 0;
+
+/**
+ * @brief Snapshot written by the writer thread, whose result has not been picked up yet, or NULL if there is none
+ *
+ * Protected by snapshot_mutex
+ */
+static log_snapshot *finished_snapshot = NULL;
+
+/**
+ * @brief ID of the idle source picking up finished_snapshot, or 0 if there is none
+ *
+ * Protected by snapshot_mutex
+ */
+static guint finish_source = 0;
+
+/**
+ * @brief Mutex protecting finished_snapshot and finish_source
+ */
+static GMutex snapshot_mutex;
+
+/**
+ * @brief Writes a whole buffer to the log, retrying after interruptions and partial writes
+ *
+ * Runs on the writer thread
+ * @param buffer The buffer
+ * @param length Number of bytes to write
+ */
+static void write_all(const char *buffer, gsize length){
+    gssize written;
+
+    while(length > 0){
+        if((written = write(log_fd, buffer, length)) < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        buffer += written;
+        length -= written;
+    }
+}
+
+/**
+ * @brief Queues work for the writer thread
+ *
+ * @param operation What to do
+ * @param line Line to append for LOG_WRITE, or NULL. It is freed by the writer thread
+ * @param snapshot Snapshot to write for LOG_SNAPSHOT, or NULL
+ */
+static void push_item(log_operation operation, char *line, log_snapshot *snapshot){
+    log_item *item = g_new(log_item, 1);
+
+    item->operation = operation;
+    item->line = line;
+    item->snapshot = snapshot;
+    g_async_queue_push(pending, item);
+}
+
+/**
+ * @brief Takes a snapshot and hands it to the writer thread, which writes it and empties the log
+ *
+ * The changes queued before this runs are already applied to the preferences, so they are in the snapshot.
+ * Those queued after it are written to the emptied log. No snapshot is taken if the freeze function refuses
+ * @param unused Not used
+ * @return FALSE, so that the idle source is removed
+ */
+static gboolean compact_log(gpointer unused){
+    gpointer data;
+    log_snapshot *snapshot;
+
+    compact_source = 0;
+
+    if((data = freeze_func()) == NULL){
+        return FALSE;
+    }
+
+    snapshot = g_new0(log_snapshot, 1);
+    snapshot->data = data;
+    snapshot->records = records;
+
+    records = 0;
+    snapshotting = 1;
+    push_item(LOG_SNAPSHOT, NULL, snapshot);
+
+    return FALSE;
+}
+
+/**
+ * @brief Takes a snapshot once the log is long enough, unless one is being written already
+ */
+static void schedule_compaction(void){
+    if(writer != NULL && !snapshotting && records >= PREFERENCE_LOG_COMPACT_RECORDS && compact_source == 0){
+        compact_source = g_idle_add(compact_log, NULL);
+    }
+}
+
+/**
+ * @brief Hands the result of the snapshot written by the writer thread to the thaw function
+ *
+ * Runs on the main loop. If the snapshot could not be written, its changes are still in the log and a snapshot
+ * is tried again after the next change
+ * @param unused Not used
+ * @return FALSE, so that the idle source is removed
+ */
+static gboolean finish_snapshot(gpointer unused){
+    log_snapshot *snapshot;
+
+    g_mutex_lock(&snapshot_mutex);
+    snapshot = finished_snapshot;
+    finished_snapshot = NULL;
+    finish_source = 0;
+    g_mutex_unlock(&snapshot_mutex);
+
+    if(snapshot == NULL){
+        return FALSE;
+    }
+
+    thaw_func(snapshot->data, snapshot->saved);
+    snapshotting = 0;
+
+    if(snapshot->saved){
+        schedule_compaction();
+    }
+    else{
+        records += snapshot->records;
+    }
+
+    g_free(snapshot);
+
+    return FALSE;
+}
+
+/**
+ * @brief Appends the queued changes to the log and syncs them once they have waited long enough
+ *
+ * @param unused Not used
+ * @return NULL
+ */
+static gpointer writer_main(gpointer unused){
+    int dirty = 0, running = 1;
+    gint64 deadline = 0, now;
+    log_item *item;
+
+    while(running){
+        if(dirty){
+            now = g_get_monotonic_time();
+            item = now < deadline ? g_async_queue_timeout_pop(pending, deadline - now) : NULL;
+        }
+        else{
+            item = g_async_queue_pop(pending);
+        }
+
+        // Nothing else arrived in time, or changes keep arriving and the oldest one has waited long enough
+        if(item == NULL){
+            fdatasync(log_fd);
+            dirty = 0;
+            continue;
+        }
+
+        switch(item->operation){
+            case LOG_WRITE:
+                write_all(item->line, strlen(item->line));
+                if(!dirty){
+                    dirty = 1;
+                    deadline = g_get_monotonic_time() + (gint64)PREFERENCE_LOG_SYNC_DELAY * 1000;
+                }
+                break;
+            case LOG_SNAPSHOT:
+                // The lines written so far are the changes in the snapshot, and the next ones are still queued
+                if((item->snapshot->saved = snapshot_func(item->snapshot->data)) && ftruncate(log_fd, 0) == 0){
+                    fdatasync(log_fd);
+                    dirty = 0;
+                }
+
+                g_mutex_lock(&snapshot_mutex);
+                finished_snapshot = item->snapshot;
+                finish_source = g_idle_add(finish_snapshot, NULL);
+                g_mutex_unlock(&snapshot_mutex);
+                break;
+            case LOG_STOP:
+                if(dirty){
+                    fdatasync(log_fd);
+                }
+                running = 0;
+                break;
+        }
+
+        g_free(item->line);
+        g_free(item);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Replays the changes in the log and starts the writer thread
+ *
+ * Must be called after the snapshot has been read and before any other function in this file
+ * @param filename Name of the log file
+ * @param replay Function called for each change in the log, oldest first
+ * @param data Data passed to replay
+ * @param freeze Function gathering on the main loop what the snapshot needs
+ * @param snapshot Function writing every preference to the snapshot on the writer thread
+ * @param thaw Function picking up the result of the snapshot on the main loop
+ * @return 1 on success, or 0 if the log could not be opened, in which case changes are not logged
+ */
+int preference_log_open(const char *filename, preference_log_replay_func replay, gpointer data,
+                        preference_log_freeze_func freeze, preference_log_snapshot_func snapshot,
+                        preference_log_thaw_func thaw){
+    int i;
+    char *contents = NULL, *line, *end, *field, **fields;
+    gsize length = 0, valid = 0;
+
+    if((log_fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0600)) < 0){
+        return 0;
+    }
+
+    freeze_func = freeze;
+    snapshot_func = snapshot;
+    thaw_func = thaw;
+    records = 0;
+    snapshotting = 0;
+
+    if(g_file_get_contents(filename, &contents, &length, NULL)){
+        for(line = contents; (end = memchr(line, '\n', length - (line - contents))) != NULL; line = end + 1){
+            *end = '\0';
+
+            fields = g_strsplit(line, "\t", -1);
+            for(i=0; fields[i] != NULL; i++){
+                field = g_strcompress(fields[i]);
+                g_free(fields[i]);
+                fields[i] = field;
+            }
+
+            if(fields[0] != NULL){
+                replay(fields, data);
+                records++;
+            }
+            g_strfreev(fields);
+
+            valid = end + 1 - contents;
+        }
+
+        g_free(contents);
+
+        // A crash may have cut the last line short, and the next change must not be appended to it
+        if(valid < length && ftruncate(log_fd, valid) < 0){
+            close(log_fd);
+            log_fd = -1;
+            return 0;
+        }
+    }
+
+    pending = g_async_queue_new();
+    writer = g_thread_new("preference-log", writer_main, NULL);
+
+    schedule_compaction();
+
+    return 1;
+}
+
+/**
+ * @brief Logs a change to the preferences
+ *
+ * The change must already be applied to the preferences, so that the next snapshot includes it.
+ * Nothing is done if the log is not open
+ * @param fields NULL-terminated array with the fields of the change. The first one names the kind of change
+ */
+void preference_log_append(const char **fields){
+    int i;
+    char *escaped;
+    GString *line;
+
+    if(writer == NULL){
+        return;
+    }
+
+    line = g_string_new(NULL);
+    for(i=0; fields[i] != NULL; i++){
+        escaped = g_strescape(fields[i], NULL);
+        if(i > 0){
+            g_string_append_c(line, '\t');
+        }
+        g_string_append(line, escaped);
+        g_free(escaped);
+    }
+    g_string_append_c(line, '\n');
+
+    push_item(LOG_WRITE, g_string_free(line, FALSE), NULL);
+    records++;
+
+    schedule_compaction();
+}
+
+/**
+ * @brief Writes and syncs the changes still queued and closes the log
+ *
+ * No new snapshot is taken, so closing does not depend on the number of preferences. A snapshot already handed
+ * to the writer thread is finished, and its result picked up before returning
+ */
+void preference_log_close(void){
+    if(compact_source != 0){
+        g_source_remove(compact_source);
+        compact_source = 0;
+    }
+
+    if(writer != NULL){
+        push_item(LOG_STOP, NULL, NULL);
+        g_thread_join(writer);
+        writer = NULL;
+
+        g_async_queue_unref(pending);
+        pending = NULL;
+
+        g_mutex_lock(&snapshot_mutex);
+        if(finish_source != 0){
+            g_source_remove(finish_source);
+            finish_source = 0;
+        }
+        g_mutex_unlock(&snapshot_mutex);
+
+        finish_snapshot(NULL);
+    }
+
+    if(log_fd >= 0){
+        close(log_fd);
+        log_fd = -1;
+    }
+}
@@ -0,0 +1,706 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file preference_store.c
+ * @brief Binary file holding the preferences, memory-mapped and looked up in place
+ *
+ * The file is written whole by a preference_store_builder and never changed afterwards, so opening it costs
+ * the same whatever the number of bindings: it is mapped and its header checked, without any parsing.
+ * It is made of a header followed by these sections:
+ * - The language pairs, each of them a pair of offsets into the string table, so each pair is stored once.
+ * - A hash table of buddies with open addressing, whose buckets hold the hash and the name offset of a buddy
+ *   and the index of its incoming and outgoing language pairs.
+ * - The integer settings, as name offset and value.
+ * - The APY list, as offsets.
+ * - The string table: every language code, buddy name, setting name and address, each of them once and
+ *   null-terminated. Offset 0 is an empty string, which marks the empty buckets.
+ *
+ * Every offset and index read from the file is checked before it is used, so a damaged file cannot make a lookup
+ * read outside the mapping. The functions in this file must be called from the main loop, except
+ * preference_store_foreach() and the builder functions, which the thread writing the preference log uses while the
+ * store is not opened again
+ */
+
+#include "preference_store.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Identifies a preference store
+ */
+#define PREFERENCE_STORE_MAGIC "APTPREFS"
+
+/**
+ * @brief Version of the file layout. Files with any other version are ignored
+ */
+#define PREFERENCE_STORE_VERSION 1
+
+/**
+ * @brief Index of a missing language pair, or APY count of a store without an APY list
+ */
+#define PREFERENCE_STORE_NONE 0xFFFFFFFFu
+
+/**
+ * @brief Header at the beginning of the store
+ */
+typedef struct {
+    /** PREFERENCE_STORE_MAGIC, without its terminating null */
+    char magic[8];
+    /** PREFERENCE_STORE_VERSION */
+    guint32 version;
+    /** Size of the whole file, in bytes */
+    guint32 file_size;
+    /** Number of language pairs */
+    guint32 pair_count;
+    /** Number of buckets of the buddy hash table, a power of two */
+    guint32 bucket_count;
+    /** Number of integer settings */
+    guint32 setting_count;
+    /** Number of APYs in the APY list, or PREFERENCE_STORE_NONE if no list is stored */
+    guint32 apy_count;
+    /** Size of the string table, in bytes */
+    guint32 string_bytes;
+    /** Unused, keeps the sections aligned */
+    char reserved[12];
+} store_header;
+
+/**
+ * @brief A language pair of the store
+ */
+typedef struct {
+    /** Offset of the source language */
+    guint32 source;
+    /** Offset of the target language */
+    guint32 target;
+} store_pair;
+
+/**
+ * @brief A bucket of the buddy hash table
+ */
+typedef struct {
+    /** Hash of the buddy name */
+    guint32 hash;
+    /** Offset of the buddy name, or 0 if the bucket is empty */
+    guint32 user;
+    /** Index of the incoming and outgoing language pairs, or PREFERENCE_STORE_NONE if there is none */
+    guint32 pair[2];
+} store_bucket;
+
+/**
+ * @brief An integer setting of the store
+ */
+typedef struct {
+    /** Offset of the name of the setting */
+    guint32 key;
+    /** Unused, keeps the value aligned */
+    guint32 reserved;
+    /** Value of the setting */
+    gint64 value;
+} store_setting;
+
+/**
+ * @brief The language pairs bound to a buddy, gathered by a builder
+ */
+typedef struct {
+    /** Source language for each direction, or NULL if there is no binding in that direction */
+    char *source[2];
+    /** Target language for each direction, or NULL if there is no binding in that direction */
+    char *target[2];
+} builder_binding;
+
+/**
+ * @brief Preferences gathered to be written as a new store
+ */
+struct preference_store_builder {
+    /** builder_bindings by buddy name */
+    GHashTable *bindings;
+    /** Values of the integer settings, by name */
+    GHashTable *settings;
+    /** The APY list, or NULL if it is not stored */
+    char **apys;
+    /** Number of APYs in apys */
+    int apy_count;
+};
+
+/**
+ * @brief The mapped store, or NULL if there is none
+ */
+static const store_header *header = NULL;
+
+/**
+ * @brief Size, in bytes, of the mapping
+ */
+static gsize mapped_size = 0;
+
+/**
+ * @brief First language pair of the mapped store
+ */
+static const store_pair *pairs = NULL;
+
+/**
+ * @brief First bucket of the mapped store
+ */
+static const store_bucket *buckets = NULL;
+
+/**
+ * @brief First integer setting of the mapped store
+ */
+static const store_setting *settings = NULL;
+
+/**
+ * @brief Offsets of the APYs of the mapped store
+ */
+static const guint32 *apys = NULL;
+
+/**
+ * @brief String table of the mapped store
+ */
+static const char *strings = NULL;
+
+/**
+ * @brief Hashes a buddy name with 32-bit FNV-1a
+ *
+ * @param key The name
+ * @return The hash
+ */
+static guint32 hash_key(const char *key){
+    guint32 hash = 2166136261u;
+
+    for(; *key != '\0'; key++){
+        hash ^= (guchar)*key;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Returns the string at an offset of the string table
+ *
+ * @param offset The offset
+ * @return The string, or NULL if the offset is outside the string table
+ */
+static const char* string_at(guint32 offset){
+    return offset < header->string_bytes ? strings + offset : NULL;
+}
+
+/**
+ * @brief Returns the number of APY offsets stored after the settings
+ *
+ * @param store The header of a store
+ * @return The number of APYs, 0 if no list is stored
+ */
+static guint32 stored_apys(const store_header *store){
+    return store->apy_count == PREFERENCE_STORE_NONE ? 0 : store->apy_count;
+}
+
+/**
+ * @brief Checks that a mapped file is a store this code can use
+ *
+ * @param store The beginning of the mapped file
+ * @param size Size of the mapped file, at least that of the header
+ * @return 1 if the file is valid, or 0 otherwise
+ */
+static int header_is_valid(const store_header *store, gsize size){
+    guint64 expected;
+
+    if(memcmp(store->magic, PREFERENCE_STORE_MAGIC, sizeof(store->magic)) ||
+       store->version != PREFERENCE_STORE_VERSION || store->file_size != size ||
+       store->bucket_count == 0 || (store->bucket_count & (store->bucket_count - 1)) != 0 ||
+       store->string_bytes == 0){
+        return 0;
+    }
+
+    expected = sizeof(store_header) + (guint64)store->pair_count * sizeof(store_pair) +
+               (guint64)store->bucket_count * sizeof(store_bucket) +
+               (guint64)store->setting_count * sizeof(store_setting) +
+               (guint64)stored_apys(store) * sizeof(guint32) + store->string_bytes;
+
+    return expected == size && ((const char*)store)[size - 1] == '\0';
+}
+
+/**
+ * @brief Maps the store, replacing the one mapped before
+ *
+ * @param filename Name of the store
+ * @return 1 on success, or 0 if the file does not exist or is not a valid store, in which case the store is empty
+ */
+int preference_store_open(const char *filename){
+    int fd;
+    struct stat info;
+    void *data;
+
+    preference_store_close();
+
+    if((fd = open(filename, O_RDONLY)) < 0){
+        return 0;
+    }
+
+    if(fstat(fd, &info) < 0 ||
+       (guint64)info.st_size < sizeof(store_header) || (guint64)info.st_size > G_MAXUINT32){
+        close(fd);
+        return 0;
+    }
+
+    // The store is replaced by renaming, never written in place, so the mapping stays valid
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED){
+        return 0;
+    }
+
+    if(!header_is_valid(data, info.st_size)){
+        munmap(data, info.st_size);
+        return 0;
+    }
+
+    header = data;
+    mapped_size = info.st_size;
+    pairs = (const store_pair*)(header + 1);
+    buckets = (const store_bucket*)(pairs + header->pair_count);
+    settings = (const store_setting*)(buckets + header->bucket_count);
+    apys = (const guint32*)(settings + header->setting_count);
+    strings = (const char*)(apys + stored_apys(header));
+
+    return 1;
+}
+
+/**
+ * @brief Finds a language pair of a buddy
+ *
+ * Nothing is allocated. The returned strings point into the mapping and are valid until the store is closed
+ * @param user Name of the buddy
+ * @param direction PREFERENCE_STORE_INCOMING or PREFERENCE_STORE_OUTGOING
+ * @param source Reference to where the source language will be stored. May be NULL
+ * @param target Reference to where the target language will be stored. May be NULL
+ * @return 1 if there is a language pair bound, or 0 otherwise
+ */
+int preference_store_lookup(const char *user, int direction, const char **source, const char **target){
+    guint32 i, probes, hash, mask;
+    const char *name, *source_text, *target_text;
+    const store_bucket *bucket;
+
+    if(header == NULL){
+        return 0;
+    }
+
+    hash = hash_key(user);
+    mask = header->bucket_count - 1;
+
+    for(i = hash & mask, probes = 0; probes < header->bucket_count; i = (i + 1) & mask, probes++){
+        bucket = &buckets[i];
+
+        if(bucket->user == 0){
+            return 0;
+        }
+
+        if(bucket->hash != hash || (name = string_at(bucket->user)) == NULL || strcmp(name, user)){
+            continue;
+        }
+
+        if(bucket->pair[direction] >= header->pair_count ||
+           (source_text = string_at(pairs[bucket->pair[direction]].source)) == NULL ||
+           (target_text = string_at(pairs[bucket->pair[direction]].target)) == NULL){
+            return 0;
+        }
+
+        if(source != NULL){
+            *source = source_text;
+        }
+        if(target != NULL){
+            *target = target_text;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Retrieves an integer setting
+ *
+ * @param key Name of the setting
+ * @param value Reference to where the value will be stored
+ * @return 1 if the setting is stored, or 0 otherwise
+ */
+int preference_store_get_int(const char *key, gint64 *value){
+    guint32 i;
+    const char *name;
+
+    if(header == NULL){
+        return 0;
+    }
+
+    for(i=0; i<header->setting_count; i++){
+        if((name = string_at(settings[i].key)) != NULL && !strcmp(name, key)){
+            *value = settings[i].value;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Retrieves the APY list
+ *
+ * @param addresses Reference to where an array with the addresses will be stored. The array must be freed with
+ * g_free(). The addresses point into the mapping and are valid until the store is closed
+ * @return The number of addresses, or -1 if no APY list is stored
+ */
+int preference_store_get_apys(const char ***addresses){
+    guint32 i;
+    int count = 0;
+    const char *address;
+
+    if(header == NULL || header->apy_count == PREFERENCE_STORE_NONE){
+        return -1;
+    }
+
+    *addresses = g_new(const char*, header->apy_count + 1);
+    for(i=0; i<header->apy_count; i++){
+        if((address = string_at(apys[i])) != NULL){
+            (*addresses)[count++] = address;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Calls a function for every binding and another one for every integer setting in the store
+ *
+ * @param binding Function called for each binding. May be NULL
+ * @param setting Function called for each integer setting. May be NULL
+ * @param data Data passed to both functions
+ */
+void preference_store_foreach(preference_store_binding_func binding, preference_store_setting_func setting,
+                              gpointer data){
+    guint32 i;
+    int direction;
+    const char *user, *source, *target, *key;
+
+    if(header == NULL){
+        return;
+    }
+
+    for(i=0; binding != NULL && i<header->bucket_count; i++){
+        if(buckets[i].user == 0 || (user = string_at(buckets[i].user)) == NULL){
+            continue;
+        }
+
+        for(direction=PREFERENCE_STORE_INCOMING; direction<=PREFERENCE_STORE_OUTGOING; direction++){
+            if(buckets[i].pair[direction] < header->pair_count &&
+               (source = string_at(pairs[buckets[i].pair[direction]].source)) != NULL &&
+               (target = string_at(pairs[buckets[i].pair[direction]].target)) != NULL){
+                binding(user, direction, source, target, data);
+            }
+        }
+    }
+
+    for(i=0; setting != NULL && i<header->setting_count; i++){
+        if((key = string_at(settings[i].key)) != NULL){
+            setting(key, settings[i].value, data);
+        }
+    }
+}
+
+/**
+ * @brief Unmaps the store
+ *
+ * Every string returned by the store becomes invalid
+ */
+void preference_store_close(void){
+    if(header != NULL){
+        munmap((void*)header, mapped_size);
+    }
+
+    header = NULL;
+    mapped_size = 0;
+    pairs = NULL;
+    buckets = NULL;
+    settings = NULL;
+    apys = NULL;
+    strings = NULL;
+}
+
+/**
+ * @brief Frees the language pairs of a buddy gathered by a builder
+ *
+ * Used as the value destroy function of the bindings table
+ * @param data The builder_binding
+ */
+static void free_binding(gpointer data){
+    builder_binding *binding = data;
+    int i;
+
+    for(i=0; i<2; i++){
+        g_free(binding->source[i]);
+        g_free(binding->target[i]);
+    }
+    g_free(binding);
+}
+
+/**
+ * @brief Creates an empty builder
+ *
+ * @return The builder, which must be freed with preference_store_builder_free()
+ */
+preference_store_builder* preference_store_builder_new(void){
+    preference_store_builder *builder = g_new0(preference_store_builder, 1);
+
+    builder->bindings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_binding);
+    builder->settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    builder->apy_count = -1;
+
+    return builder;
+}
+
+/**
+ * @brief Adds a binding to a builder, replacing the one added before for the same buddy and direction
+ *
+ * @param builder The builder
+ * @param user Name of the buddy
+ * @param direction PREFERENCE_STORE_INCOMING or PREFERENCE_STORE_OUTGOING
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ */
+void preference_store_builder_add_binding(preference_store_builder *builder, const char *user, int direction,
+                                          const char *source, const char *target){
+    builder_binding *binding;
+
+    if(*user == '\0'){
+        return;
+    }
+
+    if((binding = g_hash_table_lookup(builder->bindings, user)) == NULL){
+        binding = g_new0(builder_binding, 1);
+        g_hash_table_insert(builder->bindings, g_strdup(user), binding);
+    }
+
+    g_free(binding->source[direction]);
+    g_free(binding->target[direction]);
+    binding->source[direction] = g_strdup(source);
+    binding->target[direction] = g_strdup(target);
+}
+
+/**
+ * @brief Adds an integer setting to a builder, replacing the one added before with the same name
+ *
+ * @param builder The builder
+ * @param key Name of the setting
+ * @param value Value of the setting
+ */
+void preference_store_builder_add_int(preference_store_builder *builder, const char *key, gint64 value){
+    gint64 *stored = g_new(gint64, 1);
+
+    *stored = value;
+    g_hash_table_insert(builder->settings, g_strdup(key), stored);
+}
+
+/**
+ * @brief Sets the APY list of a builder
+ *
+ * @param builder The builder
+ * @param addresses The addresses, in order. They are copied
+ * @param count Number of addresses
+ */
+void preference_store_builder_set_apys(preference_store_builder *builder, char **addresses, int count){
+    int i;
+
+    g_strfreev(builder->apys);
+
+    builder->apys = g_new(char*, count + 1);
+    for(i=0; i<count; i++){
+        builder->apys[i] = g_strdup(addresses[i]);
+    }
+    builder->apys[count] = NULL;
+    builder->apy_count = count;
+}
+
+/**
+ * @brief Returns the offset of a string in the string table being built, adding it if it is not there yet
+ *
+ * @param table The string table
+ * @param offsets Offsets of the strings already in the table
+ * @param text The string
+ * @return The offset
+ */
+static guint32 intern_string(GString *table, GHashTable *offsets, const char *text){
+    gpointer offset;
+
+    if(g_hash_table_lookup_extended(offsets, text, NULL, &offset)){
+        return GPOINTER_TO_UINT(offset);
+    }
+
+    offset = GUINT_TO_POINTER(table->len);
+    g_string_append_len(table, text, strlen(text) + 1);
+    g_hash_table_insert(offsets, g_strdup(text), offset);
+
+    return GPOINTER_TO_UINT(offset);
+}
+
+/**
+ * @brief Returns the index of a language pair in the pair table being built, adding it if it is not there yet
+ *
+ * @param pair_table The pair table, an array of store_pair
+ * @param pair_ids Indexes of the language pairs already in the table
+ * @param table The string table
+ * @param offsets Offsets of the strings already in the table
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @return The index
+ */
+static guint32 intern_pair(GArray *pair_table, GHashTable *pair_ids, GString *table, GHashTable *offsets,
+                           const char *source, const char *target){
+    char *key;
+    gpointer id;
+    store_pair pair;
+
+    key = g_strdup_printf("%s\t%s", source, target);
+
+    if(g_hash_table_lookup_extended(pair_ids, key, NULL, &id)){
+        g_free(key);
+        return GPOINTER_TO_UINT(id);
+    }
+
+    pair.source = intern_string(table, offsets, source);
+    pair.target = intern_string(table, offsets, target);
+    g_array_append_val(pair_table, pair);
+
+    id = GUINT_TO_POINTER(pair_table->len - 1);
+    g_hash_table_insert(pair_ids, key, id);
+
+    return GPOINTER_TO_UINT(id);
+}
+
+/**
+ * @brief Writes the preferences gathered by a builder as a new store
+ *
+ * The file is replaced atomically, so a crash leaves either the old store or the new one. A store that is mapped
+ * keeps its old contents until it is opened again
+ * @param builder The builder
+ * @param filename Name of the store
+ * @return 1 on success, or 0 otherwise
+ */
+int preference_store_builder_save(preference_store_builder *builder, const char *filename){
+    int direction, saved;
+    guint32 i, hash, mask, offset, bucket_count = 8;
+    GString *table, *file;
+    GHashTable *offsets, *pair_ids;
+    GArray *pair_table;
+    GHashTableIter iter;
+    gpointer key, value;
+    builder_binding *binding;
+    store_bucket *bucket_table;
+    store_setting setting;
+    store_header store;
+
+    table = g_string_new(NULL);
+    g_string_append_c(table, '\0');
+    offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_insert(offsets, g_strdup(""), GUINT_TO_POINTER(0));
+    pair_table = g_array_new(FALSE, FALSE, sizeof(store_pair));
+    pair_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    // At most half the buckets are used, so that probing stays short
+    while(bucket_count < 2 * g_hash_table_size(builder->bindings)){
+        bucket_count *= 2;
+    }
+    mask = bucket_count - 1;
+    bucket_table = g_new0(store_bucket, bucket_count);
+
+    g_hash_table_iter_init(&iter, builder->bindings);
+    while(g_hash_table_iter_next(&iter, &key, &value)){
+        binding = value;
+
+        hash = hash_key(key);
+        i = hash & mask;
+        while(bucket_table[i].user != 0){
+            i = (i + 1) & mask;
+        }
+
+        bucket_table[i].hash = hash;
+        bucket_table[i].user = intern_string(table, offsets, key);
+        for(direction=PREFERENCE_STORE_INCOMING; direction<=PREFERENCE_STORE_OUTGOING; direction++){
+            bucket_table[i].pair[direction] = binding->source[direction] == NULL ? PREFERENCE_STORE_NONE :
+                intern_pair(pair_table, pair_ids, table, offsets, binding->source[direction], binding->target[direction]);
+        }
+    }
+
+    memset(&store, 0, sizeof(store));
+    memcpy(store.magic, PREFERENCE_STORE_MAGIC, sizeof(store.magic));
+    store.version = PREFERENCE_STORE_VERSION;
+    store.pair_count = pair_table->len;
+    store.bucket_count = bucket_count;
+    store.setting_count = g_hash_table_size(builder->settings);
+    store.apy_count = builder->apy_count < 0 ? PREFERENCE_STORE_NONE : (guint32)builder->apy_count;
+
+    file = g_string_new(NULL);
+    g_string_append_len(file, (const char*)&store, sizeof(store));
+    g_string_append_len(file, (const char*)pair_table->data, pair_table->len * sizeof(store_pair));
+    g_string_append_len(file, (const char*)bucket_table, bucket_count * sizeof(store_bucket));
+
+    g_hash_table_iter_init(&iter, builder->settings);
+    while(g_hash_table_iter_next(&iter, &key, &value)){
+        setting.key = intern_string(table, offsets, key);
+        setting.reserved = 0;
+        setting.value = *(gint64*)value;
+        g_string_append_len(file, (const char*)&setting, sizeof(setting));
+    }
+
+    for(i=0; i<stored_apys(&store); i++){
+        offset = intern_string(table, offsets, builder->apys[i]);
+        g_string_append_len(file, (const char*)&offset, sizeof(offset));
+    }
+
+    g_string_append_len(file, table->str, table->len);
+
+    // The sizes are only known once every string has been interned
+    ((store_header*)file->str)->string_bytes = table->len;
+    ((store_header*)file->str)->file_size = file->len;
+
+    saved = file->len <= G_MAXUINT32 && g_file_set_contents(filename, file->str, file->len, NULL);
+
+    g_string_free(file, TRUE);
+    g_free(bucket_table);
+    g_hash_table_destroy(pair_ids);
+    g_array_free(pair_table, TRUE);
+    g_hash_table_destroy(offsets);
+    g_string_free(table, TRUE);
+
+    return saved;
+}
+
+/**
+ * @brief Frees a builder
+ *
+ * @param builder The builder
+ */
+void preference_store_builder_free(preference_store_builder *builder){
+    g_hash_table_destroy(builder->bindings);
+    g_hash_table_destroy(builder->settings);
+    g_strfreev(builder->apys);
+    g_free(builder);
+}
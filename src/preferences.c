@@ -0,0 +1,538 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file preferences.c
+ * @brief The plugin preferences: bindings, APY list, display mode and integer settings
+ *
+ * The preferences are read in place from the preference store, and the changes made since the store was written
+ * are kept in memory (the buddy index for the bindings) and appended to the preference log. Once the log is long
+ * enough, the store is written again with every preference on the thread writing the log, and the log is emptied.
+ * Starting up only maps the store and replays the log, so it takes the same time whatever the number of bindings.<br>
+ * All the functions in this file must be called from the main loop
+ */
+
+#include "preferences.h"
+#include "preference_store.h"
+#include "preference_log.h"
+#include "buddy_index.h"
+#include "apy_client.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Name of the setting holding the display mode
+ */
+#define DISPLAY_MODE_KEY "displayMode"
+
+/**
+ * @brief Name of the preference store
+ */
+static char *store_file = NULL;
+
+/**
+ * @brief Integer settings changed since the store was written, by name
+ */
+static GHashTable *changed_settings = NULL;
+
+/**
+ * @brief 1 while the preference store is being written by the conversion of the preferences of earlier versions
+ *
+ * The store is not written from the log until the conversion has finished, so that neither overwrites the other
+ */
+static int converting = 0;
+
+/**
+ * @brief 1 once the APY list has been changed since the plugin was loaded
+ */
+static int apys_changed = 0;
+
+/**
+ * @brief The preferences changed since the store was written, copied to write the store again on another thread
+ */
+typedef struct {
+    /** Copy of the changed bindings */
+    buddy_index_snapshot *bindings;
+    /** Copy of changed_settings */
+    GHashTable *settings;
+    /** The APY list, or NULL if it could not be read */
+    char **addresses;
+    /** Number of APYs in the list */
+    int count;
+    /** The new preference store, while it is being written */
+    preference_store_builder *builder;
+} store_snapshot;
+
+/**
+ * @brief Changes an integer setting in memory
+ *
+ * @param key Name of the setting
+ * @param value Value of the setting
+ */
+static void changeSetting(const char* key, gint64 value){
+    gint64 *stored = g_new(gint64, 1);
+
+    *stored = value;
+    g_hash_table_insert(changed_settings, g_strdup(key), stored);
+}
+
+/**
+ * @brief Replaces the APY list with the one in the preference store, if there is any
+ */
+static void restoreAPYList(void){
+    int count;
+    const char **addresses;
+
+    if((count = preference_store_get_apys(&addresses)) < 0){
+        return;
+    }
+
+    apySetList((char**)addresses, count);
+    g_free(addresses);
+}
+
+/**
+ * @brief Applies to the preferences a change read from the preference log
+ *
+ * Used as the replay function of the log, which does not log the changes again while it is being opened
+ * @param fields NULL-terminated array with the fields of the change
+ * @param data Not used
+ */
+static void replayChange(char **fields, gpointer data){
+    guint count = g_strv_length(fields);
+
+    if(!strcmp(fields[0], "bind") && count == 5){
+        buddy_index_set(fields[2], fields[1], fields[3], fields[4]);
+    }
+    else if(!strcmp(fields[0], "unbind") && count == 3){
+        buddy_index_remove(fields[2], fields[1], converting);
+    }
+    else if(!strcmp(fields[0], "forget") && count == 2){
+        buddy_index_remove(fields[1], NULL, converting);
+    }
+    else if(!strcmp(fields[0], "int") && count == 3){
+        changeSetting(fields[1], g_ascii_strtoll(fields[2], NULL, 10));
+    }
+    else if(!strcmp(fields[0], "apys")){
+        apySetList(fields + 1, count - 1);
+        apys_changed = 1;
+    }
+}
+
+/**
+ * @brief Adds a binding to the new preference store
+ *
+ * Used with buddy_index_foreach()
+ * @param user Name of the buddy
+ * @param direction "incoming" or "outgoing"
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param data The preference_store_builder
+ */
+static void storeBinding(const char *user, const char *direction, const char *source, const char *target,
+                         gpointer data){
+    preference_store_builder_add_binding(data, user,
+        strcmp(direction, "incoming") ? PREFERENCE_STORE_OUTGOING : PREFERENCE_STORE_INCOMING, source, target);
+}
+
+/**
+ * @brief Adds an integer setting of the current preference store to the new one, unless it has changed
+ *
+ * @param key Name of the setting
+ * @param value Value of the setting
+ * @param data The store_snapshot
+ */
+static void storeSetting(const char *key, gint64 value, gpointer data){
+    store_snapshot *snapshot = data;
+
+    if(g_hash_table_lookup(snapshot->settings, key) == NULL){
+        preference_store_builder_add_int(snapshot->builder, key, value);
+    }
+}
+
+/**
+ * @brief Copies the preferences changed since the store was written
+ *
+ * Used as the freeze function of the preference log. Only the changes are copied, so this does not depend on the
+ * number of preferences. Nothing is copied while the store is being converted, so that the store is not written
+ * @return The store_snapshot, or NULL while the store is being converted
+ */
+static gpointer freezeStore(void){
+    GHashTableIter iter;
+    gpointer key, value;
+    gint64 *copy;
+    store_snapshot *snapshot;
+
+    if(converting){
+        return NULL;
+    }
+
+    snapshot = g_new0(store_snapshot, 1);
+    snapshot->bindings = buddy_index_snapshot_new();
+    snapshot->settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    snapshot->count = getAPYAddress(&snapshot->addresses);
+
+    g_hash_table_iter_init(&iter, changed_settings);
+    while(g_hash_table_iter_next(&iter, &key, &value)){
+        copy = g_new(gint64, 1);
+        *copy = *(gint64*)value;
+        g_hash_table_insert(snapshot->settings, g_strdup(key), copy);
+    }
+
+    return snapshot;
+}
+
+/**
+ * @brief Writes the preference store again with the current store and the copied changes
+ *
+ * Used as the snapshot function of the preference log, so it runs on the thread writing the log. The current store
+ * stays mapped meanwhile, as it is only opened again by thawStore()
+ * @param data The store_snapshot
+ * @return 1 on success, or 0 otherwise
+ */
+static int writeStore(gpointer data){
+    int saved;
+    GHashTableIter iter;
+    gpointer key, value;
+    store_snapshot *snapshot = data;
+
+    snapshot->builder = preference_store_builder_new();
+
+    buddy_index_snapshot_foreach(snapshot->bindings, storeBinding, snapshot->builder);
+
+    preference_store_foreach(NULL, storeSetting, snapshot);
+    g_hash_table_iter_init(&iter, snapshot->settings);
+    while(g_hash_table_iter_next(&iter, &key, &value)){
+        preference_store_builder_add_int(snapshot->builder, key, *(gint64*)value);
+    }
+
+    if(snapshot->count >= 0){
+        preference_store_builder_set_apys(snapshot->builder, snapshot->addresses, snapshot->count);
+    }
+
+    saved = preference_store_builder_save(snapshot->builder, store_file);
+
+    preference_store_builder_free(snapshot->builder);
+    snapshot->builder = NULL;
+
+    return saved;
+}
+
+/**
+ * @brief Maps the preference store once it has been written again, and drops the changes it holds
+ *
+ * Used as the thaw function of the preference log. The changes made while the store was being written are kept
+ * @param data The store_snapshot, which is freed
+ * @param saved 1 if the store was written, or 0 otherwise
+ */
+static void thawStore(gpointer data, int saved){
+    int i;
+    GHashTableIter iter;
+    gpointer key, value;
+    gint64 *current;
+    store_snapshot *snapshot = data;
+
+    if(saved){
+        preference_store_open(store_file);
+        buddy_index_snapshot_written(snapshot->bindings);
+
+        g_hash_table_iter_init(&iter, snapshot->settings);
+        while(g_hash_table_iter_next(&iter, &key, &value)){
+            if((current = g_hash_table_lookup(changed_settings, key)) != NULL && *current == *(gint64*)value){
+                g_hash_table_remove(changed_settings, key);
+            }
+        }
+    }
+
+    for(i=0; i<snapshot->count; i++){
+        free(snapshot->addresses[i]);
+    }
+    if(snapshot->count >= 0){
+        free(snapshot->addresses);
+    }
+
+    buddy_index_snapshot_free(snapshot->bindings);
+    g_hash_table_destroy(snapshot->settings);
+    g_free(snapshot);
+}
+
+/**
+ * @brief Reads the preferences and restores the APY list stored in them
+ *
+ * The buddy index must have been created before. All the functions in this file require this to be first called
+ * in order to work properly. While the store is being converted, the preferences start empty and the changes are
+ * kept on top of the converted ones once preferencesConverted() is called
+ * @param store_filename Name of the preference store
+ * @param log_filename Name of the file where the changes to the preferences are logged
+ * @param converting_store 1 if the store is being written on a worker thread by pythonMigratePreferences(), or 0
+ * otherwise
+ */
+void preferencesInit(const char* store_filename, const char* log_filename, int converting_store){
+    store_file = g_strdup(store_filename);
+    converting = converting_store;
+    apys_changed = 0;
+    changed_settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    preference_store_open(store_file);
+    restoreAPYList();
+
+    preference_log_open(log_filename, replayChange, NULL, freezeStore, writeStore, thawStore);
+}
+
+/**
+ * @brief Reads the preference store once its conversion has finished
+ *
+ * The changes made in the meantime still take precedence over the converted preferences
+ */
+void preferencesConverted(void){
+    converting = 0;
+
+    preference_store_open(store_file);
+    if(!apys_changed){
+        restoreAPYList();
+    }
+}
+
+/**
+ * @brief Syncs the changes still being logged and closes the preferences
+ *
+ * The preference store is not written again, so this does not depend on the number of preferences
+ */
+void preferencesFinalize(void){
+    preference_log_close();
+
+    g_hash_table_destroy(changed_settings);
+    changed_settings = NULL;
+
+    preference_store_close();
+
+    g_free(store_file);
+    store_file = NULL;
+}
+
+/**
+ * @brief Stores the latest changes to the APY address list
+ *
+ * @return 1 on success, or 0 otherwise
+ */
+int updateFileAddresses(void){
+    int i, count;
+    char **addresses;
+    const char **fields;
+
+    if((count = getAPYAddress(&addresses)) < 0){
+        return 0;
+    }
+
+    fields = g_new(const char*, count + 2);
+    fields[0] = "apys";
+    for(i=0; i<count; i++){
+        fields[i + 1] = addresses[i];
+    }
+    fields[count + 1] = NULL;
+
+    preference_log_append(fields);
+    apys_changed = 1;
+    g_free(fields);
+
+    for(i=0; i<count; i++){
+        free(addresses[i]);
+    }
+    free(addresses);
+
+    return 1;
+}
+
+/**
+ * @brief Returns the stored display_mode
+ *
+ * @return The display_mode value on success or NULL otherwise
+ */
+const char* getDisplay(void){
+    long mode;
+
+    if((mode = getIntKey(DISPLAY_MODE_KEY, -1)) < 0){
+        return NULL;
+    }
+
+    switch(mode){
+        case 0:
+            return "compressed";
+        case 1:
+            return "both";
+        case 3:
+            return "progressive";
+        default:
+            return "translation";
+    }
+}
+
+/**
+ * @brief Stores the display_mode
+ *
+ * @param display_mode The display_mode. Must be 'both', 'translation', 'compressed' or 'progressive'
+ * @return 1 on success or 0 otherwise
+ */
+int setDisplay(const char* display_mode){
+    int mode;
+
+    if(!strcmp("compressed",display_mode)){
+        mode = 0;
+    }
+    else{
+        if(!strcmp("both",display_mode)){
+            mode = 1;
+        }
+        else if(!strcmp("progressive",display_mode)){
+            mode = 3;
+        }
+        else{
+            mode = 2;
+        }
+    }
+
+    return setIntKey(DISPLAY_MODE_KEY, mode);
+}
+
+/**
+ * @brief Retrieves an integer setting
+ *
+ * @param key Name of the setting
+ * @param default_value Value returned if the setting has never been stored
+ * @return The value of the setting, or default_value if it is not stored
+ */
+long getIntKey(const char* key, long default_value){
+    gint64 *changed, value;
+
+    if((changed = g_hash_table_lookup(changed_settings, key)) != NULL){
+        return (long)*changed;
+    }
+
+    if(preference_store_get_int(key, &value)){
+        return (long)value;
+    }
+
+    return default_value;
+}
+
+/**
+ * @brief Stores an integer setting
+ *
+ * @param key Name of the setting
+ * @param value Value of the setting
+ * @return 1 on success, or 0 otherwise
+ */
+int setIntKey(const char* key, long value){
+    char number[32];
+    const char *fields[] = {"int", key, number, NULL};
+
+    changeSetting(key, value);
+
+    sprintf(number, "%ld", value);
+    preference_log_append(fields);
+
+    return 1;
+}
+
+/**
+ * @brief Checks whether there is a language pair bound to a given user
+ *
+ * @param user Name of the user to look for
+ * @param direction Direction to look for the user in ("incoming" or "outgoing")
+ * @return 1 if there is a language pair for the user, or 0 otherwise
+ */
+int dictionaryHasUser(const char* user, const char* direction){
+    return buddy_index_lookup(user, direction, NULL, NULL);
+}
+
+/**
+ * @brief Returns the language bound to a user
+ *
+ * The returned string is valid until the preferences change, so it must be copied to be kept
+ * @param user Name of the user to look for
+ * @param direction Direction to look for the user in ("incoming" or "outgoing")
+ * @param key Language to look for ("source" or "target")
+ * @return The language if the call was successful, or "None" otherwise
+ */
+char* dictionaryGetUserLanguage(const char *user, const char* direction, const char* key){
+    const char *source, *target;
+
+    if(!buddy_index_lookup(user, direction, &source, &target)){
+        return "None";
+    }
+
+    return (char*)(strcmp(key, "source") ? target : source);
+}
+
+/**
+ * @brief Binds a language pair to a user
+ *
+ * @param user Name of the user to create a new entry for
+ * @param direction Direction to create a new entry in ("incoming" or "outgoing")
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @return 1 on success, or 0 otherwise
+ */
+int dictionarySetUserEntry(const char* user, const char* direction, const char* source, const char* target){
+    const char *fields[] = {"bind", direction, user, source, target, NULL};
+
+    if(!buddy_index_set(user, direction, source, target)){
+        return 0;
+    }
+
+    preference_log_append(fields);
+    return 1;
+}
+
+/**
+ * @brief Removes the language pair bound to a user in one direction
+ *
+ * While the preference store is being converted, the removal is always kept, as the language pair may be in
+ * the converted store
+ * @param user Name of the user whose entry will be removed
+ * @param entry Name of the entry that will be removed. Must be either 'incoming' or 'outgoing'
+ * @return 1 on success, or 0 if there was no language pair bound
+ */
+int dictionaryRemoveUserEntry(const char* user, char* entry){
+    const char *fields[] = {"unbind", entry, user, NULL};
+
+    if(!buddy_index_remove(user, entry, converting)){
+        return 0;
+    }
+
+    preference_log_append(fields);
+    return 1;
+}
+
+/**
+ * @brief Removes every language pair bound to a user
+ *
+ * @param user Name of the user whose entries will be removed
+ * @return 1 on success, or 0 otherwise
+ */
+int dictionaryRemoveUserEntries(const char* user){
+    const char *fields[] = {"forget", user, NULL};
+
+    buddy_index_remove(user, NULL, converting);
+    preference_log_append(fields);
+
+    return 1;
+}
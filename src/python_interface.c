@@ -20,943 +20,433 @@
 /**
  * @file python_interface.c
  * @brief Functions to interface the plugin and Python
+ *
+ * Earlier versions of the plugin stored their preferences with the apertiumFiles module. Python is only used to
+ * read those preferences once and convert them into the preference store (see preferences.c), so the interpreter
+ * is not needed afterwards.<br>
+ * The interpreter may be started and used from any thread: pythonMigratePreferences() takes the GIL through
+ * PyGILState, and releases it while it writes the store
  */
 
 #include "python_interface.h"
+#include "preference_store.h"
 
 /**
- * @brief Reference to the apertiumFiles module
- *
- * Initialized with the pythonInit() function
+ * @brief The functions of the apertiumFiles module used by the plugin
  */
-PyObject *files_module;
+typedef enum {SET_FILE, READ_FILE, GET_KEY, GET_DICTIONARY, BOUND_FUNCTIONS} bound_function;
 
 /**
- * @brief Reference to the apertiumInterfaceAPY module
- *
- * Initialized with the pythonInit() function
+ * @brief Strings passed to Python often enough to be created only once
  */
-PyObject *iface_module;
+typedef enum {NAME_INCOMING, NAME_OUTGOING, NAME_SOURCE, NAME_TARGET, NAME_APY_ADDRESS, NAME_DISPLAY_MODE,
+              CACHED_NAMES} cached_name;
 
 /**
- * @brief Initializes the Python environment
- *
- * Loads both the apertiumFiles and apertiumInterfaceAPY modules, which are used by the plugin.<br>
- * All the functions in this file require this to be first called in order to work properly
- * @param filename Name of the file where the preferences for the plugin will be stored
+ * @brief Names of the functions in bound_function, in the same order
  */
-void pythonInit(const char* filename){
-    PyObject *pFunc, *pArgs, *addresses;
-
-    Py_SetProgramName(NULL);
-    Py_Initialize();
-
-    files_module = PyImport_ImportModule("apertiumpluginutils.apertiumFiles");
-
-    if (files_module != NULL) {
-        pFunc = PyObject_GetAttrString(files_module, "setFile");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(1);
-
-            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString(filename));
-
-            PyObject_CallObject(pFunc, pArgs);
-            Py_XDECREF(pArgs);
-        }
-        else {
-            return;
-        }
-        Py_XDECREF(pFunc);
-
-        pFunc = PyObject_GetAttrString(files_module, "read");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(0);
-            PyObject_CallObject(pFunc, pArgs);
-            Py_XDECREF(pArgs);
-        }
-        else {
-            return;
-        }
-        Py_XDECREF(pFunc);
-
-        pFunc = PyObject_GetAttrString(files_module, "getKey");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(1);
-
-            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString("apyAddress"));
-
-            addresses = PyObject_CallObject(pFunc, pArgs);
-            if(addresses == NULL || addresses == Py_None){
-                Py_XDECREF(pArgs);
-                Py_XDECREF(pFunc);
-                return;
-            }
-            Py_XDECREF(pArgs);
-        }
-        else {
-            return;
-        }
-        Py_XDECREF(pFunc);
-    }
-    else {
-        notify_error_popup("Failed to load module: \'apertiumFiles\'");
-        return;
-    }
-
-    iface_module = PyImport_ImportModule("apertiumpluginutils.apertiumInterfaceAPY");
-
-    if (iface_module != NULL) {
-        pFunc = PyObject_GetAttrString(iface_module, "setAPYList");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(1);
-
-            PyTuple_SetItem(pArgs, 0, addresses);
-
-            if(PyObject_CallObject(pFunc, pArgs) == NULL){
-                Py_XDECREF(pFunc);
-                Py_XDECREF(addresses);
-                notify_error_popup("Error on setAPYList(result is null)");
-                return;
-            }
-        }
-        else {
-            notify_error_popup("Error on setAPYList(pfunc)");
-            return;
-        }
-        Py_XDECREF(pFunc);
-        Py_XDECREF(addresses);
-    }
-    else{
-        notify_error_popup("Failed to load module: \'apertiumInterfaceAPY\'");
-        return;
-    }
-}
+static const char *bound_function_names[BOUND_FUNCTIONS] = {
+    "setFile", "read", "getKey", "getDictionary"
+};
 
 /**
- * @brief Finalizes the Python environment
+ * @brief Text of the strings in cached_name, in the same order
  */
-void pythonFinalize(void){
-    Py_Finalize();
-}
+static const char *cached_name_texts[CACHED_NAMES] = {
+    "incoming", "outgoing", "source", "target", "apyAddress", "displayMode"
+};
 
 /**
- * @brief Retrieves a list with all the APYs
+ * @brief Integer settings stored by the plugin under a fixed name
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param list References to a 2-level char array where the apy list will be stored
- * The list parameter must be freed after its use
- * @return The number of addresses returned or -1 if an error occured
+ * The weights of the APYs are stored as "apyWeight <address>" for each address in the APY list
  */
-int getAPYAddress(char ***list){
-    int i,size;
-    PyObject *pFunc, *pArgs, *result;
-
-    if (iface_module != NULL) {
-        pFunc = PyObject_GetAttrString(iface_module, "getAPYList");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(0);
-
-            result = PyObject_CallObject(pFunc, pArgs);
-
-            if (result != NULL) {
-
-                size = PyList_GET_SIZE(result);
-
-                *list = malloc(sizeof(char*)*size);
-                for(i=0; i<size; i++){
-                    (*list)[i] = PyBytes_AsString(PyList_GetItem(result,i));
-                }
-
-                Py_XDECREF(pFunc);
-                Py_XDECREF(result);
-                return size;
-            }
-            else {
-                Py_XDECREF(pFunc);
-                return -1;
-            }
-        }
-        else {
-            return -1;
-        }
-        Py_XDECREF(pFunc);
-    }
-    else {
-        notify_error("Module: \'apertiumInterfaceAPY\' is not loaded");
-        return -1;
-    }
-}
+static const char *setting_names[] = {
+    "poolIdle", "poolActive", "hedge", "apyPolicy", "breakerFailures", "breakerCooldown",
+    "cacheEntries", "cacheBytes", "batchWindow", "batchTexts", "batchBytes", NULL
+};
 
 /**
- * @brief Sets the address where the request for the Apertium-APY will be sent
+ * @brief Reference to the apertiumFiles module
  *
- * The address will not be set if there is no response from an APY server <br>
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param address Pointer to a string with the new address
- * @param port Pointer to a string with the new port. NULL if no port is needed
- * @param order Position this address will take in the list. Negative value to append at the end
- * @param force Any number that is not 0 indicates the function to forcefully change the address,
- * despite not receiving an answer from the server
- * @return 1 if the call was successful and the address was set, or 0 otherwise
+ * Initialized with the pythonMigratePreferences() function
  */
-int setAPYAddress(char* address, char* port, int order, int force){
-    char* msg;
-    PyObject *pFunc, *pArg, *pArgs, *new_address;
-
-    if (iface_module != NULL) {
-        pFunc = PyObject_GetAttrString(iface_module, "setAPYAddress");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(4);
-
-            pArg = PyBytes_FromString(address);
-            PyTuple_SetItem(pArgs, 0, pArg);
-
-            pArg = port == NULL ? Py_None : PyBytes_FromString(port);
-            PyTuple_SetItem(pArgs, 1, pArg);
-
-            PyTuple_SetItem(pArgs, 2, order > -1 ? PyLong_FromLong(order) : Py_None);
-
-            PyTuple_SetItem(pArgs, 3, force == 0 ? Py_False : Py_True);
-
-            new_address = PyObject_CallObject(pFunc, pArgs);
-            Py_XDECREF(pArgs);
-            Py_XDECREF(pFunc);
-
-            if (new_address != NULL){
-                if(new_address != Py_None){
-                    if(files_module != NULL){
-                        pFunc = PyObject_GetAttrString(files_module, "setKey");
-
-                        if (pFunc) {
-                            pArgs = PyTuple_New(2);
-
-                            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString("apyAddress"));
-
-                            PyTuple_SetItem(pArgs, 1, new_address);
-
-                            PyObject_CallObject(pFunc, pArgs);
-
-                            Py_XDECREF(new_address);
-                        }
-                        else{
-                            Py_XDECREF(new_address);
-                            return 0;
-                        }
-                    }
-                    else{
-                        notify_error("Module: \'apertiumFiles\' is not loaded");
-                        return 0;
-                    }
-                    return 1;
-                }
-                else{
-                    msg = malloc(sizeof(char)*(strlen(address)+(port == NULL ? 0 : strlen(port))+100));
-                    if(port != NULL){
-                        sprintf(msg,"No response from server at %s:%s",address,port);
-                    }
-                    else{
-                        sprintf(msg,"No response from server at %s",address);
-                    }
-                    notify_error(msg);
-                    free(msg);
-                    return 0;
-                }
-            }
-            else {
-                return 0;
-            }
-        }
-        else {
-            return 0;
-        }
-        Py_XDECREF(pFunc);
-    }
-    else {
-        notify_error("Module: \'apertiumInterfaceAPY\' is not loaded");
-        return 0;
-    }
-}
+PyObject *files_module;
 
 /**
- * @brief Removes the APY address at the given position in the APY list
+ * @brief The functions of the apertiumFiles module, or NULL for those that could not be found
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param position Position in the list of the address to be removed
- * @return 1 on success, or 0 otherwise
+ * Filled and released by pythonMigratePreferences()
  */
-int removeAPYAddress(int position){
-    PyObject *pFunc, *pArgs, *result;
-
-    if(iface_module != NULL){
-        pFunc = PyObject_GetAttrString(iface_module, "removeAPYAddress");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(1);
-
-            PyTuple_SetItem(pArgs, 0, PyLong_FromLong((long)position));
-
-            result = PyObject_CallObject(pFunc, pArgs);
-
-            Py_XDECREF(pArgs);
-
-            if(result != NULL && result != Py_False){
-                Py_XDECREF(result);
-                Py_XDECREF(pFunc);
-
-                if(updateFileAddresses()){
-                    return 1;
-                }
-                else{
-                    return 0;
-                }
-            }
-            else{
-                Py_XDECREF(pFunc);
-                return 0;
-            }
-        }
-        else{
-            return 0;
-        }
-    }
-    else{
-        notify_error("Module: \'apertiumInterfaceAPY\' is not loaded");
-        return 0;
-    }
-}
+static PyObject *bound_functions[BOUND_FUNCTIONS];
 
 /**
- * @brief Sets the APY list key in the dictionary
+ * @brief The Python objects for the strings in cached_name
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param list APY list to be set
- * @return 1 on success, or 0 otherwise
+ * Filled and released by pythonMigratePreferences()
  */
-int setFileAPYList(PyObject* list){
-    PyObject *pFunc, *pArgs;
-
-    if(files_module != NULL){
-        pFunc = PyObject_GetAttrString(files_module, "setKey");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(2);
-
-            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString("apyAddress"));
+static PyObject *cached_names[CACHED_NAMES];
 
-            PyTuple_SetItem(pArgs, 1, list);
-
-            PyObject_CallObject(pFunc, pArgs);
+/**
+ * @brief Thread state of the thread that called pythonInit() while it does not hold the GIL
+ *
+ * Set at the end of pythonInit() and restored by pythonFinalize()
+ */
+static PyThreadState *init_thread_state = NULL;
 
-            Py_XDECREF(pArgs);
-            Py_XDECREF(pFunc);
+/**
+ * @brief Looks up the functions of the apertiumFiles module and creates the cached strings
+ *
+ * The caller must hold the GIL
+ */
+static void bindFunctions(void){
+    int i;
 
-            return 1;
-        }
-        else{
-            return 0;
+    for(i=0; i<BOUND_FUNCTIONS; i++){
+        if((bound_functions[i] = PyObject_GetAttrString(files_module, bound_function_names[i])) == NULL){
+            PyErr_Clear();
         }
     }
-    else{
-        notify_error("Module: \'apertiumFiles\' is not loaded");
-        return 0;
+
+    for(i=0; i<CACHED_NAMES; i++){
+#if PY_MAJOR_VERSION >= 3
+        cached_names[i] = PyUnicode_InternFromString(cached_name_texts[i]);
+#else
+        cached_names[i] = PyUnicode_FromString(cached_name_texts[i]);
+#endif
     }
 }
 
 /**
- * @brief Writes to the preferences files the latest changes to the APY address list
+ * @brief Releases the objects created by bindFunctions()
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @return 1 on success, or 0 otherwise
+ * The caller must hold the GIL
  */
-int updateFileAddresses(void){
-    PyObject *pFunc, *pArgs, *list;
-
-    if(iface_module != NULL){
-        pFunc = PyObject_GetAttrString(iface_module, "getAPYList");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(0);
-
-            list = PyObject_CallObject(pFunc, pArgs);
+static void releaseFunctions(void){
+    int i;
 
-            Py_XDECREF(pArgs);
-            Py_XDECREF(pFunc);
-
-            if(list != NULL){
-
-                if(setFileAPYList(list)){
-                    return 1;
-                }
-                else{
-                    return 0;
-                }
-            }
-            else{
-                return 0;
-            }
-        }
-        else{
-            return 0;
-        }
+    for(i=0; i<BOUND_FUNCTIONS; i++){
+        Py_CLEAR(bound_functions[i]);
     }
-    else{
-        notify_error("Module: \'apertiumInterfaceAPY\' is not loaded");
-        return 0;
+
+    for(i=0; i<CACHED_NAMES; i++){
+        Py_CLEAR(cached_names[i]);
     }
+
+    Py_CLEAR(files_module);
 }
 
 /**
- * @brief Returns the value for the display_mode stored in the preferences file
+ * @brief Returns a function of the apertiumFiles module
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @return The display_mode value on success or NULL otherwise
+ * An error is notified if the function is not available. The caller must hold the GIL
+ * @param function The function
+ * @return A borrowed reference to the function, or NULL if it is not available
  */
-const char* getDisplay(void){
-    int mode;
-    PyObject *pFunc, *pArgs, *result;
-
-    if(files_module != NULL){
-        pFunc = PyObject_GetAttrString(files_module, "getKey");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(1);
-
-            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString("displayMode"));
-
-            result = PyObject_CallObject(pFunc, pArgs);
-
-            Py_XDECREF(pArgs);
-
-            if(result != NULL && result != Py_None){
-                mode = (int)PyLong_AsLong(result);
-                Py_XDECREF(result);
-                switch(mode){
-                    case 0:
-                        return "compressed";
-                    case 1:
-                        return "both";
-                    default:
-                        return "translation";
-                }
-            }
-            else{
-                Py_XDECREF(pFunc);
-                return NULL;
-            }
-        }
-        else{
-            return NULL;
-        }
-    }
-    else{
+static PyObject* boundFunction(bound_function function){
+    if(bound_functions[function] == NULL){
         notify_error("Module: \'apertiumFiles\' is not loaded");
-        return NULL;
     }
+
+    return bound_functions[function];
 }
 
 /**
- * @brief Sets the display_mode value in the dictionary so that it is store in the preferences file
+ * @brief Calls the getKey function of the apertiumFiles module
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param display_mode The display_mode. Must be 'both', 'translation' or 'compressed'
- * @return 1 on success or 0 otherwise
+ * The caller must hold the GIL
+ * @param name Name of the key
+ * @return A new reference to the value of the key, or NULL if the key is not stored or the call failed
  */
-int setDisplay(const char* display_mode){
-    int mode;
-    PyObject *pFunc, *pArgs;
+static PyObject* getKey(PyObject* name){
+    PyObject *pFunc, *result;
 
-    if(!strcmp("compressed",display_mode)){
-        mode = 0;
-    }
-    else{
-        if(!strcmp("both",display_mode)){
-            mode = 1;
-        }
-        else{
-            mode = 2;
-        }
+    if((pFunc = boundFunction(GET_KEY)) == NULL){
+        return NULL;
     }
 
-    if(files_module != NULL){
-        pFunc = PyObject_GetAttrString(files_module, "setKey");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(2);
-
-            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString("displayMode"));
-
-            PyTuple_SetItem(pArgs, 1, PyLong_FromLong((long)mode));
+    result = PyObject_CallFunctionObjArgs(pFunc, name, NULL);
 
-            PyObject_CallObject(pFunc, pArgs);
-
-            Py_XDECREF(pArgs);
-        }
-        else{
-            return 0;
-        }
-        Py_XDECREF(pFunc);
-        return 1;
+    if(result == NULL){
+        PyErr_Clear();
     }
-    else{
-        notify_error("Module: \'apertiumFiles\' is not loaded");
-        return 0;
+    else if(result == Py_None){
+        Py_DECREF(result);
+        result = NULL;
     }
+
+    return result;
 }
 
 /**
- * @brief Checks whether the dictionary contains language pair information for a given user
+ * @brief Checks the value returned by a function of the apertiumFiles module that returns True on success
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param user Name of the user to look for
- * @param direction Direction to look for the user in ("incoming" or "outgoing")
- * @return 1 if there is a language pair for the user, or 0 otherwise
+ * The caller must hold the GIL
+ * @param result The value returned by the function, or NULL if the call failed. The reference is released
+ * @return 1 if the function returned True, or 0 otherwise
  */
-int dictionaryHasUser(const char* user, const char* direction){
-    int has_user;
-    PyObject *dictionary;
+static int isTrue(PyObject* result){
+    int value;
 
-    if((dictionary = getDictionary()) == Py_None){
+    if(result == NULL){
+        PyErr_Clear();
         return 0;
     }
 
-    has_user = PyDict_Contains(
-                PyDict_GetItemString(dictionary, direction),
-                PyUnicode_FromString(user));
+    value = result == Py_True;
+    Py_DECREF(result);
 
-    Py_XDECREF(dictionary);
-    return has_user;
+    return value;
 }
 
 /**
- * @brief Returns the language stored for a user in the preferences file
+ * @brief Returns the UTF-8 contents of a Python string
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param user Name of the user to look for
- * @param direction Direction to look for the user in ("incoming" or "outgoing")
- * @param key Language to look for ("source" or "target")
- * @return The language if the call was successful, or "None" otherwise
+ * The caller must hold the GIL
+ * @param object A str or unicode object
+ * @return A newly allocated string, which must be freed with g_free(), or NULL if object is not a string
  */
-char* dictionaryGetUserLanguage(const char *user, const char* direction, const char* key){
-    char* user_lang;
-    PyObject *dictionary;
+static char* copyPythonString(PyObject* object){
+    char *copy = NULL;
+    PyObject *bytes;
 
-    if((dictionary = getDictionary()) == Py_None){
-        return "None";
+    if(object == NULL){
+        return NULL;
     }
 
-    user_lang = PyBytes_AsString(PyDict_GetItemString(
-                    PyDict_GetItemString(PyDict_GetItemString(dictionary, direction), user),key));
-
-    Py_XDECREF(dictionary);
-    return user_lang;
-}
-
-/**
- * @brief Creates a new entry in the language pairs dictionary
- *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param user Name of the user to create a new entry for
- * @param direction Direction to create a new entry in ("incoming" or "outgoing")
- * @param source Source language of the language pair
- * @param target Target language of the language pair
- * @return 1 on success, or 0 otherwise
- */
-int dictionarySetUserEntry(const char* user, const char* direction, const char* source, const char* target){
-    PyObject *pFunc, *pArgs, *result;
-
-    if (files_module != NULL) {
-        pFunc = PyObject_GetAttrString(files_module, "setLangPair");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(4);
-
-            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString(direction));
-
-            PyTuple_SetItem(pArgs, 1, PyUnicode_FromString(user));
-
-            PyTuple_SetItem(pArgs, 2, PyBytes_FromString(source));
-
-            PyTuple_SetItem(pArgs, 3, PyBytes_FromString(target));
-
-            result = PyObject_CallObject(pFunc, pArgs);
-
-            if(result != NULL){
-                if(result == Py_True){
-                    Py_XDECREF(result);
-                    Py_XDECREF(pFunc);
-                    Py_XDECREF(pArgs);
-                    return 1;
-                }
-                else{
-                    Py_XDECREF(result);
-                    Py_XDECREF(pFunc);
-                    Py_XDECREF(pArgs);
-                    return 0;
-                }
-            }
-            else{
-                Py_XDECREF(pFunc);
-                Py_XDECREF(pArgs);
-                return 0;
-            }
+    if(PyUnicode_Check(object)){
+        if((bytes = PyUnicode_AsUTF8String(object)) != NULL){
+            copy = g_strdup(PyBytes_AsString(bytes));
+            Py_DECREF(bytes);
         }
         else{
-            return 0;
+            PyErr_Clear();
         }
     }
-    else {
-        notify_error("Module: \'apertiumFiles\' is not loaded");
-        return 0;
+    else if(PyBytes_Check(object)){
+        copy = g_strdup(PyBytes_AsString(object));
     }
-}
 
-/**
- * @brief Removes the specified entry from the dictionary related to the given user
- *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param user Name of the user whose entry will be removed
- * @param entry Name of the entry that will be removed. Must be either 'incoming' or 'outgoing'
- * @return 1 on success, or 0 otherwise
- */
-int dictionaryRemoveUserEntry(const char* user, char* entry){
-    PyObject *pFunc, *pArgs, *result;
-
-    if (files_module != NULL) {
-        pFunc = PyObject_GetAttrString(files_module, "unsetLangPair");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(2);
-
-            PyTuple_SetItem(pArgs, 0, PyUnicode_FromString(entry));
-
-            PyTuple_SetItem(pArgs, 1, PyUnicode_FromString(user));
-
-            result = PyObject_CallObject(pFunc, pArgs);
-
-            if(result != NULL){
-                if(result == Py_True){
-                    Py_XDECREF(result);
-                    Py_XDECREF(pFunc);
-                    Py_XDECREF(pArgs);
-                    return 1;
-                }
-                else{
-                    Py_XDECREF(result);
-                    Py_XDECREF(pFunc);
-                    Py_XDECREF(pArgs);
-                    return 0;
-                }
-            }
-            else{
-                Py_XDECREF(pFunc);
-                Py_XDECREF(pArgs);
-                return 0;
-            }
-        }
-        else{
-            return 0;
-        }
-    }
-    else {
-        notify_error("Module: \'apertiumFiles\' is not loaded");
-        return 0;
-    }
+    return copy;
 }
 
 /**
- * @brief Removes all the entries from the dictionary related to the given user
+ * @brief Loads the apertiumFiles module and has it read the preferences file
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param user Name of the user whose entries will be removed
- * @return 1 on success, or 0 otherwise
+ * The caller must hold the GIL
+ * @param filename Name of the file where earlier versions of the plugin stored their preferences
+ * @return 1 on success, or 0 if the module could not be loaded
  */
-int dictionaryRemoveUserEntries(const char* user){
-    PyObject *dictionary;
+static int loadModules(const char* filename){
+    PyObject *pArg;
+
+    files_module = PyImport_ImportModule("apertiumpluginutils.apertiumFiles");
 
-    if((dictionary = getDictionary()) == Py_None){
+    if (files_module == NULL) {
+        PyErr_Clear();
+        notify_error_popup("Failed to load module: \'apertiumFiles\'");
         return 0;
     }
 
-    if(PyDict_Contains(PyDict_GetItemString(dictionary, "incoming"), PyUnicode_FromString(user))){
-        PyDict_DelItemString(PyDict_GetItemString(dictionary, "incoming"), user);
-    }
+    bindFunctions();
 
-    if(PyDict_Contains(PyDict_GetItemString(dictionary, "outgoing"), PyUnicode_FromString(user))){
-        PyDict_DelItemString(PyDict_GetItemString(dictionary, "outgoing"), user);
+    if(bound_functions[SET_FILE] == NULL || bound_functions[READ_FILE] == NULL){
+        return 0;
     }
 
-    setDictionary(dictionary);
-    Py_XDECREF(dictionary);
+    pArg = PyUnicode_FromString(filename);
+    isTrue(PyObject_CallFunctionObjArgs(bound_functions[SET_FILE], pArg, NULL));
+    Py_XDECREF(pArg);
+
+    isTrue(PyObject_CallFunctionObjArgs(bound_functions[READ_FILE], NULL));
 
     return 1;
 }
 
 /**
- * @brief Retrieves the Python dictionary containing the user-language_pair settings
+ * @brief Adds the user-language_pair bindings of the preferences file to a new preference store
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @return The dictionary (as a PyObject) if the call was successful, or Py_None otherwise
+ * The caller must hold the GIL
+ * @param builder The new preference store
  */
-PyObject* getDictionary(void){
-    PyObject *pFunc, *pArgs, *result;
+static void migrateBindings(preference_store_builder *builder){
+    int i;
+    char *user, *source, *target;
+    Py_ssize_t position;
+    PyObject *pFunc, *dictionary, *entries, *key, *value;
 
-    if (files_module != NULL) {
-        pFunc = PyObject_GetAttrString(files_module, "getDictionary");
+    if((pFunc = boundFunction(GET_DICTIONARY)) == NULL){
+        return;
+    }
 
-        if (pFunc) {
-            pArgs = PyTuple_New(0);
+    if((dictionary = PyObject_CallFunctionObjArgs(pFunc, NULL)) == NULL){
+        PyErr_Clear();
+        return;
+    }
 
-            result = PyObject_CallObject(pFunc, pArgs);
+    for(i=NAME_INCOMING; i<=NAME_OUTGOING; i++){
+        entries = PyDict_Check(dictionary) ? PyDict_GetItem(dictionary, cached_names[i]) : NULL;
+        if(entries == NULL || !PyDict_Check(entries)){
+            continue;
+        }
 
-            if (result != NULL) {
-                return result;
+        position = 0;
+        while(PyDict_Next(entries, &position, &key, &value)){
+            if(!PyDict_Check(value)){
+                continue;
             }
-            else {
-                Py_XDECREF(pFunc);
-                return Py_None;
+
+            user = copyPythonString(key);
+            source = copyPythonString(PyDict_GetItem(value, cached_names[NAME_SOURCE]));
+            target = copyPythonString(PyDict_GetItem(value, cached_names[NAME_TARGET]));
+
+            if(user != NULL && source != NULL && target != NULL){
+                preference_store_builder_add_binding(builder, user,
+                    i == NAME_INCOMING ? PREFERENCE_STORE_INCOMING : PREFERENCE_STORE_OUTGOING, source, target);
             }
+
+            g_free(user);
+            g_free(source);
+            g_free(target);
         }
-        else {
-            return Py_None;
-        }
-        Py_XDECREF(pFunc);
-    }
-    else {
-        notify_error("Module: \'apertiumFiles\' is not loaded");
-        return Py_None;
     }
+
+    Py_DECREF(dictionary);
 }
 
 /**
- * @brief Sets the Python dictionary containing the user-language_pair settings
+ * @brief Adds an integer setting of the preferences file to a new preference store, if it is stored
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param item New dictionary to substitute the old one with
+ * The caller must hold the GIL
+ * @param builder The new preference store
+ * @param name Name of the setting
  */
-void setDictionary(PyObject* item){
-    PyObject *pFunc, *pArgs;
+static void migrateSetting(preference_store_builder *builder, const char* name){
+    long value;
+    PyObject *pName, *result;
 
-    if (files_module != NULL) {
-        pFunc = PyObject_GetAttrString(files_module, "setDictionary");
+    pName = PyUnicode_FromString(name);
+    result = getKey(pName);
+    Py_XDECREF(pName);
 
-        if (pFunc) {
-            pArgs = PyTuple_New(1);
-
-            PyTuple_SetItem(pArgs, 0, item);
+    if(result == NULL){
+        return;
+    }
 
-            PyObject_CallObject(pFunc, pArgs);
-        }
+    value = PyLong_AsLong(result);
+    if(PyErr_Occurred()){
+        PyErr_Clear();
     }
-    else {
-        notify_error("Module: \'apertiumFiles\' is not loaded");
+    else{
+        preference_store_builder_add_int(builder, name, value);
     }
+    Py_DECREF(result);
 }
 
 /**
- * @brief Saves the Python dictionary containing the user-language_pair settings to a file
+ * @brief Adds the APY list and the settings of the preferences file to a new preference store
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
+ * The caller must hold the GIL
+ * @param builder The new preference store
  */
-void saveDictionary(void){
-    PyObject *pFunc, *pArgs;
+static void migrateSettings(preference_store_builder *builder){
+    int i, size;
+    char **list, *key;
+    PyObject *addresses;
 
-    if(getDictionary() != Py_None && getDictionary() != NULL){
-        if (files_module != NULL) {
-            pFunc = PyObject_GetAttrString(files_module, "save");
+    for(i=0; setting_names[i] != NULL; i++){
+        migrateSetting(builder, setting_names[i]);
+    }
+    migrateSetting(builder, cached_name_texts[NAME_DISPLAY_MODE]);
 
-            if (pFunc) {
-                pArgs = PyTuple_New(0);
+    if((addresses = getKey(cached_names[NAME_APY_ADDRESS])) == NULL){
+        return;
+    }
 
-                PyObject_CallObject(pFunc, pArgs);
+    if(PyList_Check(addresses)){
+        size = PyList_GET_SIZE(addresses);
+        list = g_new0(char*, size + 1);
+        for(i=0; i<size; i++){
+            list[i] = copyPythonString(PyList_GetItem(addresses, i));
+            if(list[i] == NULL){
+                list[i] = g_strdup("");
             }
-            else {
-                return;
-            }
-            Py_XDECREF(pFunc);
         }
-        else {
-            notify_error("Module: \'apertiumFiles\' is not loaded");
-            return;
+
+        preference_store_builder_set_apys(builder, list, size);
+
+        for(i=0; i<size; i++){
+            key = g_strdup_printf("apyWeight %s", list[i]);
+            migrateSetting(builder, key);
+            g_free(key);
         }
+
+        g_strfreev(list);
     }
+    Py_DECREF(addresses);
 }
 
 /**
- * @brief Retrieves a list of all the available language pairs
+ * @brief Initializes the Python environment
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded).
- * @param pairList Reference to a 3-level char pointer where the pairs will be stored. <br>
- * Pair 'n' is stored in pairList[n] and its two languages are pairList[n][0] (source) and pairList[n][1] (target). <br>
- * Both pairList[x] and pairList must be freed after its use.
- * @return Number of language pairs if the call was successful, or 0 otherwise<br>
+ * pythonMigratePreferences() requires this to be first called in order to work properly. May be called from any
+ * thread, such as a worker thread so that starting the interpreter does not hold back the main loop
  */
-int getAllPairs(char**** pairList){
-    int i, size;
-    PyObject *pFunc, *pArgs, *result, *list;
-
-    if (iface_module != NULL) {
-        pFunc = PyObject_GetAttrString(iface_module, "getAllPairs");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(0);
-
-            result = PyObject_CallObject(pFunc, pArgs);
-
-            if (result != NULL) {
-                if(PyDict_GetItemString(result,"ok") == Py_True){
-                    list = PyDict_GetItemString(result,"result");
-                    size = PyList_GET_SIZE(list);
-
-                    *pairList = malloc(sizeof(char**)*size);
-                    for(i=0; i<size; i++){
-                        (*pairList)[i] = malloc(sizeof(char*)*2);
-                        (*pairList)[i][0] = PyBytes_AsString(PyList_GetItem(PyList_GetItem(list,i),0));
-                        (*pairList)[i][1] = PyBytes_AsString(PyList_GetItem(PyList_GetItem(list,i),1));
-                    }
-
-                    Py_XDECREF(pFunc);
-                    Py_XDECREF(result);
-                    Py_XDECREF(list);
-                    return size;
-                }
-                else{
-                    notify_error(PyBytes_AsString(PyDict_GetItemString(result,"errorMsg")));
-                    return 0;
-                }
-            }
-            else {
-                Py_XDECREF(pFunc);
-                return 0;
-            }
-        }
-        else {
-            Py_XDECREF(pFunc);
-            return 0;
-        }
-    }
-    else {
-        notify_error("Module: \'apertiumInterfaceAPY\' is not loaded");
-        return 0;
-    }
+void pythonInit(void){
+    Py_SetProgramName(NULL);
+
+    // The signal handlers belong to Pidgin, and Python could only install them from the main thread anyway
+    Py_InitializeEx(0);
+    PyEval_InitThreads();
+
+    // Other threads may need the GIL too, so this thread only takes it while it calls into Python
+    init_thread_state = PyEval_SaveThread();
 }
 
 /**
- * @brief Checks if a given language pair is available
+ * @brief Finalizes the Python environment
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param source String containing the source language
- * @param source String containing the target language
- * @return 1 if the call was successful and the language pair exists, or 0 otherwise
+ * Must be called from the thread that called pythonInit(). No other thread may be calling into Python when this
+ * function is called
  */
-int pairExists(char* source, char* target){
-    PyObject *pFunc, *pArgs, *pArg, *result;
-
-    if (iface_module != NULL) {
-        pFunc = PyObject_GetAttrString(iface_module, "pairExists");
-
-        if (pFunc) {
-            pArgs = PyTuple_New(2);
-
-            pArg = PyBytes_FromString(source);
-            PyTuple_SetItem(pArgs, 0, pArg);
-
-            pArg = PyBytes_FromString(target);
-            PyTuple_SetItem(pArgs, 1, pArg);
-
-            result = PyObject_CallObject(pFunc, pArgs);
-
-            if (result != NULL) {
-                if(PyDict_GetItemString(result,"ok") == Py_True){
-                    Py_XDECREF(pFunc);
-
-                    if(PyDict_GetItemString(result,"result") == Py_True){
-                        return 1;
-                    }
-                    else{
-                        notify_error("Pair does not exist");
-                        return 0;
-                    }
-                }
-                else{
-                    Py_XDECREF(pFunc);
-                    notify_error(PyBytes_AsString(PyDict_GetItemString(result,"errorMsg")));
-                    return 0;
-                }
-            }
-            else {
-                Py_XDECREF(pFunc);
-                return 0;
-            }
-        }
-        else {
-            return 0;
-        }
-    }
-    else {
-        notify_error("Module: \'apertiumInterfaceAPY\' is not loaded");
-        return 0;
-    }
+void pythonFinalize(void){
+    PyEval_RestoreThread(init_thread_state);
+    init_thread_state = NULL;
+    Py_Finalize();
 }
 
 /**
- * @brief Translates a given text
+ * @brief Converts the preferences stored by earlier versions of the plugin into a preference store
  *
- * pythonInit() must have been called before or an error will occur (the module is not loaded)
- * @param text String containing the text to be translated
- * @param source String containing the source language to translate the text from
- * @param target String containing the target language to translate the text to
- * @return A string containing the translated text if the call was successful, or NULL otherwise
+ * The bindings, the APY list, the display mode and the integer settings are read with the apertiumFiles module.
+ * If there is no preferences file or the module cannot be loaded, an empty store is written, so that the conversion
+ * is not tried again on every start.
+ * May be called from any thread, as it acquires the GIL while it runs
+ * @param filename Name of the file where earlier versions of the plugin stored their preferences
+ * @param store_filename Name of the preference store to write
+ * @return 1 if the store was written, or 0 otherwise
  */
-char* translate(char* text, char* source, char* target){
-    char* translation;
-    PyObject *pFunc, *pArgs, *pArg, *result;
-
-    if (iface_module != NULL) {
-        pFunc = PyObject_GetAttrString(iface_module, "translate");
+int pythonMigratePreferences(const char* filename, const char* store_filename){
+    int saved;
+    preference_store_builder *builder;
+    PyGILState_STATE gil_state = PyGILState_Ensure();
 
-        if (pFunc) {
-            pArgs = PyTuple_New(3);
+    builder = preference_store_builder_new();
 
-            pArg = PyBytes_FromString(text);
-            PyTuple_SetItem(pArgs, 0, pArg);
-
-            PyTuple_SetItem(pArgs, 1, PyBytes_FromString(source));
+    if(loadModules(filename)){
+        migrateBindings(builder);
+        migrateSettings(builder);
+    }
 
-            PyTuple_SetItem(pArgs, 2, PyBytes_FromString(target));
+    releaseFunctions();
 
-            result = PyObject_CallObject(pFunc, pArgs);
+    // Writing the store does not use Python, so other threads may take the GIL in the meantime
+    Py_BEGIN_ALLOW_THREADS
+    saved = preference_store_builder_save(builder, store_filename);
+    Py_END_ALLOW_THREADS
 
-            if (result != NULL) {
-                Py_XDECREF(pFunc);
-                if(PyDict_GetItemString(result,"ok") == Py_True){
-                    translation = PyBytes_AsString(PyDict_GetItemString(result,"result"));
-                    Py_XDECREF(result);
+    preference_store_builder_free(builder);
 
-                    return translation;
-                }
-                else{
-                    notify_error(PyBytes_AsString(PyDict_GetItemString(result,"errorMsg")));
-                    return NULL;
-                }
-            }
-            else {
-                Py_XDECREF(pFunc);
-                notify_error("There was an error in the translate call");
-                return NULL;
-            }
-        }
-        else {
-            return NULL;
-        }
-    }
-    else {
-        notify_error("Module: \'apertiumInterfaceAPY\' is not loaded");
-        return NULL;
-    }
+    PyGILState_Release(gil_state);
+    return saved;
 }
@@ -0,0 +1,363 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file retry_queue.c
+ * @brief Messages whose translation failed, kept to be translated again once an APY answers
+ *
+ * The queue is written to the retry file on every change, so the messages survive restarts. Retries back off
+ * exponentially, from RETRY_QUEUE_MIN_DELAY to RETRY_QUEUE_MAX_DELAY seconds, while they keep failing.
+ * All the functions in this file must be called from the main loop
+ */
+
+#include "retry_queue.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/**
+ * @brief The retry_entries, in the order they are retried
+ *
+ * New messages are added at the tail, and a message whose retry fails goes back to the tail too
+ */
+static GQueue entries = G_QUEUE_INIT;
+
+/**
+ * @brief The message being retried, or NULL if there is none
+ *
+ * It is still written to the retry file, so it is not lost if the plugin stops before the retry finishes
+ */
+static retry_entry *taken = NULL;
+
+/**
+ * @brief Name of the retry file
+ */
+static char *retry_file = NULL;
+
+/**
+ * @brief Seconds to wait before the next retry. 0 if the last one succeeded
+ */
+static guint delay = 0;
+
+/**
+ * @brief Frees a retry entry
+ *
+ * @param entry The entry
+ */
+static void retry_entry_free(retry_entry *entry){
+    g_free(entry->account);
+    g_free(entry->protocol);
+    g_free(entry->name);
+    g_free(entry->source);
+    g_free(entry->target);
+    g_free(entry->text);
+    g_free(entry);
+}
+
+/**
+ * @brief Writes a message to a group of the retry file
+ *
+ * @param file The retry file
+ * @param group Number of the group
+ * @param entry The message
+ */
+static void save_entry(GKeyFile *file, int group, retry_entry *entry){
+    char *name;
+
+    name = g_strdup_printf("Message %d", group);
+
+    g_key_file_set_string(file, name, "account", entry->account);
+    g_key_file_set_string(file, name, "protocol", entry->protocol);
+    g_key_file_set_string(file, name, "name", entry->name);
+    g_key_file_set_string(file, name, "direction", entry->outgoing ? "outgoing" : "incoming");
+    g_key_file_set_string(file, name, "source", entry->source);
+    g_key_file_set_string(file, name, "target", entry->target);
+    g_key_file_set_string(file, name, "text", entry->text);
+    g_key_file_set_int64(file, name, "queued", entry->queued);
+
+    g_free(name);
+}
+
+/**
+ * @brief Writes the queue to the retry file
+ *
+ * Each message is stored in its own group, in the order of the queue, after the message being retried
+ */
+static void save_entries(void){
+    int fd, group = 0, written;
+    char *data, *temp;
+    gsize length;
+    GKeyFile *file;
+    GList *link;
+
+    if(retry_file == NULL){
+        return;
+    }
+
+    file = g_key_file_new();
+
+    if(taken != NULL){
+        save_entry(file, group++, taken);
+    }
+
+    for(link = entries.head; link != NULL; link = link->next){
+        save_entry(file, group++, link->data);
+    }
+
+    data = g_key_file_to_data(file, &length, NULL);
+
+    // The file holds the text of the messages, so only the user may read it. It is written aside and renamed,
+    // so that a crash never leaves it half written
+    temp = g_strconcat(retry_file, ".tmp", NULL);
+    unlink(temp);
+    if((fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0600)) >= 0){
+        written = write(fd, data, length) == (gssize)length && fsync(fd) == 0;
+        written = close(fd) == 0 && written;
+        if(!written || rename(temp, retry_file) != 0){
+            unlink(temp);
+        }
+    }
+
+    g_free(temp);
+    g_free(data);
+    g_key_file_free(file);
+}
+
+/**
+ * @brief Reads the messages stored in the retry file
+ *
+ * Groups that are incomplete are skipped
+ */
+static void load_entries(void){
+    gsize i, groups_length;
+    char **groups, *direction;
+    GKeyFile *file;
+    retry_entry *entry;
+
+    file = g_key_file_new();
+
+    if(!g_key_file_load_from_file(file, retry_file, G_KEY_FILE_NONE, NULL)){
+        g_key_file_free(file);
+        return;
+    }
+
+    groups = g_key_file_get_groups(file, &groups_length);
+
+    for(i=0; i<groups_length; i++){
+        entry = g_new0(retry_entry, 1);
+        entry->account = g_key_file_get_string(file, groups[i], "account", NULL);
+        entry->protocol = g_key_file_get_string(file, groups[i], "protocol", NULL);
+        entry->name = g_key_file_get_string(file, groups[i], "name", NULL);
+        entry->source = g_key_file_get_string(file, groups[i], "source", NULL);
+        entry->target = g_key_file_get_string(file, groups[i], "target", NULL);
+        entry->text = g_key_file_get_string(file, groups[i], "text", NULL);
+        entry->queued = g_key_file_get_int64(file, groups[i], "queued", NULL);
+
+        direction = g_key_file_get_string(file, groups[i], "direction", NULL);
+        entry->outgoing = direction != NULL && !g_strcmp0(direction, "outgoing");
+
+        if(entry->account != NULL && entry->protocol != NULL && entry->name != NULL && direction != NULL &&
+           entry->source != NULL && entry->target != NULL && entry->text != NULL){
+            g_queue_push_tail(&entries, entry);
+        }
+        else{
+            retry_entry_free(entry);
+        }
+
+        g_free(direction);
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(file);
+}
+
+/**
+ * @brief Drops the messages that have been retried for longer than RETRY_QUEUE_MAX_AGE
+ *
+ * @return 1 if any message was dropped, or 0 otherwise
+ */
+static int drop_expired(void){
+    int dropped = 0;
+    gint64 oldest;
+    GList *link, *next;
+
+    oldest = g_get_real_time() / G_USEC_PER_SEC - RETRY_QUEUE_MAX_AGE;
+
+    for(link = entries.head; link != NULL; link = next){
+        next = link->next;
+        if(((retry_entry*)link->data)->queued < oldest){
+            retry_entry_free(link->data);
+            g_queue_delete_link(&entries, link);
+            dropped = 1;
+        }
+    }
+
+    return dropped;
+}
+
+/**
+ * @brief Creates the queue and fills it with the messages stored in the retry file
+ *
+ * Must be called before any other function in this file
+ * @param filename Name of the retry file
+ */
+void retry_queue_init(const char *filename){
+    retry_file = g_strdup(filename);
+    load_entries();
+
+    if(drop_expired()){
+        save_entries();
+    }
+
+    // Messages left by the previous session are retried soon after starting
+    delay = g_queue_is_empty(&entries) ? 0 : RETRY_QUEUE_MIN_DELAY;
+}
+
+/**
+ * @brief Adds a message whose translation failed to the end of the queue
+ *
+ * The message at the head of the queue is dropped if the queue is full
+ * @param account Username of the account the message was sent or received on
+ * @param protocol Protocol ID of the account
+ * @param name Username of the buddy the message was sent to or received from
+ * @param outgoing 1 for messages sent by the user, 0 for received ones
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param text The message as it was written
+ */
+void retry_queue_add(const char *account, const char *protocol, const char *name, int outgoing,
+                     const char *source, const char *target, const char *text){
+    retry_entry *entry = g_new(retry_entry, 1);
+
+    entry->account = g_strdup(account);
+    entry->protocol = g_strdup(protocol);
+    entry->name = g_strdup(name);
+    entry->outgoing = outgoing;
+    entry->source = g_strdup(source);
+    entry->target = g_strdup(target);
+    entry->text = g_strdup(text);
+    entry->queued = g_get_real_time() / G_USEC_PER_SEC;
+
+    g_queue_push_tail(&entries, entry);
+
+    while(g_queue_get_length(&entries) > RETRY_QUEUE_MAX_ENTRIES){
+        retry_entry_free(g_queue_pop_head(&entries));
+    }
+
+    // The translation has just failed, so the next retry waits at least RETRY_QUEUE_MIN_DELAY
+    if(delay == 0){
+        delay = RETRY_QUEUE_MIN_DELAY;
+    }
+
+    save_entries();
+}
+
+/**
+ * @brief Takes the message at the head of the queue, to retry its translation
+ *
+ * Messages older than RETRY_QUEUE_MAX_AGE are dropped first. Only one message may be retried at a time
+ * @return The message, which stays owned by the queue until retry_queue_finish() is called,
+ * or NULL if the queue is empty or a message is already being retried
+ */
+retry_entry* retry_queue_take(void){
+    if(taken != NULL){
+        return NULL;
+    }
+
+    if(drop_expired()){
+        save_entries();
+    }
+
+    taken = g_queue_pop_head(&entries);
+    return taken;
+}
+
+/**
+ * @brief Finishes the retry of the message returned by retry_queue_take()
+ *
+ * @param translated 1 if the message was translated, so that it is removed from the queue, or 0 if it must be
+ * retried again, in which case it goes to the tail of the queue so that a message that keeps failing, such as
+ * one of an account that is not connected, does not hold back the others
+ */
+void retry_queue_finish(int translated){
+    if(taken == NULL){
+        return;
+    }
+
+    if(translated){
+        retry_entry_free(taken);
+    }
+    else{
+        g_queue_push_tail(&entries, taken);
+    }
+    taken = NULL;
+
+    save_entries();
+}
+
+/**
+ * @brief Retrieves the number of messages waiting to be retried
+ *
+ * @return The number of messages in the queue
+ */
+guint retry_queue_length(void){
+    return g_queue_get_length(&entries) + (taken != NULL);
+}
+
+/**
+ * @brief Retrieves how long to wait before the next retry
+ *
+ * @return The number of seconds to wait. 0 means the next message can be retried at once
+ */
+guint retry_queue_delay(void){
+    return delay;
+}
+
+/**
+ * @brief Doubles the wait before the next retry, up to RETRY_QUEUE_MAX_DELAY seconds
+ */
+void retry_queue_failed(void){
+    delay = delay == 0 ? RETRY_QUEUE_MIN_DELAY : MIN(delay * 2, RETRY_QUEUE_MAX_DELAY);
+}
+
+/**
+ * @brief Lets the next retry happen at once, as the APYs are answering again
+ */
+void retry_queue_succeeded(void){
+    delay = 0;
+}
+
+/**
+ * @brief Writes the queue to the retry file and frees it
+ */
+void retry_queue_shutdown(void){
+    save_entries();
+
+    if(taken != NULL){
+        retry_entry_free(taken);
+        taken = NULL;
+    }
+
+    while(!g_queue_is_empty(&entries)){
+        retry_entry_free(g_queue_pop_head(&entries));
+    }
+
+    g_free(retry_file);
+    retry_file = NULL;
+}
@@ -0,0 +1,366 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file translation_cache.c
+ * @brief Bounded cache of the latest translations, so that repeated messages are not requested again
+ *
+ * The least recently used translations are evicted first. Translations are also written to the cache file
+ * (see disk_cache.c), which is looked up when a translation is not in memory.
+ * All the functions in this file may be called from any thread
+ */
+
+#include "translation_cache.h"
+#include "disk_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief A cached translation
+ */
+typedef struct {
+    /** Key the translation is stored under */
+    char *key;
+    /** The translated text */
+    char *translation;
+    /** Bytes accounted for this entry */
+    gsize size;
+    /** Link of the entry in lru_queue */
+    GList *link;
+} cache_entry;
+
+/**
+ * @brief Cached translations by key
+ *
+ * Protected by cache_mutex
+ */
+static GHashTable *entries = NULL;
+
+/**
+ * @brief Cached translations, the most recently used at the head
+ *
+ * Protected by cache_mutex
+ */
+static GQueue lru_queue = G_QUEUE_INIT;
+
+/**
+ * @brief Usage figures and limits of the cache
+ *
+ * Protected by cache_mutex
+ */
+static translation_cache_stats stats;
+
+/**
+ * @brief Mutex protecting every variable in this file
+ */
+static GMutex cache_mutex;
+
+/**
+ * @brief Builds the key a translation is stored under
+ *
+ * Leading and trailing whitespace is dropped and inner runs of whitespace are collapsed into a single space,
+ * so that texts differing only in spacing share their translation
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param text The text to be translated
+ * @return The key, which must be freed with g_free()
+ */
+static char* build_key(const char *source, const char *target, const char *text){
+    GString *key;
+    int space = 0;
+
+    key = g_string_new(NULL);
+    g_string_append_printf(key, "%s\t%s\t", source, target);
+
+    while(g_ascii_isspace(*text)){
+        text++;
+    }
+
+    for(; *text != '\0'; text++){
+        if(g_ascii_isspace(*text)){
+            space = 1;
+        }
+        else{
+            if(space){
+                g_string_append_c(key, ' ');
+                space = 0;
+            }
+            g_string_append_c(key, *text);
+        }
+    }
+
+    return g_string_free(key, FALSE);
+}
+
+/**
+ * @brief Frees a cache entry
+ *
+ * Used as the value destroy function of the entries table
+ * @param data The cache_entry
+ */
+static void free_entry(gpointer data){
+    cache_entry *entry = data;
+
+    g_free(entry->key);
+    g_free(entry->translation);
+    g_free(entry);
+}
+
+/**
+ * @brief Removes an entry from the cache
+ *
+ * The caller must hold cache_mutex
+ * @param entry The entry to remove
+ */
+static void remove_entry(cache_entry *entry){
+    g_queue_delete_link(&lru_queue, entry->link);
+    stats.entries--;
+    stats.bytes -= entry->size;
+
+    g_hash_table_remove(entries, entry->key);
+}
+
+/**
+ * @brief Evicts the least recently used entries until the cache is within its limits
+ *
+ * The caller must hold cache_mutex
+ */
+static void enforce_limits(void){
+    while(stats.entries > 0 && (stats.entries > stats.max_entries || stats.bytes > stats.max_bytes)){
+        remove_entry(g_queue_peek_tail(&lru_queue));
+    }
+}
+
+/**
+ * @brief Checks whether the cache is enabled
+ *
+ * The caller must hold cache_mutex
+ * @return 1 if translations are cached, or 0 if either limit is 0
+ */
+static int cache_enabled(void){
+    return stats.max_entries > 0 && stats.max_bytes > 0;
+}
+
+/**
+ * @brief Creates the cache
+ *
+ * Must be called before any other function in this file
+ * @param max_entries Maximum number of translations kept. 0 disables the cache
+ * @param max_bytes Maximum size, in bytes, of the translations kept. 0 disables the cache
+ */
+void translation_cache_init(guint max_entries, gsize max_bytes){
+    entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_entry);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.max_entries = max_entries;
+    stats.max_bytes = max_bytes;
+}
+
+/**
+ * @brief Adds a translation to the memory cache, evicting the least recently used ones if needed
+ *
+ * The caller must hold cache_mutex
+ * @param key Key the translation is stored under. It is owned by the cache afterwards
+ * @param translation The translation
+ */
+static void insert_entry(char *key, const char *translation){
+    gsize size;
+    cache_entry *entry;
+
+    size = sizeof(cache_entry) + strlen(key) + strlen(translation) + 2;
+
+    if(entries == NULL || !cache_enabled() || size > stats.max_bytes){
+        g_free(key);
+        return;
+    }
+
+    if((entry = g_hash_table_lookup(entries, key)) != NULL){
+        remove_entry(entry);
+    }
+
+    entry = g_new(cache_entry, 1);
+    entry->key = key;
+    entry->translation = g_strdup(translation);
+    entry->size = size;
+
+    g_queue_push_head(&lru_queue, entry);
+    entry->link = g_queue_peek_head_link(&lru_queue);
+    g_hash_table_insert(entries, entry->key, entry);
+
+    stats.entries++;
+    stats.bytes += size;
+
+    enforce_limits();
+}
+
+/**
+ * @brief Stores the translation of a text in memory and in the cache file
+ *
+ * Nothing is stored while the cache is disabled
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param text The text that was translated
+ * @param translation Its translation
+ */
+void translation_cache_store(const char *source, const char *target, const char *text, const char *translation){
+    char *key;
+    int enabled;
+
+    g_mutex_lock(&cache_mutex);
+    enabled = cache_enabled();
+    g_mutex_unlock(&cache_mutex);
+
+    if(!enabled){
+        return;
+    }
+
+    key = build_key(source, target, text);
+
+    disk_cache_store(key, translation);
+
+    g_mutex_lock(&cache_mutex);
+    insert_entry(key, translation);
+    g_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * @brief Looks up the translation of a text, first in memory and then in the cache file
+ *
+ * A translation found becomes the most recently used one. The cache file is not read while the cache is disabled
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param text The text to be translated
+ * @return A newly allocated string containing the cached translation, or NULL if there is none.
+ * The returned string must be freed after its use
+ */
+char* translation_cache_lookup(const char *source, const char *target, const char *text){
+    char *key, *stored = NULL, *translation = NULL;
+    int enabled;
+    cache_entry *entry;
+
+    key = build_key(source, target, text);
+
+    g_mutex_lock(&cache_mutex);
+
+    if(entries != NULL && (entry = g_hash_table_lookup(entries, key)) != NULL){
+        g_queue_unlink(&lru_queue, entry->link);
+        g_queue_push_head_link(&lru_queue, entry->link);
+
+        translation = malloc(sizeof(char)*(strlen(entry->translation)+1));
+        sprintf(translation,"%s",entry->translation);
+        stats.hits++;
+    }
+
+    enabled = cache_enabled();
+
+    g_mutex_unlock(&cache_mutex);
+
+    if(translation != NULL){
+        g_free(key);
+        return translation;
+    }
+
+    // The cache file is read without holding the mutex, as it does not need it
+    if(enabled){
+        stored = disk_cache_lookup(key);
+    }
+
+    g_mutex_lock(&cache_mutex);
+
+    if(stored != NULL){
+        translation = malloc(sizeof(char)*(strlen(stored)+1));
+        sprintf(translation,"%s",stored);
+        stats.disk_hits++;
+
+        insert_entry(key, stored);
+        key = NULL;
+    }
+    else{
+        stats.misses++;
+    }
+
+    g_mutex_unlock(&cache_mutex);
+
+    g_free(stored);
+    g_free(key);
+    return translation;
+}
+
+/**
+ * @brief Changes the limits of the cache
+ *
+ * The least recently used translations are evicted if the cache no longer fits
+ * @param max_entries Maximum number of translations kept. 0 disables the cache
+ * @param max_bytes Maximum size, in bytes, of the translations kept. 0 disables the cache
+ */
+void translation_cache_set_limits(guint max_entries, gsize max_bytes){
+    g_mutex_lock(&cache_mutex);
+
+    stats.max_entries = max_entries;
+    stats.max_bytes = max_bytes;
+    enforce_limits();
+
+    g_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * @brief Retrieves the usage figures of the cache
+ *
+ * @param result Reference to where the figures will be stored
+ */
+void translation_cache_get_stats(translation_cache_stats *result){
+    g_mutex_lock(&cache_mutex);
+    *result = stats;
+    g_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * @brief Removes every translation from memory and from the cache file and resets the counters
+ */
+void translation_cache_clear(void){
+    disk_cache_clear();
+
+    g_mutex_lock(&cache_mutex);
+
+    g_queue_clear(&lru_queue);
+    if(entries != NULL){
+        g_hash_table_remove_all(entries);
+    }
+
+    stats.entries = 0;
+    stats.bytes = 0;
+    stats.hits = 0;
+    stats.disk_hits = 0;
+    stats.misses = 0;
+
+    g_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * @brief Frees the memory cache
+ *
+ * The cache file is left untouched. No other thread may be using the cache when this function is called
+ */
+void translation_cache_shutdown(void){
+    g_queue_clear(&lru_queue);
+
+    g_hash_table_destroy(entries);
+    entries = NULL;
+}
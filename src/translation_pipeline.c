@@ -0,0 +1,562 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file translation_pipeline.c
+ * @brief Functions to translate texts on worker threads without blocking the main loop
+ *
+ * Texts of the same language pair submitted within a short window are gathered in a batch and sent to the APY
+ * with a single request (see translateBatch()), which saves most of the per-request overhead when messages
+ * arrive in bursts. The messages the user sends are requested at once instead.<br>
+ * Texts submitted while an identical request (same text and language pair) is still in flight are not requested
+ * again: they wait for the result of the first one.<br>
+ * Drafts (see draft_translation.c) are translated on their own, and their translations are neither cached nor
+ * reported if they fail, unless a message with the same text waits for them
+ */
+
+#include "apy_client.h"
+#include "translation_cache.h"
+#include "translation_pipeline.h"
+#include "worker_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Maximum number of translations requested to the APYs at the same time
+ */
+#define TRANSLATION_WORKERS 4
+
+/**
+ * @brief Someone else waiting for the result of a translation_job
+ */
+typedef struct {
+    /** Function called on the main loop with the result */
+    translation_ready_func ready;
+    /** Data passed to ready */
+    gpointer data;
+} translation_waiter;
+
+/**
+ * @brief A translation request travelling through the pipeline
+ */
+typedef struct {
+    /** Key of the job in in_flight */
+    char *key;
+    /** Text to be translated */
+    char *text;
+    /** Source language of the language pair */
+    char *source;
+    /** Target language of the language pair */
+    char *target;
+    /** Translated text, or NULL if the translation failed */
+    char *translation;
+    /** Function called on the main loop with the result */
+    translation_ready_func ready;
+    /** Data passed to ready */
+    gpointer data;
+    /** The translation_waiters that submitted the same text and language pair later, or NULL if there are none */
+    GSList *waiters;
+    /** Class of worker task the job is run as, one of worker_priority */
+    int priority;
+    /** Data the job was handed to the workers with (the job itself or its translation_batch), or NULL while it is
+     * still gathering texts in a batch */
+    gpointer task;
+    /** 1 while only drafts wait for the job, or 0 otherwise. Accessed atomically */
+    gint draft;
+    /** 1 if the job was translated as a draft, so that its translation was neither cached nor reported */
+    int quiet;
+} translation_job;
+
+/**
+ * @brief Translation requests of the same language pair sent to the APY together
+ */
+typedef struct {
+    /** Key of the batch in open_batches */
+    char *key;
+    /** Source language of the language pair */
+    char *source;
+    /** Target language of the language pair */
+    char *target;
+    /** The translation_jobs of the batch, in the order they were submitted */
+    GPtrArray *jobs;
+    /** Sum of the lengths of the texts of the batch */
+    gsize bytes;
+    /** ID of the timeout source that will send the batch, or 0 if there is none */
+    guint timer;
+    /** Most urgent class of worker task among the jobs of the batch, one of worker_priority */
+    int priority;
+} translation_batch;
+
+/**
+ * @brief Batches still gathering texts, by "source\ttarget"
+ *
+ * Only used from the main loop
+ */
+static GHashTable *open_batches = NULL;
+
+/**
+ * @brief Jobs whose result has not been handed back yet, by "source\ttarget\ttext"
+ *
+ * Only used from the main loop
+ */
+static GHashTable *in_flight = NULL;
+
+/**
+ * @brief Limits of the batches
+ *
+ * Only used from the main loop
+ */
+static translation_batching batching = {
+    TRANSLATION_BATCH_DEFAULT_WINDOW, TRANSLATION_BATCH_DEFAULT_TEXTS, TRANSLATION_BATCH_DEFAULT_BYTES
+};
+
+/**
+ * @brief Requests the translation of a job to the APY and caches it
+ *
+ * The translation of a draft is not cached, and the user is not told if it fails. Runs on a worker thread
+ * @param data The translation_job to translate
+ */
+static void translation_job_run(gpointer data){
+    translation_job *job = data;
+
+    if((job->quiet = g_atomic_int_get(&job->draft))){
+        job->translation = translateQuietly(job->text, job->source, job->target);
+    }
+    else{
+        job->translation = translate(job->text, job->source, job->target);
+    }
+
+    if(job->translation != NULL && !job->quiet){
+        translation_cache_store(job->source, job->target, job->text, job->translation);
+    }
+}
+
+/**
+ * @brief Hands the result of a job back to whoever submitted it and to everyone waiting for it
+ *
+ * Runs on the main loop. The ownership of the translation is passed on to the ready function of the job,
+ * and each waiter receives a copy of it
+ * @param data The finished translation_job
+ */
+static void translation_job_done(gpointer data){
+    translation_job *job = data;
+    translation_waiter *waiter;
+    GSList *link;
+    char *copy;
+
+    if(in_flight != NULL){
+        g_hash_table_remove(in_flight, job->key);
+    }
+
+    // A message joined the draft while it was being translated, so the translation is no longer a draft
+    if(job->quiet && job->translation != NULL && !g_atomic_int_get(&job->draft)){
+        translation_cache_store(job->source, job->target, job->text, job->translation);
+    }
+
+    for(link = job->waiters; link != NULL; link = link->next){
+        waiter = link->data;
+        copy = NULL;
+
+        if(job->translation != NULL){
+            copy = malloc(sizeof(char)*(strlen(job->translation)+1));
+            sprintf(copy,"%s",job->translation);
+        }
+
+        waiter->ready(copy, waiter->data);
+        g_free(waiter);
+    }
+    g_slist_free(job->waiters);
+
+    job->ready(job->translation, job->data);
+
+    g_free(job->key);
+    g_free(job->text);
+    g_free(job->source);
+    g_free(job->target);
+    g_free(job);
+}
+
+/**
+ * @brief Requests the translation of every job of a batch to the APY and caches them
+ *
+ * The texts are translated one by one if the APY answer cannot be split back into the individual translations.
+ * Runs on a worker thread
+ * @param data The translation_batch to translate
+ */
+static void translation_batch_run(gpointer data){
+    translation_batch *batch = data;
+    translation_job *job;
+    char **texts, **translations;
+    guint i;
+    int result;
+
+    texts = g_new(char*, batch->jobs->len);
+    translations = g_new0(char*, batch->jobs->len);
+
+    for(i=0; i<batch->jobs->len; i++){
+        texts[i] = ((translation_job*)g_ptr_array_index(batch->jobs, i))->text;
+    }
+
+    result = translateBatch(texts, batch->jobs->len, batch->source, batch->target, translations);
+
+    for(i=0; i<batch->jobs->len; i++){
+        job = g_ptr_array_index(batch->jobs, i);
+
+        if(result > 0){
+            job->translation = translations[i];
+            translation_cache_store(job->source, job->target, job->text, job->translation);
+        }
+        else if(result == 0){
+            translation_job_run(job);
+        }
+    }
+
+    g_free(translations);
+    g_free(texts);
+}
+
+/**
+ * @brief Hands the results of every job of a batch back to whoever submitted them, and frees the batch
+ *
+ * Runs on the main loop
+ * @param data The finished translation_batch
+ */
+static void translation_batch_done(gpointer data){
+    translation_batch *batch = data;
+    guint i;
+
+    for(i=0; i<batch->jobs->len; i++){
+        translation_job_done(g_ptr_array_index(batch->jobs, i));
+    }
+
+    g_ptr_array_free(batch->jobs, TRUE);
+    g_free(batch->key);
+    g_free(batch->source);
+    g_free(batch->target);
+    g_free(batch);
+}
+
+/**
+ * @brief Stops a batch from gathering texts and hands it to the workers
+ *
+ * A batch with a single job is sent as a plain translation request
+ * @param batch The batch
+ */
+static void send_batch(translation_batch *batch){
+    translation_job *job;
+    guint i;
+
+    g_hash_table_remove(open_batches, batch->key);
+
+    if(batch->timer != 0){
+        g_source_remove(batch->timer);
+        batch->timer = 0;
+    }
+
+    if(batch->jobs->len == 1){
+        job = g_ptr_array_index(batch->jobs, 0);
+        job->task = job;
+        worker_pool_push(batch->priority, translation_job_run, translation_job_done, job);
+        g_ptr_array_set_size(batch->jobs, 0);
+        translation_batch_done(batch);
+    }
+    else{
+        for(i=0; i<batch->jobs->len; i++){
+            ((translation_job*)g_ptr_array_index(batch->jobs, i))->task = batch;
+        }
+        worker_pool_push(batch->priority, translation_batch_run, translation_batch_done, batch);
+    }
+}
+
+/**
+ * @brief Sends a batch once its window is over
+ *
+ * @param data The translation_batch
+ * @return FALSE, so that the timeout source is removed
+ */
+static gboolean batch_window_over(gpointer data){
+    translation_batch *batch = data;
+
+    batch->timer = 0;
+    send_batch(batch);
+
+    return FALSE;
+}
+
+/**
+ * @brief Sends every batch still gathering texts
+ */
+static void send_open_batches(void){
+    GList *batches, *link;
+
+    batches = g_hash_table_get_values(open_batches);
+
+    for(link = batches; link != NULL; link = link->next){
+        send_batch(link->data);
+    }
+
+    g_list_free(batches);
+}
+
+/**
+ * @brief Makes a job as urgent as a new waiter for its result
+ *
+ * A job still gathering texts in a batch raises its batch, which is sent at once for the messages the user sends.
+ * A job already handed to the workers is moved to the more urgent class if it has not started yet
+ * @param job The job
+ * @param priority Class of worker task of the waiter, one of worker_priority
+ */
+static void raise_priority(translation_job *job, int priority){
+    guint i;
+    char *key;
+    translation_batch *batch;
+
+    if(priority >= job->priority){
+        return;
+    }
+
+    job->priority = priority;
+
+    if(job->task == NULL){
+        key = g_strdup_printf("%s\t%s", job->source, job->target);
+        batch = g_hash_table_lookup(open_batches, key);
+        g_free(key);
+
+        if(batch != NULL){
+            batch->priority = MIN(batch->priority, priority);
+            if(priority == WORKER_PRIORITY_OUTGOING){
+                send_batch(batch);
+            }
+        }
+        return;
+    }
+
+    if(job->task != job){
+        batch = job->task;
+        batch->priority = MIN(batch->priority, priority);
+        for(i=0; i<batch->jobs->len; i++){
+            ((translation_job*)g_ptr_array_index(batch->jobs, i))->priority = batch->priority;
+        }
+    }
+
+    worker_pool_raise(job->task, priority);
+}
+
+/**
+ * @brief Starts the worker threads used to translate
+ *
+ * Must be called from the main loop thread before any other function in this file
+ */
+void translation_pipeline_init(void){
+    open_batches = g_hash_table_new(g_str_hash, g_str_equal);
+    in_flight = g_hash_table_new(g_str_hash, g_str_equal);
+    worker_pool_init(TRANSLATION_WORKERS);
+}
+
+/**
+ * @brief Makes a caller wait for the result of the job already translating the same text with the same language pair
+ *
+ * @param text String containing the text to be translated
+ * @param source String containing the source language to translate the text from
+ * @param target String containing the target language to translate the text to
+ * @param ready Function to call with the result
+ * @param data Additional data passed to ready
+ * @return The job, or NULL if there is none, in which case nothing is done
+ */
+static translation_job* join_job(const char *text, const char *source, const char *target,
+                                 translation_ready_func ready, gpointer data){
+    char *key;
+    translation_waiter *waiter;
+    translation_job *job;
+
+    key = g_strdup_printf("%s\t%s\t%s", source, target, text);
+    job = g_hash_table_lookup(in_flight, key);
+    g_free(key);
+
+    if(job != NULL){
+        waiter = g_new(translation_waiter, 1);
+        waiter->ready = ready;
+        waiter->data = data;
+        job->waiters = g_slist_append(job->waiters, waiter);
+    }
+
+    return job;
+}
+
+/**
+ * @brief Creates a job and marks it as in flight
+ *
+ * @param text String containing the text to be translated
+ * @param source String containing the source language to translate the text from
+ * @param target String containing the target language to translate the text to
+ * @param priority How urgent the translation is, one of worker_priority
+ * @param ready Function to call with the result
+ * @param data Additional data passed to ready
+ * @return The job, which has not been handed to the workers yet
+ */
+static translation_job* create_job(const char *text, const char *source, const char *target, int priority,
+                                   translation_ready_func ready, gpointer data){
+    translation_job *job;
+
+    job = g_new0(translation_job, 1);
+    job->key = g_strdup_printf("%s\t%s\t%s", source, target, text);
+    g_hash_table_insert(in_flight, job->key, job);
+
+    job->text = g_strdup(text);
+    job->source = g_strdup(source);
+    job->target = g_strdup(target);
+    job->ready = ready;
+    job->data = data;
+    job->priority = priority;
+
+    return job;
+}
+
+/**
+ * @brief Queues a text to be translated in the background
+ *
+ * The function returns immediately. Once the translation is available (or has failed), ready is called
+ * on the main loop with a newly allocated string containing the translation (or NULL), which must be freed.
+ * The text waits for other texts of the same language pair for up to the batching window, unless it is the
+ * translation of a message the user sends. If the same text is
+ * already being translated with the same language pair, no new request is made and ready is called with
+ * a copy of its result
+ * @param text String containing the text to be translated
+ * @param source String containing the source language to translate the text from
+ * @param target String containing the target language to translate the text to
+ * @param priority How urgent the translation is, one of worker_priority
+ * @param ready Function to call with the result
+ * @param data Additional data passed to ready
+ */
+void translation_pipeline_submit(const char *text, const char *source, const char *target, int priority,
+                                 translation_ready_func ready, gpointer data){
+    char *key;
+    translation_batch *batch;
+    translation_job *job;
+
+    if((job = join_job(text, source, target, ready, data)) != NULL){
+        g_atomic_int_set(&job->draft, 0);
+        raise_priority(job, priority);
+        return;
+    }
+
+    job = create_job(text, source, target, priority, ready, data);
+
+    // The messages the user sends never wait for the batching window
+    if(batching.window == 0 || batching.texts <= 1 || priority == WORKER_PRIORITY_OUTGOING){
+        job->task = job;
+        worker_pool_push(priority, translation_job_run, translation_job_done, job);
+        return;
+    }
+
+    key = g_strdup_printf("%s\t%s", source, target);
+
+    if((batch = g_hash_table_lookup(open_batches, key)) == NULL){
+        batch = g_new0(translation_batch, 1);
+        batch->key = key;
+        batch->source = g_strdup(source);
+        batch->target = g_strdup(target);
+        batch->jobs = g_ptr_array_new();
+        batch->priority = priority;
+        g_hash_table_insert(open_batches, batch->key, batch);
+    }
+    else{
+        g_free(key);
+    }
+
+    g_ptr_array_add(batch->jobs, job);
+    batch->priority = MIN(batch->priority, priority);
+    batch->bytes += strlen(text);
+
+    if(batch->jobs->len >= batching.texts || batch->bytes >= batching.bytes){
+        send_batch(batch);
+    }
+    else if(batch->timer == 0){
+        batch->timer = g_timeout_add(batching.window, batch_window_over, batch);
+    }
+}
+
+/**
+ * @brief Queues the draft of a message to be translated in the background
+ *
+ * Works like translation_pipeline_submit(), except that the draft is never gathered in a batch, as the draft
+ * is often incomplete, its translation is not cached and the user is not told if it fails. A message submitted
+ * while the draft is in flight waits for it, and then its translation is cached like any other
+ * @param text String containing the draft
+ * @param source String containing the source language to translate the draft from
+ * @param target String containing the target language to translate the draft to
+ * @param ready Function to call with the result
+ * @param data Additional data passed to ready
+ */
+void translation_pipeline_submit_draft(const char *text, const char *source, const char *target,
+                                       translation_ready_func ready, gpointer data){
+    translation_job *job;
+
+    if(join_job(text, source, target, ready, data) != NULL){
+        return;
+    }
+
+    job = create_job(text, source, target, WORKER_PRIORITY_BACKGROUND, ready, data);
+    job->draft = 1;
+    job->task = job;
+    worker_pool_push(WORKER_PRIORITY_BACKGROUND, translation_job_run, translation_job_done, job);
+}
+
+/**
+ * @brief Changes how texts are gathered in batches
+ *
+ * Must be called from the main loop. The batches already gathering texts are sent at once
+ * @param limits The new limits. A window of 0 or a limit of 1 text disables batching
+ */
+void translation_pipeline_set_batching(const translation_batching *limits){
+    batching = *limits;
+
+    if(open_batches != NULL){
+        send_open_batches();
+    }
+}
+
+/**
+ * @brief Retrieves how texts are gathered in batches
+ *
+ * @param limits Reference to where the limits will be stored
+ */
+void translation_pipeline_get_batching(translation_batching *limits){
+    *limits = batching;
+}
+
+/**
+ * @brief Finishes every pending translation and stops the worker threads
+ *
+ * The batches still gathering texts are sent first. The translations still queued that are not outgoing are not
+ * requested at all, and fail. The ready functions of the pending translations are called before returning
+ */
+void translation_pipeline_shutdown(void){
+    if(open_batches != NULL){
+        send_open_batches();
+        g_hash_table_destroy(open_batches);
+        open_batches = NULL;
+    }
+
+    worker_pool_shutdown();
+
+    g_hash_table_destroy(in_flight);
+    in_flight = NULL;
+}
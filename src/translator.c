@@ -26,27 +26,123 @@
 
 #define PLUGIN_ID "core-sbalbp-apertium_translator"
 
+#ifdef HAVE_PYTHON
 #include "python_interface.h"
+#endif
+#include "preferences.h"
+#include "apy_client.h"
+#include "buddy_index.h"
 #include <string.h>
 #include <glib.h>
 #include "notifications.h"
+#include "translation_pipeline.h"
+#include "worker_pool.h"
+#include "translation_cache.h"
+#include "disk_cache.h"
+#include "pair_catalogue.h"
+#include "apy_health.h"
+#include "retry_queue.h"
+#include "draft_translation.h"
 #include "plugin.h"
 #include "debug.h"
 #include "signals.h"
 #include "request.h"
 #include "cmds.h"
+#include "server.h"
+#include "util.h"
 #include "version.h"
 
 /**
  * @brief Describes the different ways in which a translated message can be shown
+ *
+ * In PROGRESSIVE mode, incoming messages are shown at once and their translation follows as a separate line,
+ * while outgoing messages are sent as in COMPRESSED mode
+ */
+typedef enum {BOTH, TRANSLATION, COMPRESSED, PROGRESSIVE} display_mode;
+
+/**
+ * @brief Number of characters of the original message quoted in front of a translation shown as a follow-up line
  */
-typedef enum {BOTH, TRANSLATION, COMPRESSED} display_mode;
+#define FOLLOW_UP_EXCERPT_LENGTH 30
 
 /**
  * @brief Variable containing the display_mode value that tell the plugin how messages should be shown
  */
 display_mode display = COMPRESSED;
 
+/**
+ * @brief A message held back by the plugin while its translation is requested
+ */
+typedef struct {
+    /** Account the message is sent or received on */
+    PurpleAccount *account;
+    /** Username of the buddy the message is sent to or received from */
+    char *name;
+    /** The message as it was written */
+    char *original;
+    /** The translation of the message, or NULL if it is not available */
+    char *translation;
+    /** Source language of the language pair the message is translated with */
+    char *source;
+    /** Target language of the language pair the message is translated with */
+    char *target;
+    /** Flags of the message */
+    PurpleMessageFlags flags;
+    /** Time the message was sent or received at */
+    time_t mtime;
+    /** 1 for messages sent by the user, 0 for received ones */
+    int outgoing;
+    /** 1 once the translation request has finished */
+    int ready;
+    /** Queue of held back messages the message belongs to */
+    GQueue *queue;
+} pending_message;
+
+/**
+ * @brief An incoming message shown before its translation, in PROGRESSIVE display mode
+ */
+typedef struct {
+    /** Account the message was received on */
+    PurpleAccount *account;
+    /** Username of the buddy the message was received from */
+    char *name;
+    /** The message as it was received */
+    char *original;
+    /** Source language of the language pair the message is translated with */
+    char *source;
+    /** Target language of the language pair the message is translated with */
+    char *target;
+    /** The translation found in the cache, or NULL if it was requested to the APYs */
+    char *translation;
+} follow_up_message;
+
+/**
+ * @brief Queues of messages waiting for their translation, one per conversation and direction
+ *
+ * Messages are delivered in the same order they were held back, so that a slow translation is never overtaken
+ */
+GHashTable *pending_queues = NULL;
+
+/**
+ * @brief ID of the timeout source starting the next retry of a failed translation, or 0 if there is none
+ */
+guint retry_source = 0;
+
+/**
+ * @brief Indicates that the plugin is delivering a held back incoming message
+ *
+ * While set, receiving_im_msg_cb lets messages through untouched
+ */
+int delivering = 0;
+
+/**
+ * @brief Messages sent to or received from buddies while the preferences are being converted, or NULL if none
+ * are being held back
+ *
+ * The bindings are not known until the conversion has finished, so the messages are held back and translated then
+ */
+GQueue *startup_messages = NULL;
+
 /**
  * @brief ID for the 'apertium_bind' command
  *
@@ -76,11 +172,18 @@ PurpleCmdId unbind_args_command_id;
 PurpleCmdId check_command_id;
 
 /**
- * @brief ID for the 'apertium_pairs' command
+ * @brief ID for the 'apertium_pairs' (without arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId pairs_noargs_command_id;
+
+/**
+ * @brief ID for the 'apertium_pairs' (with arguments) command
  *
  * Used to unregister the command on plugin unload
  */
-PurpleCmdId pairs_command_id;
+PurpleCmdId pairs_args_command_id;
 
 /**
  * @brief ID for the 'apertium_apy' (without arguments) command
@@ -131,156 +234,1266 @@ PurpleCmdId info_display_command_id;
  */
 PurpleCmdId errors_command_id;
 
+/**
+ * @brief ID for the 'apertium_cache' (without arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId cache_noargs_command_id;
+
+/**
+ * @brief ID for the 'apertium_cache' (with arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId cache_args_command_id;
+
+/**
+ * @brief ID for the 'apertium_batch' (without arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId batch_noargs_command_id;
+
+/**
+ * @brief ID for the 'apertium_batch' (with arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId batch_args_command_id;
+
+/**
+ * @brief ID for the 'apertium_pool' (without arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId pool_noargs_command_id;
+
+/**
+ * @brief ID for the 'apertium_pool' (with arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId pool_args_command_id;
+
+/**
+ * @brief ID for the 'apertium_hedge' command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId hedge_command_id;
+
+/**
+ * @brief ID for the 'apertium_apypolicy' command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId apypolicy_command_id;
+
+/**
+ * @brief ID for the 'apertium_breaker' (without arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId breaker_noargs_command_id;
+
+/**
+ * @brief ID for the 'apertium_breaker' (with arguments) command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId breaker_args_command_id;
+
+/**
+ * @brief ID for the 'apertium_apyweight' command
+ *
+ * Used to unregister the command on plugin unload
+ */
+PurpleCmdId apyweight_command_id;
+
 /****************************************************************************************************/
 /*----------------------------------------------UTILS-----------------------------------------------*/
 /****************************************************************************************************/
 
 /**
- * @brief Translates a text message
+ * @brief Shows the language pairs available in the APYs, each with the APYs that offer it
  *
- * *message is reallocated and modified to contain both the original message and its translation
- * @param message Reference to the text string to be translated
- * @param buddy Buddy to check user-language_pair binding for
- * @param key String indicating which entry to check in the dictionary. Must be "incoming" or "outgoing"
+ * @return 1 on success, or 0 otherwise
  */
-void translate_message(char **message, PurpleBuddy *buddy, const char *key){
-    const char *username;
-    char *translation;
+int show_pairs(void){
+    int i, j, size, apys, listed;
+    char *title, *text, ***pairsList, **addresses;
 
-    username = purple_buddy_get_name(buddy);
+    if(!(size = getAllPairs(&pairsList))){
+        return 0;
+    }
 
-    if(dictionaryHasUser(username, key)){
-        char* oldMsg = malloc(sizeof(char)*(strlen(*message)+1));
-        sprintf(oldMsg,"%s",*message);
+    if((apys = getAPYAddress(&addresses)) == -1){
+        apys = 0;
+        addresses = NULL;
+    }
 
-        translation = translate(*message,
-            dictionaryGetUserLanguage(username, key, "source"),
-            dictionaryGetUserLanguage(username, key, "target"));
+    title = malloc(sizeof(char)*100);
+    text = malloc(sizeof(char)*size*(50+apys*12));
 
-        if(translation != NULL){
-            switch(display){
-                case BOTH:
-                    *message = (char*)realloc(*message, sizeof(char)*(strlen(oldMsg)+strlen(translation)+100));
-                    sprintf(*message,"\n-- Original:\n%s\n-- Translation:\n%s",oldMsg,translation);
-                    break;
-                case TRANSLATION:
-                    *message = (char*)realloc(*message, sizeof(char)*(strlen(translation)+100));
-                    sprintf(*message,"%s",translation);
-                    break;
-                case COMPRESSED:
-                    *message = (char*)realloc(*message, sizeof(char)*(strlen(oldMsg)+strlen(translation)+100));
-                    sprintf(*message,"%s\n-- Translation: %s",oldMsg,translation);
-                    break;
+    sprintf(title, "available pairs (APYs offering them)");
+    sprintf(text, " ");
+
+    for(i=0; i<size; i++){
+        sprintf(text+strlen(text),"%s - %s [", pairsList[i][0], pairsList[i][1]);
+
+        // The APYs are numbered as in the 'apertium_apy' listing
+        listed = 0;
+        for(j=0; j<apys; j++){
+            if(pair_catalogue_contains(addresses[j], pairsList[i][0], pairsList[i][1]) == 1){
+                sprintf(text+strlen(text),"%s%d", listed ? ", " : "", j+1);
+                listed = 1;
             }
         }
+        sprintf(text+strlen(text),"]");
+
+        if(i%3 == 2){
+            sprintf(text+strlen(text),"\n");
+        }
+        else{
+            sprintf(text+strlen(text),"\t");
+        }
+    }
 
-        free(oldMsg);
+    notify_info_popup(title, text);
+
+    for(i=0; i<size; i++){
+        free(pairsList[i][0]);
+        free(pairsList[i][1]);
+        free(pairsList[i]);
     }
+    free(pairsList);
+    for(i=0; i<apys; i++){
+        free(addresses[i]);
+    }
+    free(addresses);
+    free(title);
+    free(text);
+
+    return 1;
 }
 
 /**
- * @brief Parses and returns arguments for 'apertium_apy' command
+ * @brief Asks every APY for its language pairs
  *
- * This function expects 1 to 3 arguments. Passing less than 1 argument in args will result in an error. Arguments after the third one will be ignored
- * @param args String containing the arguments passed to the command (separated by whitespaces)
- * @param order Reference to a integer where the 'order' argument (optional) will be stored
- * @param address Reference to a string where the 'address' argument will be stored
- * @param port Reference to a string where the 'port' argument (optional) will be stored
- * @return 1 on success, or 0 otherwise
+ * Runs on a worker thread, as a background task
+ * @param data Reference to an int where the number of APYs that answered will be stored
  */
-int parse_apy_arguments(char* args, int *order, char **address, char **port){
+void refresh_pairs_run(gpointer data){
+    *(int*)data = refreshPairs();
+}
 
-    char *str;
+/**
+ * @brief Shows the language pairs once they have been refreshed
+ *
+ * Runs on the main loop
+ * @param data Reference to the number of APYs that answered, which is freed
+ */
+void refresh_pairs_done(gpointer data){
+    if(*(int*)data){
+        show_pairs();
+    }
 
-    if((*address = strtok(args," ")) == NULL){
-        notify_error("No 'address' argument provided");
-        return 0;
+    g_free(data);
+}
+
+/**
+ * @brief Builds the name of the setting the weight of an APY is stored under
+ *
+ * @param address Address of the APY
+ * @return The name of the setting, which must be freed with g_free()
+ */
+char* apy_weight_key(const char *address){
+    return g_strdup_printf("apyWeight %s", address);
+}
+
+/**
+ * @brief Restores from the preferences file the weights of the APYs in the APY list
+ */
+void restore_apy_weights(void){
+    int i, size;
+    char **addresses, *key;
+
+    if((size = getAPYAddress(&addresses)) == -1){
+        return;
     }
 
-    str = malloc(sizeof(char)*100);
-    sprintf(str, "%d", atoi(*address));
+    for(i=0; i<size; i++){
+        key = apy_weight_key(addresses[i]);
+        setAPYWeight(addresses[i], (unsigned int)getIntKey(key, APY_DEFAULT_WEIGHT));
+        g_free(key);
+        free(addresses[i]);
+    }
+    free(addresses);
+}
 
-    if(strcmp(str, *address) == 0){
-        free(str);
-        *order = atoi(*address);
+/**
+ * @brief Builds the text to be delivered for a message according to the display mode
+ *
+ * @param original The message as it was written
+ * @param translation The translation of the message
+ * @return A newly allocated string containing the text to be delivered, which must be freed after its use
+ */
+char* compose_message(const char *original, const char *translation){
+    char *message = NULL;
 
-        if((*address = strtok(NULL," ")) == NULL){
-            notify_error("No 'address' argument provided");
-            return 0;
+    switch(display){
+        case BOTH:
+            message = malloc(sizeof(char)*(strlen(original)+strlen(translation)+100));
+            sprintf(message,"\n-- Original:\n%s\n-- Translation:\n%s",original,translation);
+            break;
+        case TRANSLATION:
+            message = malloc(sizeof(char)*(strlen(translation)+100));
+            sprintf(message,"%s",translation);
+            break;
+        case COMPRESSED:
+        case PROGRESSIVE:
+            message = malloc(sizeof(char)*(strlen(original)+strlen(translation)+100));
+            sprintf(message,"%s\n-- Translation: %s",original,translation);
+            break;
+    }
+
+    return message;
+}
+
+/**
+ * @brief Builds the line showing the translation of an incoming message that has already been shown
+ *
+ * The beginning of the original message is quoted, so that the line can be told apart when several messages
+ * are waiting for their translation
+ * @param original The message as it was received
+ * @param translation The translation of the message
+ * @return A newly allocated string containing the line, which must be freed after its use
+ */
+char* compose_follow_up(const char *original, const char *translation){
+    char *plain, *escaped, *message;
+    int cut = 0;
+
+    plain = purple_markup_strip_html(original);
+
+    if(g_utf8_strlen(plain, -1) > FOLLOW_UP_EXCERPT_LENGTH){
+        *g_utf8_offset_to_pointer(plain, FOLLOW_UP_EXCERPT_LENGTH) = '\0';
+        cut = 1;
+    }
+    escaped = g_markup_escape_text(plain, -1);
+
+    message = malloc(sizeof(char)*(strlen(escaped)+strlen(translation)+100));
+    sprintf(message,"-- Translation of \"%s%s\": %s",escaped,cut ? "..." : "",translation);
+
+    g_free(escaped);
+    g_free(plain);
+
+    return message;
+}
+
+/**
+ * @brief Delivers a held back message, translated if its translation is available
+ *
+ * Outgoing messages are sent to the buddy and written to the conversation. Incoming messages are handed back
+ * to libpurple as if they had just been received
+ * @param msg The message to be delivered
+ */
+void deliver_message(pending_message *msg){
+    char *text;
+    PurpleConnection *gc;
+    PurpleConversation *conv;
+
+    if(g_list_find(purple_accounts_get_all(), msg->account) == NULL || !purple_account_is_connected(msg->account)){
+        purple_debug_warning(PLUGIN_ID, "Dropping message for %s, its account is no longer connected\n", msg->name);
+        return;
+    }
+
+    gc = purple_account_get_connection(msg->account);
+
+    if(msg->translation != NULL){
+        text = compose_message(msg->original, msg->translation);
+    }
+    else{
+        text = malloc(sizeof(char)*(strlen(msg->original)+1));
+        sprintf(text,"%s",msg->original);
+    }
+
+    if(msg->outgoing){
+        if(serv_send_im(gc, msg->name, text, msg->flags) > 0){
+            conv = purple_find_conversation_with_account(PURPLE_CONV_TYPE_IM, msg->name, msg->account);
+            if(conv != NULL){
+                purple_conv_im_write(purple_conversation_get_im_data(conv), NULL, msg->original, msg->flags, time(NULL));
+            }
         }
+        purple_signal_emit(purple_conversations_get_handle(), "sent-im-msg", msg->account, msg->name, text);
     }
     else{
-        free(str);
-        *order = -1;
+        delivering = 1;
+        serv_got_im(gc, msg->name, text, msg->flags, msg->mtime);
+        delivering = 0;
     }
 
-    *port = strtok(NULL," ");
+    free(text);
+}
 
-    return 1;
+/**
+ * @brief Delivers, in order, the messages at the head of a queue whose translation has finished
+ *
+ * @param queue Queue of held back messages
+ */
+void flush_pending_queue(GQueue *queue){
+    pending_message *msg;
+
+    while((msg = g_queue_peek_head(queue)) != NULL && msg->ready){
+        g_queue_pop_head(queue);
+
+        deliver_message(msg);
+
+        free(msg->translation);
+        g_free(msg->name);
+        g_free(msg->original);
+        g_free(msg->source);
+        g_free(msg->target);
+        g_free(msg);
+    }
 }
 
 /**
- * @brief Parses and returns arguments for 'apertium_bind' command
+ * @brief Writes the late translation of a message whose translation had failed into its conversation
  *
- * This function expects exactly 3 arguments. Passing less than 3 arguments in args will result in an error. Arguments after the third one will be ignored
- * @param args String containing the arguments passed to the command (separated by whitespaces)
- * @param command Reference to a string where the 'command' argument will be stored
- * @param source Reference to a string where the 'source language' argument will be stored
- * @param target Reference to a string where the 'target language' argument will be stored
- * @return 1 on success, or 0 otherwise
+ * The translation of an incoming message is shown as a delayed message of the buddy. The translation of an
+ * outgoing message is only shown to the user, who may send it; it is never sent without them seeing it first
+ * @param entry The message
+ * @param translation Its translation
+ * @return 1 on success, or 0 if the account is not connected
  */
-int parse_bind_arguments(char* args, char **command, char** source, char** target){
+int deliver_late_translation(retry_entry *entry, const char *translation){
+    char *text;
+    PurpleAccount *account;
+    PurpleConversation *conv;
 
-    if((*command = strtok(args," ")) == NULL){
-        notify_error("No command provided");
+    account = purple_accounts_find(entry->account, entry->protocol);
+    if(account == NULL || !purple_account_is_connected(account)){
         return 0;
     }
 
-    if(strcmp(*command,"incoming") && strcmp(*command,"outgoing")){
-        notify_error("Command for apertium_set must be \'incoming\' or \'outgoing\'");
-        return 0;
+    conv = purple_find_conversation_with_account(PURPLE_CONV_TYPE_IM, entry->name, account);
+    if(conv == NULL){
+        conv = purple_conversation_new(PURPLE_CONV_TYPE_IM, account, entry->name);
     }
 
-	if((*source = strtok(NULL," ")) == NULL){
-        notify_error("No source language provided");
-        return 0;
+    if(entry->outgoing){
+        text = malloc(sizeof(char)*(strlen(entry->text)+strlen(translation)+100));
+        sprintf(text,"Translation of your message \"%s\", not sent: %s",entry->text,translation);
+
+        purple_conv_im_write(purple_conversation_get_im_data(conv), NULL, text,
+                             PURPLE_MESSAGE_SYSTEM, time(NULL));
     }
-	if((*target = strtok(NULL," ")) == NULL){
-        notify_error("No target language provided");
-        return 0;
+    else{
+        text = display == PROGRESSIVE ? compose_follow_up(entry->text, translation)
+                                      : compose_message(entry->text, translation);
+        purple_conv_im_write(purple_conversation_get_im_data(conv), entry->name, text,
+                             PURPLE_MESSAGE_RECV | PURPLE_MESSAGE_DELAYED, time(NULL));
     }
 
-    return pairExists(*source, *target);
+    free(text);
+    return 1;
 }
 
+void schedule_retry(void);
+
 /**
- * @brief Parses and returns arguments for 'apertium_unbind' command
+ * @brief Called on the main loop once the retry of a failed translation has finished
  *
- * This function expects 1 argument in args. Additional arguments will be ignored
- * @param args String containing the argument passed to the command
- * @param command Reference to a string where the 'command' argument will be stored
- * @return 1 on success, or 0 otherwise
+ * @param translation The translated message, or NULL if the translation failed again
+ * @param data The retry_entry being retried
+ */
+void retry_ready_cb(char *translation, gpointer data){
+    retry_entry *entry = data;
+
+    if(translation != NULL && deliver_late_translation(entry, translation)){
+        retry_queue_succeeded();
+        retry_queue_finish(1);
+    }
+    else{
+        retry_queue_failed();
+        retry_queue_finish(0);
+    }
+
+    free(translation);
+    schedule_retry();
+}
+
+/**
+ * @brief Retries the oldest failed translation
+ *
+ * @param unused Not used
+ * @return FALSE, so that the timeout source is removed
+ */
+gboolean retry_due_cb(gpointer unused){
+    retry_entry *entry;
+    char *translation;
+
+    retry_source = 0;
+
+    if((entry = retry_queue_take()) == NULL){
+        return FALSE;
+    }
+
+    // The translation may have been cached meanwhile, by a later message with the same text
+    if((translation = translation_cache_lookup(entry->source, entry->target, entry->text)) != NULL){
+        retry_ready_cb(translation, entry);
+    }
+    else{
+        translation_pipeline_submit(entry->text, entry->source, entry->target, WORKER_PRIORITY_BACKGROUND,
+                                    retry_ready_cb, entry);
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief Schedules the next retry of a failed translation, if there is any to retry and none is scheduled
+ */
+void schedule_retry(void){
+    if(retry_source != 0 || retry_queue_length() == 0){
+        return;
+    }
+
+    retry_source = g_timeout_add_seconds(retry_queue_delay(), retry_due_cb, NULL);
+}
+
+/**
+ * @brief Keeps the retry queue up to date with the result of a translation
+ *
+ * A failed translation is queued to be retried until an APY answers. A successful one means an APY is answering
+ * again, so the messages waiting to be retried need not wait any longer
+ * @param account Account the message was sent or received on
+ * @param name Username of the buddy the message was sent to or received from
+ * @param outgoing 1 for messages sent by the user, 0 for received ones
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param original The message as it was written
+ * @param translated 1 if the message was translated, or 0 otherwise
+ */
+void track_translation_result(PurpleAccount *account, const char *name, int outgoing,
+                              const char *source, const char *target, const char *original, int translated){
+    if(!translated){
+        retry_queue_add(purple_account_get_username(account), purple_account_get_protocol_id(account),
+                        name, outgoing, source, target, original);
+        schedule_retry();
+    }
+    else if(retry_queue_delay() > 0 && retry_queue_length() > 0){
+        retry_queue_succeeded();
+        if(retry_source != 0){
+            g_source_remove(retry_source);
+            retry_source = 0;
+        }
+        schedule_retry();
+    }
+}
+
+/**
+ * @brief Called on the main loop once the translation of a held back message has finished
+ *
+ * @param translation The translated message, or NULL if the translation failed
+ * @param data The pending_message the translation belongs to
+ */
+void translation_ready_cb(char *translation, gpointer data){
+    pending_message *msg = data;
+
+    msg->translation = translation;
+    msg->ready = 1;
+
+    track_translation_result(msg->account, msg->name, msg->outgoing, msg->source, msg->target, msg->original,
+                             translation != NULL);
+
+    flush_pending_queue(msg->queue);
+}
+
+/**
+ * @brief Shows the translation of an incoming message that has already been shown, and frees the message
+ *
+ * Called on the main loop once the translation has finished
+ * @param translation The translated message, or NULL if the translation failed
+ * @param data The follow_up_message the translation belongs to
+ */
+void follow_up_ready_cb(char *translation, gpointer data){
+    follow_up_message *msg = data;
+    char *text;
+    PurpleConversation *conv;
+
+    if(g_list_find(purple_accounts_get_all(), msg->account) == NULL){
+        purple_debug_warning(PLUGIN_ID, "Dropping translation for %s, its account no longer exists\n", msg->name);
+    }
+    else{
+        track_translation_result(msg->account, msg->name, 0, msg->source, msg->target, msg->original,
+                                 translation != NULL);
+
+        if(translation != NULL){
+            conv = purple_find_conversation_with_account(PURPLE_CONV_TYPE_IM, msg->name, msg->account);
+            if(conv == NULL){
+                conv = purple_conversation_new(PURPLE_CONV_TYPE_IM, msg->account, msg->name);
+            }
+
+            text = compose_follow_up(msg->original, translation);
+            purple_conv_im_write(purple_conversation_get_im_data(conv), msg->name, text, PURPLE_MESSAGE_RECV, time(NULL));
+            free(text);
+        }
+    }
+
+    free(translation);
+    g_free(msg->name);
+    g_free(msg->original);
+    g_free(msg->source);
+    g_free(msg->target);
+    g_free(msg);
+}
+
+/**
+ * @brief Shows a translation found in the cache once the original message has been shown
+ *
+ * @param data The follow_up_message, with its translation
+ * @return FALSE, so that the idle source is removed
+ */
+gboolean follow_up_cached_cb(gpointer data){
+    follow_up_message *msg = data;
+
+    follow_up_ready_cb(msg->translation, msg);
+
+    return FALSE;
+}
+
+/**
+ * @brief Requests the translation of an incoming message that is shown at once, in PROGRESSIVE display mode
+ *
+ * Nothing is done if there is no user-language_pair binding for the buddy. Otherwise, the translation is shown
+ * as a follow-up line of the conversation as soon as it is available
+ * @param account Account the message was received on
+ * @param buddy Buddy to check user-language_pair binding for
+ * @param name Username of the buddy
+ * @param message The received message
+ */
+void translate_progressively(PurpleAccount *account, PurpleBuddy *buddy, const char *name, const char *message){
+    const char *username;
+    follow_up_message *msg;
+
+    if(buddy == NULL){
+        return;
+    }
+
+    username = purple_buddy_get_name(buddy);
+
+    if(!dictionaryHasUser(username, "incoming")){
+        return;
+    }
+
+    msg = g_new0(follow_up_message, 1);
+    msg->account = account;
+    msg->name = g_strdup(name);
+    msg->original = g_strdup(message);
+    msg->source = g_strdup(dictionaryGetUserLanguage(username, "incoming", "source"));
+    msg->target = g_strdup(dictionaryGetUserLanguage(username, "incoming", "target"));
+
+    // The original message has not been shown yet, so even a cached translation must wait for it
+    if((msg->translation = translation_cache_lookup(msg->source, msg->target, message)) != NULL){
+        g_idle_add(follow_up_cached_cb, msg);
+    }
+    else{
+        translation_pipeline_submit(message, msg->source, msg->target, WORKER_PRIORITY_INCOMING,
+                                    follow_up_ready_cb, msg);
+    }
+}
+
+/**
+ * @brief Holds back a message and requests its translation in the background
+ *
+ * Nothing is done if there is no user-language_pair binding for the buddy. Otherwise, the message is delivered
+ * by deliver_message() once its translation is available, so the caller must stop libpurple from handling it.
+ * Translations found in the cache are used without asking the APYs
+ * @param account Account the message is sent or received on
+ * @param buddy Buddy to check user-language_pair binding for
+ * @param name Username of the buddy
+ * @param message The message to be translated
+ * @param flags Flags of the message
+ * @param key String indicating which entry to check in the dictionary. Must be "incoming" or "outgoing"
+ * @return 1 if the message was held back, or 0 otherwise
+ */
+int queue_message(PurpleAccount *account, PurpleBuddy *buddy, const char *name,
+                  const char *message, PurpleMessageFlags flags, const char *key){
+    const char *username;
+    char *queue_key;
+    pending_message *msg;
+
+    if(buddy == NULL){
+        return 0;
+    }
+
+    username = purple_buddy_get_name(buddy);
+
+    if(!dictionaryHasUser(username, key)){
+        return 0;
+    }
+
+    msg = g_new0(pending_message, 1);
+    msg->account = account;
+    msg->name = g_strdup(name);
+    msg->original = g_strdup(message);
+    msg->flags = flags;
+    msg->mtime = time(NULL);
+    msg->outgoing = !strcmp(key, "outgoing");
+    msg->source = g_strdup(dictionaryGetUserLanguage(username, key, "source"));
+    msg->target = g_strdup(dictionaryGetUserLanguage(username, key, "target"));
+
+    queue_key = g_strdup_printf("%s %p %s", key, (void*)account, name);
+    if((msg->queue = g_hash_table_lookup(pending_queues, queue_key)) == NULL){
+        msg->queue = g_queue_new();
+        g_hash_table_insert(pending_queues, queue_key, msg->queue);
+    }
+    else{
+        g_free(queue_key);
+    }
+
+    g_queue_push_tail(msg->queue, msg);
+
+    // A translated draft or a cached translation needs no request, so the message goes out at once unless older
+    // ones are still waiting
+    if((msg->outgoing &&
+        (msg->translation = draft_translation_take(account, name, message, msg->source, msg->target)) != NULL) ||
+       (msg->translation = translation_cache_lookup(msg->source, msg->target, message)) != NULL){
+        msg->ready = 1;
+        flush_pending_queue(msg->queue);
+    }
+    else{
+        translation_pipeline_submit(message, msg->source, msg->target,
+            msg->outgoing ? WORKER_PRIORITY_OUTGOING : WORKER_PRIORITY_INCOMING, translation_ready_cb, msg);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Parses and returns arguments for 'apertium_apy' command
+ *
+ * This function expects 1 to 3 arguments. Passing less than 1 argument in args will result in an error. Arguments after the third one will be ignored
+ * @param args String containing the arguments passed to the command (separated by whitespaces)
+ * @param order Reference to a integer where the 'order' argument (optional) will be stored
+ * @param address Reference to a string where the 'address' argument will be stored
+ * @param port Reference to a string where the 'port' argument (optional) will be stored
+ * @return 1 on success, or 0 otherwise
+ */
+int parse_apy_arguments(char* args, int *order, char **address, char **port){
+
+    char *str;
+
+    if((*address = strtok(args," ")) == NULL){
+        notify_error("No 'address' argument provided");
+        return 0;
+    }
+
+    str = malloc(sizeof(char)*100);
+    sprintf(str, "%d", atoi(*address));
+
+    if(strcmp(str, *address) == 0){
+        free(str);
+        *order = atoi(*address);
+
+        if((*address = strtok(NULL," ")) == NULL){
+            notify_error("No 'address' argument provided");
+            return 0;
+        }
+    }
+    else{
+        free(str);
+        *order = -1;
+    }
+
+    *port = strtok(NULL," ");
+
+    return 1;
+}
+
+/**
+ * @brief Parses and returns arguments for 'apertium_bind' command
+ *
+ * This function expects exactly 3 arguments. Passing less than 3 arguments in args will result in an error. Arguments after the third one will be ignored
+ * @param args String containing the arguments passed to the command (separated by whitespaces)
+ * @param command Reference to a string where the 'command' argument will be stored
+ * @param source Reference to a string where the 'source language' argument will be stored
+ * @param target Reference to a string where the 'target language' argument will be stored
+ * @return 1 on success, or 0 otherwise
+ */
+int parse_bind_arguments(char* args, char **command, char** source, char** target){
+
+    if((*command = strtok(args," ")) == NULL){
+        notify_error("No command provided");
+        return 0;
+    }
+
+    if(strcmp(*command,"incoming") && strcmp(*command,"outgoing")){
+        notify_error("Command for apertium_set must be \'incoming\' or \'outgoing\'");
+        return 0;
+    }
+
+	if((*source = strtok(NULL," ")) == NULL){
+        notify_error("No source language provided");
+        return 0;
+    }
+	if((*target = strtok(NULL," ")) == NULL){
+        notify_error("No target language provided");
+        return 0;
+    }
+
+    return pairExists(*source, *target);
+}
+
+/**
+ * @brief Parses and returns arguments for 'apertium_unbind' command
+ *
+ * This function expects 1 argument in args. Additional arguments will be ignored
+ * @param args String containing the argument passed to the command
+ * @param command Reference to a string where the 'command' argument will be stored
+ * @return 1 on success, or 0 otherwise
+ */
+int parse_unbind_arguments(char* args, char **command){
+
+    if((*command = strtok(args," ")) == NULL){
+        return 0;
+    }
+
+    if(strcmp(*command,"incoming") && strcmp(*command,"outgoing")){
+        notify_error("Command for apertium_delete must be null, \'incoming\' or \'outgoing\'");
+        return 0;
+    }
+
+    return 1;
+}
+
+/****************************************************************************************************/
+/*----------------------------------COMMAND CALLBACK DEFINITIONS------------------------------------*/
+/****************************************************************************************************/
+
+/**
+ * @brief Callback for the 'apertium_check' command
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_check_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *title, *text;
+    const char *username;
+    PurpleBuddy *buddy;
+
+    set_conversation(conv);
+
+    title = malloc(sizeof(char)*100);
+    text = malloc(sizeof(char)*300);
+
+    buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
+    username = purple_buddy_get_name(buddy);
+
+    sprintf(title,"Pairs for \'%s\'", purple_buddy_get_name(buddy));
+
+    if(dictionaryHasUser(username, "incoming")){
+        sprintf(text,"Incoming messages: %s - %s\n",
+            dictionaryGetUserLanguage(username, "incoming", "source"),
+            dictionaryGetUserLanguage(username, "incoming", "target"));
+    }
+    else{
+        sprintf(text,"Incoming messages: None\n");
+    }
+    if(dictionaryHasUser(username, "outgoing")){
+        sprintf(text,"%sOutgoing messages: %s - %s", text,
+            dictionaryGetUserLanguage(username, "outgoing", "source"),
+            dictionaryGetUserLanguage(username, "outgoing", "target"));
+    }
+    else{
+        sprintf(text,"%sOutgoing messages: None", text);
+    }
+
+    notify_info_popup(title, text);
+
+    free(title);
+    free(text);
+
+    return PURPLE_CMD_RET_OK;
+}
+
+/**
+ * @brief Callback for the 'apertium_pairs' command when no arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_pairs_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    set_conversation(conv);
+
+    return show_pairs() ? PURPLE_CMD_RET_OK : PURPLE_CMD_RET_FAILED;
+}
+
+/**
+ * @brief Callback for the 'apertium_pairs' command when arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_pairs_args_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    set_conversation(conv);
+
+    if(strcmp(*args, "refresh")){
+        notify_error("The argument must be \"refresh\"");
+        return PURPLE_CMD_RET_FAILED;
+    }
+
+    // Asking every APY may take a while, so it is done in the background and the pairs are shown afterwards
+    worker_pool_push(WORKER_PRIORITY_BACKGROUND, refresh_pairs_run, refresh_pairs_done, g_new0(int, 1));
+
+    notify_info("Refreshing the language pairs");
+    return PURPLE_CMD_RET_OK;
+}
+
+/**
+ * @brief Callback for the 'apertium_set' command
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_bind_cb(PurpleConversation *conv, const gchar *cmd,
+								gchar **args, gchar **error, void *data){
+    const char *username;
+    char *command, *source, *target, *msg;
+	PurpleBuddy *buddy;
+
+    set_conversation(conv);
+
+    if(parse_bind_arguments(*args,&command,&source,&target)){
+    	buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
+        username = purple_buddy_get_name(buddy);
+
+    	if(dictionarySetUserEntry(username,command,source,target)){
+            // The buddy is likely to be written to soon
+            warmUpPair(source, target);
+
+            msg = malloc(sizeof(char)*(strlen(source)+strlen(target)+strlen(command)+strlen(username)+100));
+            sprintf(msg, "%s pair for %s successfully set to %s-%s",command,username,source,target);
+            notify_info(msg);
+            free(msg);
+    		return PURPLE_CMD_RET_OK;
+    	}
+    	else{
+    		return PURPLE_CMD_RET_FAILED;
+    	}
+	}
+	else{
+		return PURPLE_CMD_RET_FAILED;
+	}
+}
+
+/**
+ * @brief Callback for the 'apertium_delete' command when no arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_unbind_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    const char *username;
+    char *msg;
+    PurpleBuddy *buddy;
+
+    set_conversation(conv);
+
+    buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
+    username = purple_buddy_get_name(buddy);
+
+    if(dictionaryRemoveUserEntries(username)){
+        msg = malloc(sizeof(char)*(strlen(username)+100));
+        sprintf(msg, "Successfully removed data for %s",username);
+        notify_info(msg);
+        free(msg);
+        return PURPLE_CMD_RET_OK;
+    }
+    else{
+        return PURPLE_CMD_RET_FAILED;
+    }
+}
+
+/**
+ * @brief Callback for the 'apertium_delete' command when arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_unbind_args_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    const char *username;
+    char *command, *msg;
+    PurpleBuddy *buddy;
+
+    set_conversation(conv);
+
+    if(parse_unbind_arguments(*args,&command)){
+        buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
+        username = purple_buddy_get_name(buddy);
+
+        if(dictionaryRemoveUserEntry(username, command)){
+            msg = malloc(sizeof(char)*(strlen(username)+strlen(command)+100));
+            sprintf(msg, "Successfully removed %s data for %s",command,username);
+            notify_info(msg);
+            free(msg);
+            return PURPLE_CMD_RET_OK;
+        }
+        else{
+            return PURPLE_CMD_RET_FAILED;
+        }
+    }
+    else{
+        return PURPLE_CMD_RET_FAILED;
+    }
+}
+
+/**
+ * @brief Callback for the 'apertium_apy' command when no arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_apy_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char **addresses;
+    int i,size;
+    GString *msg;
+    char **sources, **targets;
+    int pairs;
+    apy_pool_stats stats;
+    apy_health_stats health;
+
+    set_conversation(conv);
+
+    if((size = getAPYAddress(&addresses)) == -1){
+        return PURPLE_CMD_RET_FAILED;
+    }
+    else{
+        msg = g_string_new("APY address list:");
+        for(i=0; i<size; i++){
+            getAPYPoolStats(addresses[i], &stats);
+            g_string_append_printf(msg,"\n%d - %s\n    Connections: %u in use, %u idle, %lu opened, %lu requests on reused ones",
+                i+1, addresses[i], stats.active, stats.idle, (unsigned long)stats.opened, (unsigned long)stats.reused);
+
+            apy_health_get(addresses[i], &health);
+            if(health.known){
+                g_string_append_printf(msg,"\n    Latency: %.0f ms, errors: %.0f%% (%lu of %lu requests failed)",
+                    health.latency, health.error_rate*100, (unsigned long)health.failures, (unsigned long)health.requests);
+                if(health.breaker == APY_BREAKER_OPEN){
+                    g_string_append(msg,"\n    Not answering, skipped for now");
+                }
+                else if(health.breaker == APY_BREAKER_HALF_OPEN){
+                    g_string_append(msg,"\n    Not answering, checking whether it has recovered");
+                }
+            }
+            else{
+                g_string_append(msg,"\n    Latency: not known yet");
+            }
+
+            if((pairs = pair_catalogue_get(addresses[i], &sources, &targets)) >= 0){
+                g_string_append_printf(msg,"\n    Language pairs: %d", pairs);
+                g_strfreev(sources);
+                g_strfreev(targets);
+            }
+
+            g_string_append_printf(msg,"\n    Weight: %u", getAPYWeight(addresses[i]));
+            free(addresses[i]);
+        }
+
+        notify_info_popup("APY addresses", msg->str);
+        free(addresses);
+        g_string_free(msg, TRUE);
+
+        return PURPLE_CMD_RET_OK;
+    }
+}
+
+/**
+ * @brief Callback for the 'apertium_apy' command when arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_apy_args_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *address, *port;
+    int order;
+
+    set_conversation(conv);
+
+    if(parse_apy_arguments(*args, &order, &address, &port)){
+        if(!setAPYAddress(address, port, order, 0)){
+            return PURPLE_CMD_RET_FAILED;
+        }
+        updateFileAddresses();
+        restore_apy_weights();
+    }
+    else{
+        return PURPLE_CMD_RET_FAILED;
+    }
+
+    notify_info("APY address successfully set");
+    return PURPLE_CMD_RET_OK;
+}
+
+/**
+ * @brief Callback for the 'apertium_apyremove' command
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_apyremove_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *position_str;
+    int position;
+
+    set_conversation(conv);
+
+    if((position_str = strtok(*args," ")) == NULL){
+        notify_error("No 'position' argument provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
+    else{
+        position = atoi(position_str);
+        if(!removeAPYAddress(position)){
+            notify_error("Couldn't remove the APY address");
+            return PURPLE_CMD_RET_FAILED;
+        }
+        updateFileAddresses();
+    }
+
+    notify_info("APY address successfully removed");
+    return PURPLE_CMD_RET_OK;
+}
+
+/**
+ * @brief Callback for the 'apertium_display' command when no arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_display_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *msg;
+
+    set_conversation(conv);
+
+    msg = malloc(sizeof(char)*150);
+
+    switch(display){
+        case COMPRESSED:
+            sprintf(msg,"\"Compressed\"\nBoth the original message and its translation are displayed, in 2 lines");
+            break;
+        case BOTH:
+            sprintf(msg,"\"Both\"\nBoth the original message and its translation are displayed");
+            break;
+        case TRANSLATION:
+            sprintf(msg,"\"Translation\"\nOnly the translated message is displayed");
+            break;
+        case PROGRESSIVE:
+            sprintf(msg,"\"Progressive\"\nIncoming messages are displayed at once, and their translation when it arrives");
+            break;
+    }
+
+    notify_info_popup("Current display mode",msg);
+
+    free(msg);
+
+    return PURPLE_CMD_RET_OK;
+}
+
+/**
+ * @brief Callback for the 'apertium_display' command when arguments are passed
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_display_args_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *mode;
+
+    set_conversation(conv);
+
+    if((mode = strtok(*args," ")) == NULL){
+        notify_error("No mode argument provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
+    else{
+        if(!strcmp(mode,"both")){
+            display = BOTH;
+            setDisplay("both");
+        }
+        else{
+            if(!strcmp(mode,"translation")){
+                display = TRANSLATION;
+                setDisplay("translation");
+            }
+            else{
+                if(!strcmp(mode,"compressed")){
+                    display = COMPRESSED;
+                    setDisplay("compressed");
+                }
+                else if(!strcmp(mode,"progressive")){
+                    display = PROGRESSIVE;
+                    setDisplay("progressive");
+                }
+                else{
+                    notify_error("mode argument must be \"both\", \"translation\", \"compressed\" or \"progressive\"");
+                    return PURPLE_CMD_RET_FAILED;
+                }
+            }
+        }
+    }
+
+    return PURPLE_CMD_RET_OK;
+}
+
+/**
+ * @brief Callback for the 'apertium_infodisplay' command
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
+ */
+PurpleCmdRet apertium_infodisplay_args_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *mode;
+
+    set_conversation(conv);
+
+    if((mode = strtok(*args," ")) == NULL){
+        notify_error("No mode argument provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
+    else{
+        if(!strcmp(mode,"dialog")){
+            set_info_display_mode("dialog");
+        }
+        else{
+            if(!strcmp(mode,"print")){
+                set_info_display_mode("print");
+            }
+            else{
+                if(!strcmp(mode,"none")){
+                    set_info_display_mode("none");
+                }
+                else{
+                    notify_error("mode argument must be \"dialog\", \"print\" or \"none\"");
+                    return PURPLE_CMD_RET_FAILED;
+                }
+            }
+        }
+    }
+
+    return PURPLE_CMD_RET_OK;
+}
+
+/**
+ * @brief Callback for the 'apertium_errors' command
+ *
+ * Refer to the libpurple Commands API documentation for more information
+ * @param conv Conversation where the command was used
+ * @param cmd String containing the command
+ * @param args String containing the arguments passed to the command
+ * @param error
+ * @param data Additional data passed
+ * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-int parse_unbind_arguments(char* args, char **command){
+PurpleCmdRet apertium_errors_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *swtch;
 
-    if((*command = strtok(args," ")) == NULL){
-        return 0;
+    set_conversation(conv);
+
+    if((swtch = strtok(*args," ")) == NULL){
+        notify_error("No switch value provided");
+        return PURPLE_CMD_RET_FAILED;
     }
 
-    if(strcmp(*command,"incoming") && strcmp(*command,"outgoing")){
-        notify_error("Command for apertium_delete must be null, \'incoming\' or \'outgoing\'");
-        return 0;
+    if(!strcmp(swtch,"on")){
+        notifications_on();
+        notify_info("Error messages enabled");
+        return PURPLE_CMD_RET_OK;
+    }
+    if(!strcmp(swtch,"off")){
+        notifications_off();
+        notify_info("Error messages disabled");
+        return PURPLE_CMD_RET_OK;
     }
 
-    return 1;
+    notify_error("Argument for this command must be either \"on\" or \"off\"");
+    return PURPLE_CMD_RET_FAILED;
 }
 
-/****************************************************************************************************/
-/*----------------------------------COMMAND CALLBACK DEFINITIONS------------------------------------*/
-/****************************************************************************************************/
-
 /**
- * @brief Callback for the 'apertium_check' command
+ * @brief Callback for the 'apertium_cache' command when no arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -290,49 +1503,28 @@ int parse_unbind_arguments(char* args, char **command){
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_check_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_cache_noargs_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    char *title, *text;
-    const char *username;
-    PurpleBuddy *buddy;
+    char *msg;
+    translation_cache_stats stats;
 
     set_conversation(conv);
 
-    title = malloc(sizeof(char)*100);
-    text = malloc(sizeof(char)*300);
-
-    buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
-    username = purple_buddy_get_name(buddy);
-
-    sprintf(title,"Pairs for \'%s\'", purple_buddy_get_name(buddy));
-
-    if(dictionaryHasUser(username, "incoming")){
-        sprintf(text,"Incoming messages: %s - %s\n",
-            dictionaryGetUserLanguage(username, "incoming", "source"),
-            dictionaryGetUserLanguage(username, "incoming", "target"));
-    }
-    else{
-        sprintf(text,"Incoming messages: None\n");
-    }
-    if(dictionaryHasUser(username, "outgoing")){
-        sprintf(text,"%sOutgoing messages: %s - %s", text,
-            dictionaryGetUserLanguage(username, "outgoing", "source"),
-            dictionaryGetUserLanguage(username, "outgoing", "target"));
-    }
-    else{
-        sprintf(text,"%sOutgoing messages: None", text);
-    }
+    translation_cache_get_stats(&stats);
 
-    notify_info_popup(title, text);
+    msg = malloc(sizeof(char)*300);
+    sprintf(msg,"Translations: %u of %u\nSize: %lu of %lu bytes\nHits: %lu\nHits from the cache file: %lu\nMisses: %lu",
+        stats.entries, stats.max_entries, (unsigned long)stats.bytes, (unsigned long)stats.max_bytes,
+        (unsigned long)stats.hits, (unsigned long)stats.disk_hits, (unsigned long)stats.misses);
 
-    free(title);
-    free(text);
+    notify_info_popup("Translation cache", msg);
+    free(msg);
 
     return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_pairs' command
+ * @brief Callback for the 'apertium_cache' command when arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -342,49 +1534,52 @@ PurpleCmdRet apertium_check_cb(PurpleConversation *conv, const gchar *cmd,
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_pairs_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_cache_args_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    int i, size;
-    char *title, *text, ***pairsList;
+    char *action, *value_str, *end;
+    long value;
+    translation_cache_stats stats;
 
     set_conversation(conv);
 
-    if(!(size = getAllPairs(&pairsList))){
+    if((action = strtok(*args," ")) == NULL){
+        notify_error("No action argument provided");
         return PURPLE_CMD_RET_FAILED;
     }
 
-    title = malloc(sizeof(char)*100);
-    text = malloc(sizeof(char)*size*50);
-
-    sprintf(title, "available pairs");
-    sprintf(text, " ");
+    if(!strcmp(action,"clear")){
+        translation_cache_clear();
+        notify_info("Translation cache cleared");
+        return PURPLE_CMD_RET_OK;
+    }
 
-    for(i=0; i<size; i++){
-        sprintf(text,"%s%s - %s", text, pairsList[i][0], pairsList[i][1]);
-        if(i%3 == 2){
-            sprintf(text,"%s\n",text);
-        }
-        else{
-            sprintf(text,"%s\t",text);
-        }
+    if(strcmp(action,"entries") && strcmp(action,"bytes")){
+        notify_error("action argument must be \"clear\", \"entries\" or \"bytes\"");
+        return PURPLE_CMD_RET_FAILED;
     }
 
-    sprintf(text,"%s", text);
+    if((value_str = strtok(NULL," ")) == NULL || (value = strtol(value_str, &end, 10)) < 0 || *end != '\0'){
+        notify_error("A limit of 0 or more must be provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
 
-    notify_info_popup(title, text);
+    translation_cache_get_stats(&stats);
 
-    for(i=0; i<size; i++){
-        free(pairsList[i]);
+    if(!strcmp(action,"entries")){
+        translation_cache_set_limits((guint)value, stats.max_bytes);
+        setIntKey("cacheEntries", value);
+    }
+    else{
+        translation_cache_set_limits(stats.max_entries, (gsize)value);
+        setIntKey("cacheBytes", value);
     }
-    free(pairsList);
-    free(title);
-    free(text);
 
+    notify_info("Translation cache limit set");
     return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_set' command
+ * @brief Callback for the 'apertium_batch' command when no arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -394,36 +1589,27 @@ PurpleCmdRet apertium_pairs_cb(PurpleConversation *conv, const gchar *cmd,
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_bind_cb(PurpleConversation *conv, const gchar *cmd,
-								gchar **args, gchar **error, void *data){
-    const char *username;
-    char *command, *source, *target, *msg;
-	PurpleBuddy *buddy;
+PurpleCmdRet apertium_batch_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+                                gchar **args, gchar **error, void *data){
+    char *msg;
+    translation_batching limits;
 
     set_conversation(conv);
 
-    if(parse_bind_arguments(*args,&command,&source,&target)){
-    	buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
-        username = purple_buddy_get_name(buddy);
+    translation_pipeline_get_batching(&limits);
 
-    	if(dictionarySetUserEntry(username,command,source,target)){
-            msg = malloc(sizeof(char)*(strlen(source)+strlen(target)+strlen(command)+strlen(username)+100));
-            sprintf(msg, "%s pair for %s successfully set to %s-%s",command,username,source,target);
-            notify_info(msg);
-            free(msg);
-    		return PURPLE_CMD_RET_OK;
-    	}
-    	else{
-    		return PURPLE_CMD_RET_FAILED;
-    	}
-	}
-	else{
-		return PURPLE_CMD_RET_FAILED;
-	}
+    msg = malloc(sizeof(char)*200);
+    sprintf(msg,"Window: %u ms\nTexts per request: %u\nBytes per request: %lu",
+        limits.window, limits.texts, (unsigned long)limits.bytes);
+
+    notify_info_popup("Translation batches", msg);
+    free(msg);
+
+    return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_delete' command when no arguments are passed
+ * @brief Callback for the 'apertium_batch' command when arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -433,31 +1619,52 @@ PurpleCmdRet apertium_bind_cb(PurpleConversation *conv, const gchar *cmd,
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_unbind_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_batch_args_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    const char *username;
-    char *msg;
-    PurpleBuddy *buddy;
+    char *setting, *value_str, *end;
+    long value;
+    translation_batching limits;
 
     set_conversation(conv);
 
-    buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
-    username = purple_buddy_get_name(buddy);
+    if((setting = strtok(*args," ")) == NULL){
+        notify_error("No setting argument provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
 
-    if(dictionaryRemoveUserEntries(username)){
-        msg = malloc(sizeof(char)*(strlen(username)+100));
-        sprintf(msg, "Successfully removed data for %s",username);
-        notify_info(msg);
-        free(msg);
-        return PURPLE_CMD_RET_OK;
+    if(strcmp(setting,"window") && strcmp(setting,"texts") && strcmp(setting,"bytes")){
+        notify_error("setting argument must be \"window\", \"texts\" or \"bytes\"");
+        return PURPLE_CMD_RET_FAILED;
     }
-    else{
+
+    if((value_str = strtok(NULL," ")) == NULL || (value = strtol(value_str, &end, 10)) < 0 || *end != '\0'){
+        notify_error("A value of 0 or more must be provided");
         return PURPLE_CMD_RET_FAILED;
     }
+
+    translation_pipeline_get_batching(&limits);
+
+    if(!strcmp(setting,"window")){
+        limits.window = (guint)value;
+        setIntKey("batchWindow", value);
+    }
+    else if(!strcmp(setting,"texts")){
+        limits.texts = (guint)value;
+        setIntKey("batchTexts", value);
+    }
+    else{
+        limits.bytes = (gsize)value;
+        setIntKey("batchBytes", value);
+    }
+
+    translation_pipeline_set_batching(&limits);
+
+    notify_info("Translation batch setting changed");
+    return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_delete' command when arguments are passed
+ * @brief Callback for the 'apertium_pool' command when no arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -467,36 +1674,31 @@ PurpleCmdRet apertium_unbind_noargs_cb(PurpleConversation *conv, const gchar *cm
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_unbind_args_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_pool_noargs_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    const char *username;
-    char *command, *msg;
-    PurpleBuddy *buddy;
+    char *msg;
+    unsigned int max_idle, max_active;
 
     set_conversation(conv);
 
-    if(parse_unbind_arguments(*args,&command)){
-        buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
-        username = purple_buddy_get_name(buddy);
+    getAPYPoolLimits(&max_idle, &max_active);
 
-        if(dictionaryRemoveUserEntry(username, command)){
-            msg = malloc(sizeof(char)*(strlen(username)+strlen(command)+100));
-            sprintf(msg, "Successfully removed %s data for %s",command,username);
-            notify_info(msg);
-            free(msg);
-            return PURPLE_CMD_RET_OK;
-        }
-        else{
-            return PURPLE_CMD_RET_FAILED;
-        }
+    msg = malloc(sizeof(char)*200);
+    if(max_active > 0){
+        sprintf(msg,"Idle connections kept per APY: %u\nConnections in use per APY: up to %u", max_idle, max_active);
     }
     else{
-        return PURPLE_CMD_RET_FAILED;
+        sprintf(msg,"Idle connections kept per APY: %u\nConnections in use per APY: no limit", max_idle);
     }
+
+    notify_info_popup("APY connections", msg);
+    free(msg);
+
+    return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_apy' command when no arguments are passed
+ * @brief Callback for the 'apertium_pool' command when arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -506,64 +1708,48 @@ PurpleCmdRet apertium_unbind_args_cb(PurpleConversation *conv, const gchar *cmd,
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_apy_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_pool_args_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    char **addresses, *msg;
-    int i,size;
+    char *setting, *value_str, *end;
+    long value;
+    unsigned int max_idle, max_active;
 
     set_conversation(conv);
 
-    if((size = getAPYAddress(&addresses)) == -1){
+    if((setting = strtok(*args," ")) == NULL){
+        notify_error("No setting argument provided");
         return PURPLE_CMD_RET_FAILED;
     }
-    else{
-        msg = malloc(sizeof(char)*(17+50*size));
-        sprintf(msg,"APY address list:");
-        for(i=0; i<size; i++){
-            sprintf(msg,"%s\n%d - %s",msg,i+1,addresses[i]);
-        }
-
-        notify_info_popup("APY addresses", msg);
-        free(addresses);
-        free(msg);
 
-        return PURPLE_CMD_RET_OK;
+    if(strcmp(setting,"idle") && strcmp(setting,"active")){
+        notify_error("setting argument must be \"idle\" or \"active\"");
+        return PURPLE_CMD_RET_FAILED;
     }
-}
 
-/**
- * @brief Callback for the 'apertium_apy' command when arguments are passed
- *
- * Refer to the libpurple Commands API documentation for more information
- * @param conv Conversation where the command was used
- * @param cmd String containing the command
- * @param args String containing the arguments passed to the command
- * @param error
- * @param data Additional data passed
- * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
- */
-PurpleCmdRet apertium_apy_args_cb(PurpleConversation *conv, const gchar *cmd,
-                                gchar **args, gchar **error, void *data){
-    char *address, *port;
-    int order;
+    if((value_str = strtok(NULL," ")) == NULL || (value = strtol(value_str, &end, 10)) < 0 || *end != '\0'){
+        notify_error("A limit of 0 or more must be provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
 
-    set_conversation(conv);
+    getAPYPoolLimits(&max_idle, &max_active);
 
-    if(parse_apy_arguments(*args, &order, &address, &port)){
-        if(!setAPYAddress(address, port, order, 0)){
-            return PURPLE_CMD_RET_FAILED;
-        }
+    if(!strcmp(setting,"idle")){
+        max_idle = (unsigned int)value;
+        setIntKey("poolIdle", value);
     }
     else{
-        return PURPLE_CMD_RET_FAILED;
+        max_active = (unsigned int)value;
+        setIntKey("poolActive", value);
     }
 
-    notify_info("APY address successfully set");
+    setAPYPoolLimits(max_idle, max_active);
+
+    notify_info("APY connection limit set");
     return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_apyremove' command
+ * @brief Callback for the 'apertium_hedge' command
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -573,31 +1759,36 @@ PurpleCmdRet apertium_apy_args_cb(PurpleConversation *conv, const gchar *cmd,
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_apyremove_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_hedge_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    char *position_str;
-    int position;
+    char *swtch;
 
     set_conversation(conv);
 
-    if((position_str = strtok(*args," ")) == NULL){
-        notify_error("No 'position' argument provided");
+    if((swtch = strtok(*args," ")) == NULL){
+        notify_error("No switch value provided");
         return PURPLE_CMD_RET_FAILED;
     }
-    else{
-        position = atoi(position_str);
-        if(!removeAPYAddress(position)){
-            notify_error("Couldn't remove the APY address");
-            return PURPLE_CMD_RET_FAILED;
-        }
+
+    if(!strcmp(swtch,"on")){
+        setAPYHedging(1);
+        setIntKey("hedge", 1);
+        notify_info("Hedged requests enabled");
+        return PURPLE_CMD_RET_OK;
+    }
+    if(!strcmp(swtch,"off")){
+        setAPYHedging(0);
+        setIntKey("hedge", 0);
+        notify_info("Hedged requests disabled");
+        return PURPLE_CMD_RET_OK;
     }
 
-    notify_info("APY address successfully removed");
-    return PURPLE_CMD_RET_OK;
+    notify_error("Argument for this command must be either \"on\" or \"off\"");
+    return PURPLE_CMD_RET_FAILED;
 }
 
 /**
- * @brief Callback for the 'apertium_display' command when no arguments are passed
+ * @brief Callback for the 'apertium_apypolicy' command
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -607,35 +1798,47 @@ PurpleCmdRet apertium_apyremove_cb(PurpleConversation *conv, const gchar *cmd,
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_display_noargs_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_apypolicy_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    char *msg;
+    char *name;
+    int new_policy;
 
     set_conversation(conv);
 
-    msg = malloc(sizeof(char)*150);
+    if((name = strtok(*args," ")) == NULL){
+        notify_error("No policy argument provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
 
-    switch(display){
-        case COMPRESSED:
-            sprintf(msg,"\"Compressed\"\nBoth the original message and its translation are displayed, in 2 lines");
-            break;
-        case BOTH:
-            sprintf(msg,"\"Both\"\nBoth the original message and its translation are displayed");
-            break;
-        case TRANSLATION:
-            sprintf(msg,"\"Translation\"\nOnly the translated message is displayed");
-            break;
+    if(!strcmp(name,"order")){
+        new_policy = APY_POLICY_ORDER;
+    }
+    else if(!strcmp(name,"fastest")){
+        new_policy = APY_POLICY_FASTEST;
+    }
+    else if(!strcmp(name,"round_robin")){
+        new_policy = APY_POLICY_ROUND_ROBIN;
+    }
+    else if(!strcmp(name,"least_outstanding")){
+        new_policy = APY_POLICY_LEAST_OUTSTANDING;
+    }
+    else if(!strcmp(name,"weighted")){
+        new_policy = APY_POLICY_WEIGHTED;
+    }
+    else{
+        notify_error("policy argument must be \"order\", \"fastest\", \"round_robin\", \"least_outstanding\" or \"weighted\"");
+        return PURPLE_CMD_RET_FAILED;
     }
 
-    notify_info_popup("Current display mode",msg);
-
-    free(msg);
+    setAPYPolicy(new_policy);
+    setIntKey("apyPolicy", new_policy);
 
+    notify_info("APY policy set");
     return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_display' command when arguments are passed
+ * @brief Callback for the 'apertium_breaker' command when no arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -645,44 +1848,31 @@ PurpleCmdRet apertium_display_noargs_cb(PurpleConversation *conv, const gchar *c
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_display_args_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_breaker_noargs_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    char *mode;
+    char *msg;
+    guint failures, cooldown;
 
     set_conversation(conv);
 
-    if((mode = strtok(*args," ")) == NULL){
-        notify_error("No mode argument provided");
-        return PURPLE_CMD_RET_FAILED;
+    apy_health_get_breaker(&failures, &cooldown);
+
+    msg = malloc(sizeof(char)*200);
+    if(failures > 0){
+        sprintf(msg,"APYs are skipped after %u failures in a row, for %u seconds", failures, cooldown);
     }
     else{
-        if(!strcmp(mode,"both")){
-            display = BOTH;
-            setDisplay("both");
-        }
-        else{
-            if(!strcmp(mode,"translation")){
-                display = TRANSLATION;
-                setDisplay("translation");
-            }
-            else{
-                if(!strcmp(mode,"compressed")){
-                    display = COMPRESSED;
-                    setDisplay("compressed");
-                }
-                else{
-                    notify_error("mode argument must be \"both\", \"translation\" or \"compressed\"");
-                    return PURPLE_CMD_RET_FAILED;
-                }
-            }
-        }
+        sprintf(msg,"APYs are never skipped");
     }
 
+    notify_info_popup("APY circuit breakers", msg);
+    free(msg);
+
     return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_infodisplay' command
+ * @brief Callback for the 'apertium_breaker' command when arguments are passed
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -692,41 +1882,48 @@ PurpleCmdRet apertium_display_args_cb(PurpleConversation *conv, const gchar *cmd
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_infodisplay_args_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_breaker_args_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    char *mode;
+    char *setting, *value_str, *end;
+    long value;
+    guint failures, cooldown;
 
     set_conversation(conv);
 
-    if((mode = strtok(*args," ")) == NULL){
-        notify_error("No mode argument provided");
+    if((setting = strtok(*args," ")) == NULL){
+        notify_error("No setting argument provided");
+        return PURPLE_CMD_RET_FAILED;
+    }
+
+    if(strcmp(setting,"failures") && strcmp(setting,"cooldown")){
+        notify_error("setting argument must be \"failures\" or \"cooldown\"");
+        return PURPLE_CMD_RET_FAILED;
+    }
+
+    if((value_str = strtok(NULL," ")) == NULL || (value = strtol(value_str, &end, 10)) < 0 || *end != '\0'){
+        notify_error("A value of 0 or more must be provided");
         return PURPLE_CMD_RET_FAILED;
     }
+
+    apy_health_get_breaker(&failures, &cooldown);
+
+    if(!strcmp(setting,"failures")){
+        failures = (guint)value;
+        setIntKey("breakerFailures", value);
+    }
     else{
-        if(!strcmp(mode,"dialog")){
-            set_info_display_mode("dialog");
-        }
-        else{
-            if(!strcmp(mode,"print")){
-                set_info_display_mode("print");
-            }
-            else{
-                if(!strcmp(mode,"none")){
-                    set_info_display_mode("none");
-                }
-                else{
-                    notify_error("mode argument must be \"dialog\", \"print\" or \"none\"");
-                    return PURPLE_CMD_RET_FAILED;
-                }
-            }
-        }
+        cooldown = (guint)value;
+        setIntKey("breakerCooldown", value);
     }
 
+    apy_health_set_breaker(failures, cooldown);
+
+    notify_info("APY circuit breaker setting changed");
     return PURPLE_CMD_RET_OK;
 }
 
 /**
- * @brief Callback for the 'apertium_errors' command
+ * @brief Callback for the 'apertium_apyweight' command
  *
  * Refer to the libpurple Commands API documentation for more information
  * @param conv Conversation where the command was used
@@ -736,40 +1933,88 @@ PurpleCmdRet apertium_infodisplay_args_cb(PurpleConversation *conv, const gchar
  * @param data Additional data passed
  * @return PURPLE_CMD_RET_OK on success, or PURPLE_CMD_RET_FAILED otherwise
  */
-PurpleCmdRet apertium_errors_cb(PurpleConversation *conv, const gchar *cmd,
+PurpleCmdRet apertium_apyweight_cb(PurpleConversation *conv, const gchar *cmd,
                                 gchar **args, gchar **error, void *data){
-    char *swtch;
+    char *position_str, *value_str, *end, **addresses, *key;
+    long position, value;
+    int i, size, valid;
 
     set_conversation(conv);
 
-    if((swtch = strtok(*args," ")) == NULL){
-        notify_error("No switch value provided");
+    if((position_str = strtok(*args," ")) == NULL){
+        notify_error("No 'position' argument provided");
         return PURPLE_CMD_RET_FAILED;
     }
 
-    if(!strcmp(swtch,"on")){
-        notifications_on();
-        notify_info("Error messages enabled");
-        return PURPLE_CMD_RET_OK;
+    if((value_str = strtok(NULL," ")) == NULL || (value = strtol(value_str, &end, 10)) < 0 || *end != '\0'){
+        notify_error("A weight of 0 or more must be provided");
+        return PURPLE_CMD_RET_FAILED;
     }
-    if(!strcmp(swtch,"off")){
-        notifications_off();
-        notify_info("Error messages disabled");
-        return PURPLE_CMD_RET_OK;
+
+    if((size = getAPYAddress(&addresses)) == -1){
+        return PURPLE_CMD_RET_FAILED;
     }
 
-    notify_error("Argument for this command must be either \"on\" or \"off\"");
-    return PURPLE_CMD_RET_FAILED;
+    position = strtol(position_str, &end, 10);
+    valid = *end == '\0' && position >= 0 && position < size;
+
+    if(!valid){
+        notify_error("There is no APY address at the given position");
+    }
+    else{
+        setAPYWeight(addresses[position], (unsigned int)value);
+
+        key = apy_weight_key(addresses[position]);
+        setIntKey(key, value);
+        g_free(key);
+    }
+
+    for(i=0; i<size; i++){
+        free(addresses[i]);
+    }
+    free(addresses);
+
+    if(!valid){
+        return PURPLE_CMD_RET_FAILED;
+    }
+
+    notify_info("APY weight set");
+    return PURPLE_CMD_RET_OK;
 }
 
 /****************************************************************************************************/
 /*--------------------------------CONVERSATION CALLBACK DEFINITIONS---------------------------------*/
 /****************************************************************************************************/
 
+/**
+ * @brief Holds back a message sent or received while the preferences are being converted
+ *
+ * @param account Account the message is sent or received on
+ * @param name Username of the buddy
+ * @param message The message
+ * @param flags Flags of the message
+ * @param outgoing 1 for messages sent by the user, 0 for received ones
+ */
+void hold_startup_message(PurpleAccount *account, const char *name, const char *message,
+                          PurpleMessageFlags flags, int outgoing){
+    pending_message *msg = g_new0(pending_message, 1);
+
+    msg->account = account;
+    msg->name = g_strdup(name);
+    msg->original = g_strdup(message);
+    msg->flags = flags;
+    msg->mtime = time(NULL);
+    msg->outgoing = outgoing;
+
+    g_queue_push_tail(startup_messages, msg);
+}
+
 /**
  * @brief Callback called before sending an IM message
  *
- * Attemps to translate the outgoing message if there exists a recipient-language_pair binding. Refer to the libpurple Conversation Signals documentation for more information
+ * Attemps to translate the outgoing message if there exists a recipient-language_pair binding.
+ * The message is not sent now; it is sent along with its translation as soon as the translation is available.
+ * Refer to the libpurple Conversation Signals documentation for more information
  * @param account The account the message is being sent on
  * @param recipient The username of the receiver
  * @param message Reference to the message string. Can be modified
@@ -781,7 +2026,16 @@ void sending_im_msg_cb(PurpleAccount *account, char *recipient, char **message,
 
     buddy = purple_find_buddy(account, recipient);
 
-    translate_message(message, buddy, "outgoing");
+    if(startup_messages != NULL && buddy != NULL){
+        hold_startup_message(account, recipient, *message, PURPLE_MESSAGE_SEND, 1);
+        g_free(*message);
+        *message = NULL;
+    }
+    else if(queue_message(account, buddy, recipient, *message, PURPLE_MESSAGE_SEND, "outgoing")){
+        // Setting the message to NULL cancels the sending
+        g_free(*message);
+        *message = NULL;
+    }
 
     return;
 }
@@ -789,13 +2043,16 @@ void sending_im_msg_cb(PurpleAccount *account, char *recipient, char **message,
 /**
  * @brief Callback called before receiving an IM message
  *
- * Attemps to translate the incoming message if there exists a sender-language_pair binding. Refer to the libpurple Conversation Signals documentation for more information
+ * Attemps to translate the incoming message if there exists a sender-language_pair binding.
+ * The message is dropped now and received again, along with its translation, as soon as the translation is available.
+ * Refer to the libpurple Conversation Signals documentation for more information
  * @param account The account the message was received on
  * @param sender Reference to a string containing the username of the sender
  * @param message Reference to a string containing the message that was sent
  * @param conv The IM conversation
  * @param flags A pointer to the IM message flags
  * @param handle Plugin handle
+ * @return TRUE if the message was held back to be translated (so that libpurple drops it), or FALSE otherwise
  */
 gboolean receiving_im_msg_cb(PurpleAccount *account, char **sender,
                             char **message, PurpleConversation *conv,
@@ -803,12 +2060,205 @@ gboolean receiving_im_msg_cb(PurpleAccount *account, char **sender,
 
 	PurpleBuddy *buddy;
 
+	if(delivering){
+		return FALSE;
+	}
+
 	buddy = purple_find_buddy(account, *sender);
 
-	translate_message(message, buddy, "incoming");
+	// The bindings are not known yet
+	if(startup_messages != NULL && buddy != NULL){
+		hold_startup_message(account, *sender, *message, *flags, 0);
+		return TRUE;
+	}
+
+	// The message is shown at once, and its translation follows as soon as it is available
+	if(display == PROGRESSIVE){
+		translate_progressively(account, buddy, *sender, *message);
+		return FALSE;
+	}
+
+	return queue_message(account, buddy, *sender, *message, *flags, "incoming");
+}
+
+/**
+ * @brief Gets the APYs ready to translate a language pair bound to a buddy
+ *
+ * Used with buddy_index_foreach()
+ * @param user Name of the buddy
+ * @param direction "incoming" or "outgoing"
+ * @param source Source language of the language pair
+ * @param target Target language of the language pair
+ * @param data Not used
+ */
+void warm_up_binding(const char *user, const char *direction, const char *source, const char *target, gpointer data){
+    warmUpPair(source, target);
+}
+
+/**
+ * @brief Callback called when a conversation is created
+ *
+ * Gets the APYs ready to translate the language pairs bound to the buddy in both directions, so that the first
+ * message of the conversation is not held back while an APY starts the pipeline of its pair.
+ * Refer to the libpurple Conversation Signals documentation for more information
+ * @param conv The new conversation
+ * @param handle Plugin handle
+ */
+void conversation_created_cb(PurpleConversation *conv, gpointer handle){
+    PurpleBuddy *buddy;
+    const char *username;
+
+    if(purple_conversation_get_type(conv) != PURPLE_CONV_TYPE_IM){
+        return;
+    }
+
+    buddy = purple_find_buddy(purple_conversation_get_account(conv), purple_conversation_get_name(conv));
+    if(buddy == NULL){
+        return;
+    }
+
+    username = purple_buddy_get_name(buddy);
+
+    if(dictionaryHasUser(username, "incoming")){
+        warmUpPair(dictionaryGetUserLanguage(username, "incoming", "source"),
+                   dictionaryGetUserLanguage(username, "incoming", "target"));
+    }
+    if(dictionaryHasUser(username, "outgoing")){
+        warmUpPair(dictionaryGetUserLanguage(username, "outgoing", "source"),
+                   dictionaryGetUserLanguage(username, "outgoing", "target"));
+    }
+}
+
+/**
+ * @brief Applies the settings stored in the preferences
+ *
+ * Called on plugin load, and again once the preferences of earlier versions have been converted
+ */
+void apply_preferences(void){
+    translation_batching batching;
+    const char* mode;
+
+    setAPYPoolLimits(
+        (unsigned int)getIntKey("poolIdle", APY_POOL_DEFAULT_IDLE),
+        (unsigned int)getIntKey("poolActive", APY_POOL_DEFAULT_ACTIVE));
+    setAPYHedging((int)getIntKey("hedge", 0));
+    setAPYPolicy((int)getIntKey("apyPolicy", APY_POLICY_ORDER));
+    restore_apy_weights();
+    apy_health_set_breaker(
+        (guint)getIntKey("breakerFailures", APY_BREAKER_DEFAULT_FAILURES),
+        (guint)getIntKey("breakerCooldown", APY_BREAKER_DEFAULT_COOLDOWN));
+
+    translation_cache_set_limits(
+        (guint)getIntKey("cacheEntries", TRANSLATION_CACHE_DEFAULT_ENTRIES),
+        (gsize)getIntKey("cacheBytes", TRANSLATION_CACHE_DEFAULT_BYTES));
+
+    batching.window = (guint)getIntKey("batchWindow", TRANSLATION_BATCH_DEFAULT_WINDOW);
+    batching.texts = (guint)getIntKey("batchTexts", TRANSLATION_BATCH_DEFAULT_TEXTS);
+    batching.bytes = (gsize)getIntKey("batchBytes", TRANSLATION_BATCH_DEFAULT_BYTES);
+    translation_pipeline_set_batching(&batching);
+
+    // Retrieving the displayMode
+    mode = getDisplay();
+
+    if(mode != NULL){
+        if(!strcmp(mode,"both")){
+            display = BOTH;
+        }
+        else{
+            if(!strcmp(mode,"compressed")){
+                display = COMPRESSED;
+            }
+            else if(!strcmp(mode,"progressive")){
+                display = PROGRESSIVE;
+            }
+            else{
+                display = TRANSLATION;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Releases, in order, the messages held back while the preferences were being converted
+ *
+ * @param translate 1 to translate the messages of buddies with a binding, or 0 to deliver every message as it was
+ */
+void release_startup_messages(int translate){
+    pending_message *msg;
+    PurpleBuddy *buddy;
+    GQueue *queue = startup_messages;
+
+    startup_messages = NULL;
+
+    while((msg = g_queue_pop_head(queue)) != NULL){
+        buddy = NULL;
+        if(translate && g_list_find(purple_accounts_get_all(), msg->account) != NULL){
+            buddy = purple_find_buddy(msg->account, msg->name);
+        }
+
+        if(buddy != NULL && !msg->outgoing && display == PROGRESSIVE){
+            deliver_message(msg);
+            translate_progressively(msg->account, buddy, msg->name, msg->original);
+        }
+        else if(buddy == NULL || !queue_message(msg->account, buddy, msg->name, msg->original, msg->flags,
+                                                msg->outgoing ? "outgoing" : "incoming")){
+            deliver_message(msg);
+        }
+
+        g_free(msg->name);
+        g_free(msg->original);
+        g_free(msg);
+    }
+
+    g_queue_free(queue);
+}
+
+#ifdef HAVE_PYTHON
+/**
+ * @brief Converts the preferences stored by earlier versions through Python
+ *
+ * Runs on a worker thread
+ * @param data Reference to an int set to 1 once the conversion has run
+ */
+void convert_preferences_run(gpointer data){
+    pythonInit();
+    pythonMigratePreferences("apertium_pidgin_plugin_preferences.pkl", "apertium_pidgin_plugin_preferences.db");
+    pythonFinalize();
+
+    *(int*)data = 1;
+}
+
+/**
+ * @brief Applies the converted preferences and releases the messages held back in the meantime
+ *
+ * Runs on the main loop
+ * @param data Reference to an int set to 1 once the conversion has run, which is freed
+ */
+void convert_preferences_done(gpointer data){
+    int converted = *(int*)data;
+
+    g_free(data);
+
+    // The plugin was unloaded before the conversion started. Nothing has been written, so it starts again on the
+    // next load and the changes logged meanwhile are replayed on top of it
+    if(!converted){
+        return;
+    }
+
+    preferencesConverted();
+
+    // The plugin is being unloaded, and the held back messages have already been delivered
+    if(startup_messages == NULL){
+        return;
+    }
+
+    apply_preferences();
 
-	return FALSE;
+    buddy_index_foreach(warm_up_binding, NULL);
+
+    release_startup_messages(1);
 }
+#endif
 
 /****************************************************************************************************/
 /*----------------------------------------PLUGIN FUNCTIONS------------------------------------------*/
@@ -817,16 +2267,21 @@ gboolean receiving_im_msg_cb(PurpleAccount *account, char **sender,
 /**
  * @brief Initializes the plugin
  *
- * Sets both the conversation and command bindings. Initializes the Python embedding
+ * Sets both the conversation and command bindings. Reads the preferences and initializes the translation workers.
+ * The preferences stored by earlier versions are converted on a worker thread, and the messages of buddies are
+ * held back until the conversion has finished
  * @param plugin Plugin handle
  * @return TRUE on success, or FALSE otherwise
  */
 gboolean plugin_load(PurplePlugin *plugin){
 
 	void *conv_handle = purple_conversations_get_handle();
+	int converting;
 
 	set_translator_plugin(plugin);
 
+	pending_queues = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_queue_free);
+
 	/*
 	 * Here we bind the different callbacks to the appropriate events.
 	 * The events 'sending' and 'receiving' are both fired before actually
@@ -837,6 +2292,8 @@ gboolean plugin_load(PurplePlugin *plugin){
 						plugin, PURPLE_CALLBACK(sending_im_msg_cb), plugin);
 	purple_signal_connect(conv_handle, "receiving-im-msg",
 						plugin, PURPLE_CALLBACK(receiving_im_msg_cb), plugin);
+	purple_signal_connect(conv_handle, "conversation-created",
+						plugin, PURPLE_CALLBACK(conversation_created_cb), plugin);
 
 
     bind_command_id = purple_cmd_register("apertium_bind", "s", PURPLE_CMD_P_HIGH,
@@ -859,11 +2316,16 @@ gboolean plugin_load(PurplePlugin *plugin){
         "apertium_check\nShows the current language pairs assigned to this contact for both incoming and outgoing messages.",
         NULL);
 
-    pairs_command_id = purple_cmd_register("apertium_pairs", "", PURPLE_CMD_P_HIGH,
-        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_pairs_cb,
+    pairs_noargs_command_id = purple_cmd_register("apertium_pairs", "", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_pairs_noargs_cb,
         "apertium_pairs\nShows all the available Apertium language pairs that can be used.",
         NULL);
 
+    pairs_args_command_id = purple_cmd_register("apertium_pairs", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_pairs_args_cb,
+        "apertium_pairs \'action\'\nShows all the available Apertium language pairs that can be used.\nThe \'action\' argument must be \"refresh\" (asks every APY for its language pairs again before showing them)",
+        NULL);
+
     apy_noargs_command_id = purple_cmd_register("apertium_apy", "", PURPLE_CMD_P_HIGH,
         PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_apy_noargs_cb,
         "apertium_apy\nShows a list with all the APYs that will be requested for answers in order.",
@@ -886,7 +2348,7 @@ gboolean plugin_load(PurplePlugin *plugin){
 
     display_args_command_id = purple_cmd_register("apertium_display", "s", PURPLE_CMD_P_HIGH,
         PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_display_args_cb,
-        "apertium_display \'display_mode\'\nSets the display mode for translated messages.\nThe \'display_mode\' argument must be \"both\" (displays the original message and its translation), \"translation\" (displays only the translation) or \"compressed\" (displays both the original message and translation, but does so in 2 lines)",
+        "apertium_display \'display_mode\'\nSets the display mode for translated messages.\nThe \'display_mode\' argument must be \"both\" (displays the original message and its translation), \"translation\" (displays only the translation), \"compressed\" (displays both the original message and translation, but does so in 2 lines) or \"progressive\" (displays incoming messages at once and their translation in a follow-up line when it arrives)",
         NULL);
 
     info_display_command_id = purple_cmd_register("apertium_infodisplay", "s", PURPLE_CMD_P_HIGH,
@@ -899,25 +2361,110 @@ gboolean plugin_load(PurplePlugin *plugin){
         "apertium_errors \'switch\'\nTurns on/off the error notification messages.\nThe \'switch\' argument must be either \"on\" or \"off\"",
         NULL);
 
-	// Python embedding
-	pythonInit("apertium_pidgin_plugin_preferences.pkl");
+    cache_noargs_command_id = purple_cmd_register("apertium_cache", "", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_cache_noargs_cb,
+        "apertium_cache\nShows how many translations are cached and how often the cache was used.",
+        NULL);
 
-    // Retrieving the displayMode
-    const char* mode = getDisplay();
+    cache_args_command_id = purple_cmd_register("apertium_cache", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_cache_args_cb,
+        "apertium_cache \'action\' \'limit\'\nManages the translation cache.\nThe \'action\' argument must be \"clear\" (removes every cached translation), \"entries\" (sets the maximum number of cached translations to \'limit\') or \"bytes\" (sets the maximum size of the cache to \'limit\' bytes)",
+        NULL);
 
-    if(mode != NULL){
-        if(!strcmp(mode,"both")){
-            display = BOTH;
-        }
-        else{
-            if(!strcmp(mode,"compressed")){
-                display = COMPRESSED;
-            }
-            else{
-                display = TRANSLATION;
-            }
-        }
-    }
+    batch_noargs_command_id = purple_cmd_register("apertium_batch", "", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_batch_noargs_cb,
+        "apertium_batch\nShows how messages of the same language pair are gathered to be translated together.",
+        NULL);
+
+    batch_args_command_id = purple_cmd_register("apertium_batch", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_batch_args_cb,
+        "apertium_batch \'setting\' \'value\'\nChanges how messages of the same language pair are gathered to be translated together.\nThe \'setting\' argument must be \"window\" (milliseconds a message waits for others, 0 to send every message on its own), \"texts\" (maximum number of messages translated together) or \"bytes\" (size of the messages after which they are sent without waiting)",
+        NULL);
+
+    pool_noargs_command_id = purple_cmd_register("apertium_pool", "", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_pool_noargs_cb,
+        "apertium_pool\nShows how many connections are kept open to each APY.",
+        NULL);
+
+    pool_args_command_id = purple_cmd_register("apertium_pool", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_pool_args_cb,
+        "apertium_pool \'setting\' \'limit\'\nChanges how many connections are kept open to each APY.\nThe \'setting\' argument must be \"idle\" (connections kept open between requests, 0 to close them after each request) or \"active\" (connections in use at the same time, 0 for no limit)",
+        NULL);
+
+    hedge_command_id = purple_cmd_register("apertium_hedge", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_hedge_cb,
+        "apertium_hedge \'switch\'\nTurns on/off hedged requests: while on, a translation is also requested to the next APY in the list whenever the previous ones take longer than usual to answer.\nThe \'switch\' argument must be either \"on\" or \"off\"",
+        NULL);
+
+    apypolicy_command_id = purple_cmd_register("apertium_apypolicy", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_apypolicy_cb,
+        "apertium_apypolicy \'policy\'\nSets the order in which the APYs are asked to translate.\nThe \'policy\' argument must be \"order\" (the order of the APY list), \"fastest\" (the fastest healthy APY first, according to the latencies observed), \"round_robin\" (each request starts at the next APY), \"least_outstanding\" (the APY with the fewest requests in progress first) or \"weighted\" (an APY chosen at random in proportion to its weight first)",
+        NULL);
+
+    breaker_noargs_command_id = purple_cmd_register("apertium_breaker", "", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_breaker_noargs_cb,
+        "apertium_breaker\nShows when APYs that are not answering are skipped.",
+        NULL);
+
+    breaker_args_command_id = purple_cmd_register("apertium_breaker", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_breaker_args_cb,
+        "apertium_breaker \'setting\' \'value\'\nChanges when APYs that are not answering are skipped.\nThe \'setting\' argument must be \"failures\" (failures in a row after which an APY is skipped, 0 to never skip it) or \"cooldown\" (seconds an APY is skipped before a single request checks whether it has recovered)",
+        NULL);
+
+    apyweight_command_id = purple_cmd_register("apertium_apyweight", "s", PURPLE_CMD_P_HIGH,
+        PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, PLUGIN_ID, apertium_apyweight_cb,
+        "apertium_apyweight \'position\' \'weight\'\nSets the weight of the APY located at the given position in the APY list, used by the \"weighted\" APY policy. An APY with twice the weight of another is asked first twice as often, and one with weight 0 is only asked when the others fail",
+        NULL);
+
+	// The APY list and the buddy index must exist before the preferences restore them
+	apyInit();
+	buddy_index_init();
+
+	// Language pairs received from the APYs in previous sessions
+	pair_catalogue_init("apertium_pidgin_plugin_pairs.ini");
+
+	// Messages whose translation failed in previous sessions
+	retry_queue_init("apertium_pidgin_plugin_retry.ini");
+
+	// The translation workers run the conversion of the preferences, if there is one
+	translation_pipeline_init();
+
+	// Preferences stored by earlier versions through Python are converted once, without holding back Pidgin
+	converting = !g_file_test("apertium_pidgin_plugin_preferences.db", G_FILE_TEST_EXISTS) &&
+	             g_file_test("apertium_pidgin_plugin_preferences.pkl", G_FILE_TEST_EXISTS);
+#ifndef HAVE_PYTHON
+	if(converting){
+		purple_debug_warning(PLUGIN_ID, "Built without Python, the preferences of earlier versions are not converted\n");
+		converting = 0;
+	}
+#endif
+
+	preferencesInit("apertium_pidgin_plugin_preferences.db", "apertium_pidgin_plugin_preferences.log", converting);
+
+	// Translations from previous sessions, stored next to the preferences file
+	disk_cache_open("apertium_pidgin_plugin_cache.db", DISK_CACHE_DEFAULT_SLOTS);
+
+	translation_cache_init(TRANSLATION_CACHE_DEFAULT_ENTRIES, TRANSLATION_CACHE_DEFAULT_BYTES);
+
+	apply_preferences();
+
+	schedule_retry();
+
+	// Outgoing messages translated while they are being typed
+	draft_translation_init(plugin);
+
+	if(!converting){
+		// APYs start the pipeline of a language pair on its first request, which is much slower than the next ones
+		buddy_index_foreach(warm_up_binding, NULL);
+	}
+#ifdef HAVE_PYTHON
+	else{
+		// The conversion runs as background work, so it never takes a thread the translations need. The messages
+		// are held back until it has finished anyway, as their bindings are not known before
+		startup_messages = g_queue_new();
+		worker_pool_push(WORKER_PRIORITY_BACKGROUND, convert_preferences_run, convert_preferences_done, g_new0(int, 1));
+	}
+#endif
 
 	return TRUE;
 }
@@ -925,13 +2472,40 @@ gboolean plugin_load(PurplePlugin *plugin){
 /**
  * @brief Finalizes the plugin
  *
- * Called on plugin unload. Unregisters the command bindings and finalizes the Python embedding
+ * Called on plugin unload. Delivers the messages waiting for a translation, unregisters the command bindings and closes the preferences
  * @param plugin Plugin handle
  * @return TRUE on success, or FALSE otherwise
  */
 gboolean plugin_unload(PurplePlugin *plugin){
 
-	saveDictionary();
+	// Background work must not hold back the messages still waiting for their translation
+	apyStopProbes();
+
+	// Drafts are no longer needed, and their translations still in flight are discarded
+	draft_translation_shutdown();
+
+	// Messages held back while the preferences were being converted go out untranslated
+	if(startup_messages != NULL){
+		release_startup_messages(0);
+	}
+
+	// An APY that is not answering must not hold back the unloading, so the requests in flight are aborted
+	apyCancelRequests();
+
+	// Delivers every message still waiting for its translation
+	translation_pipeline_shutdown();
+
+	if(retry_source != 0){
+		g_source_remove(retry_source);
+		retry_source = 0;
+	}
+	retry_queue_shutdown();
+
+	g_hash_table_destroy(pending_queues);
+
+	translation_cache_shutdown();
+
+	disk_cache_close();
 
 	purple_signals_disconnect_by_handle(plugin);
 
@@ -939,7 +2513,8 @@ gboolean plugin_unload(PurplePlugin *plugin){
     purple_cmd_unregister(unbind_noargs_command_id);
     purple_cmd_unregister(unbind_args_command_id);
     purple_cmd_unregister(check_command_id);
-    purple_cmd_unregister(pairs_command_id);
+    purple_cmd_unregister(pairs_noargs_command_id);
+    purple_cmd_unregister(pairs_args_command_id);
     purple_cmd_unregister(apy_noargs_command_id);
     purple_cmd_unregister(apy_args_command_id);
     purple_cmd_unregister(apyremove_command_id);
@@ -947,8 +2522,23 @@ gboolean plugin_unload(PurplePlugin *plugin){
     purple_cmd_unregister(display_args_command_id);
     purple_cmd_unregister(info_display_command_id);
     purple_cmd_unregister(errors_command_id);
-
-	pythonFinalize();
+    purple_cmd_unregister(cache_noargs_command_id);
+    purple_cmd_unregister(cache_args_command_id);
+    purple_cmd_unregister(batch_noargs_command_id);
+    purple_cmd_unregister(batch_args_command_id);
+    purple_cmd_unregister(pool_noargs_command_id);
+    purple_cmd_unregister(pool_args_command_id);
+    purple_cmd_unregister(hedge_command_id);
+    purple_cmd_unregister(apypolicy_command_id);
+    purple_cmd_unregister(breaker_noargs_command_id);
+    purple_cmd_unregister(breaker_args_command_id);
+    purple_cmd_unregister(apyweight_command_id);
+
+	preferencesFinalize();
+
+	buddy_index_shutdown();
+	pair_catalogue_shutdown();
+	apyFinalize();
 
 	return TRUE;
 }
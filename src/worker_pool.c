@@ -0,0 +1,381 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file worker_pool.c
+ * @brief Thread pool running blocking work away from the GLib main loop
+ *
+ * Tasks are queued by priority: a worker always takes the oldest task of the most urgent class it is allowed
+ * to run. Each class has a limit of tasks running at the same time, and one thread is always kept for
+ * WORKER_PRIORITY_OUTGOING tasks, so the messages the user sends never wait behind incoming messages or
+ * background work
+ */
+
+#include "worker_pool.h"
+
+/**
+ * @brief A unit of work handled by the pool
+ */
+typedef struct {
+    /** Function run on a worker thread */
+    worker_task_func work;
+    /** Function run on the main loop once work has finished. May be NULL */
+    worker_task_func done;
+    /** Data passed to both functions */
+    gpointer data;
+    /** Class of the task, one of worker_priority */
+    int priority;
+} worker_task;
+
+/**
+ * @brief The worker threads
+ *
+ * Initialized with the worker_pool_init() function
+ */
+static GThread **threads = NULL;
+
+/**
+ * @brief Number of worker threads
+ */
+static guint thread_count = 0;
+
+/**
+ * @brief Tasks waiting for a worker, one queue per class
+ *
+ * Protected by queue_mutex
+ */
+static GQueue queued_tasks[WORKER_PRIORITY_COUNT];
+
+/**
+ * @brief Number of tasks of each class running
+ *
+ * Protected by queue_mutex
+ */
+static guint running[WORKER_PRIORITY_COUNT];
+
+/**
+ * @brief Maximum number of tasks of each class running at the same time
+ *
+ * Protected by queue_mutex
+ */
+static guint limits[WORKER_PRIORITY_COUNT];
+
+/**
+ * @brief Number of tasks running, of any class
+ *
+ * Protected by queue_mutex
+ */
+static guint running_total = 0;
+
+/**
+ * @brief 1 once the workers must exit after the queued tasks are done, or 0 otherwise
+ *
+ * Protected by queue_mutex
+ */
+static int stopping = 0;
+
+/**
+ * @brief Mutex protecting the queues and the counters of the running tasks
+ */
+static GMutex queue_mutex;
+
+/**
+ * @brief Signalled when a task is queued, when a task finishes or when the workers must exit
+ */
+static GCond queue_cond;
+
+/**
+ * @brief Tasks whose work has finished and are waiting for their done function to be called
+ */
+static GAsyncQueue *finished_tasks = NULL;
+
+/**
+ * @brief ID of the idle source dispatching the finished tasks, or 0 if there is none
+ *
+ * Protected by dispatch_mutex
+ */
+static guint dispatch_source = 0;
+
+/**
+ * @brief Mutex protecting dispatch_source
+ */
+static GMutex dispatch_mutex;
+
+/**
+ * @brief Calls the done function of every finished task
+ *
+ * Runs on the main loop
+ * @param unused Not used
+ * @return FALSE, so that the idle source is removed
+ */
+static gboolean dispatch_finished_tasks(gpointer unused){
+    worker_task *task;
+
+    g_mutex_lock(&dispatch_mutex);
+    dispatch_source = 0;
+    g_mutex_unlock(&dispatch_mutex);
+
+    while((task = g_async_queue_try_pop(finished_tasks)) != NULL){
+        if(task->done != NULL){
+            task->done(task->data);
+        }
+        g_free(task);
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief Runs a task on a worker thread and hands it back to the main loop
+ *
+ * @param task The task to run
+ */
+static void run_task(worker_task *task){
+    task->work(task->data);
+
+    g_async_queue_push(finished_tasks, task);
+
+    g_mutex_lock(&dispatch_mutex);
+    if(dispatch_source == 0){
+        dispatch_source = g_idle_add(dispatch_finished_tasks, NULL);
+    }
+    g_mutex_unlock(&dispatch_mutex);
+}
+
+/**
+ * @brief Checks whether another task of a class may start
+ *
+ * The caller must hold queue_mutex
+ * @param priority The class, one of worker_priority
+ * @return 1 if a task of the class may start, or 0 otherwise
+ */
+static int may_start(int priority){
+    if(running[priority] >= limits[priority]){
+        return 0;
+    }
+
+    // The last free thread is kept for the messages the user sends
+    return priority == WORKER_PRIORITY_OUTGOING || thread_count < 2 || running_total + 1 < thread_count;
+}
+
+/**
+ * @brief Takes the most urgent task that may start
+ *
+ * The caller must hold queue_mutex
+ * @return The task, or NULL if no queued task may start now
+ */
+static worker_task* next_task(void){
+    int priority;
+
+    for(priority=0; priority<WORKER_PRIORITY_COUNT; priority++){
+        if(!g_queue_is_empty(&queued_tasks[priority]) && may_start(priority)){
+            return g_queue_pop_head(&queued_tasks[priority]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Checks whether every queue is empty
+ *
+ * The caller must hold queue_mutex
+ * @return 1 if no task is queued, or 0 otherwise
+ */
+static int queues_empty(void){
+    int priority;
+
+    for(priority=0; priority<WORKER_PRIORITY_COUNT; priority++){
+        if(!g_queue_is_empty(&queued_tasks[priority])){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Body of the worker threads: runs queued tasks until the pool is shut down
+ *
+ * @param unused Not used
+ * @return NULL
+ */
+static gpointer worker_main(gpointer unused){
+    worker_task *task;
+
+    g_mutex_lock(&queue_mutex);
+
+    while(!stopping || !queues_empty()){
+        if((task = next_task()) == NULL){
+            g_cond_wait(&queue_cond, &queue_mutex);
+            continue;
+        }
+
+        running[task->priority]++;
+        running_total++;
+        g_mutex_unlock(&queue_mutex);
+
+        run_task(task);
+
+        g_mutex_lock(&queue_mutex);
+        running[task->priority]--;
+        running_total--;
+        // A task of a class that had reached its limit may start now
+        g_cond_broadcast(&queue_cond);
+    }
+
+    g_mutex_unlock(&queue_mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief Creates the worker threads
+ *
+ * Must be called from the main loop thread before any other function in this file.
+ * WORKER_PRIORITY_OUTGOING tasks may use every thread, WORKER_PRIORITY_INCOMING tasks every thread but one
+ * and WORKER_PRIORITY_BACKGROUND tasks WORKER_BACKGROUND_THREADS threads
+ * @param max_threads Maximum number of tasks that may run at the same time
+ */
+void worker_pool_init(int max_threads){
+    guint i;
+
+    finished_tasks = g_async_queue_new();
+
+    thread_count = max_threads > 0 ? (guint)max_threads : 1;
+    stopping = 0;
+    running_total = 0;
+
+    for(i=0; i<WORKER_PRIORITY_COUNT; i++){
+        g_queue_init(&queued_tasks[i]);
+        running[i] = 0;
+    }
+
+    limits[WORKER_PRIORITY_OUTGOING] = thread_count;
+    limits[WORKER_PRIORITY_INCOMING] = thread_count > 1 ? thread_count - 1 : 1;
+    limits[WORKER_PRIORITY_BACKGROUND] = MIN(WORKER_BACKGROUND_THREADS, limits[WORKER_PRIORITY_INCOMING]);
+
+    threads = g_new(GThread*, thread_count);
+    for(i=0; i<thread_count; i++){
+        threads[i] = g_thread_new("translation-worker", worker_main, NULL);
+    }
+}
+
+/**
+ * @brief Queues a task to be run on a worker thread
+ *
+ * @param priority Class of the task, one of worker_priority
+ * @param work Function to run on a worker thread
+ * @param done Function to run on the main loop after work has returned. May be NULL
+ * @param data Data passed to both functions
+ */
+void worker_pool_push(int priority, worker_task_func work, worker_task_func done, gpointer data){
+    worker_task *task = g_new(worker_task, 1);
+
+    task->work = work;
+    task->done = done;
+    task->data = data;
+    task->priority = CLAMP(priority, 0, WORKER_PRIORITY_COUNT - 1);
+
+    g_mutex_lock(&queue_mutex);
+    g_queue_push_tail(&queued_tasks[task->priority], task);
+    g_cond_signal(&queue_cond);
+    g_mutex_unlock(&queue_mutex);
+}
+
+/**
+ * @brief Moves a task still waiting for a worker to a more urgent class
+ *
+ * Tasks already running, or queued in a class at least as urgent, are left as they are
+ * @param data Data the task was queued with
+ * @param priority The new class, one of worker_priority
+ * @return 1 if the task was moved, or 0 otherwise
+ */
+int worker_pool_raise(gpointer data, int priority){
+    int class, moved = 0;
+    GList *link;
+    worker_task *task;
+
+    priority = CLAMP(priority, 0, WORKER_PRIORITY_COUNT - 1);
+
+    g_mutex_lock(&queue_mutex);
+
+    for(class = priority + 1; class < WORKER_PRIORITY_COUNT && !moved; class++){
+        for(link = queued_tasks[class].head; link != NULL; link = link->next){
+            task = link->data;
+            if(task->data == data){
+                g_queue_delete_link(&queued_tasks[class], link);
+                task->priority = priority;
+                g_queue_push_tail(&queued_tasks[priority], task);
+                g_cond_broadcast(&queue_cond);
+                moved = 1;
+                break;
+            }
+        }
+    }
+
+    g_mutex_unlock(&queue_mutex);
+
+    return moved;
+}
+
+/**
+ * @brief Waits for the running tasks and the queued WORKER_PRIORITY_OUTGOING tasks to finish, and destroys the
+ * worker threads
+ *
+ * The queued tasks of the other classes are not run. The done functions of every task still pending, including
+ * those, are called before returning, so no task is lost
+ */
+void worker_pool_shutdown(void){
+    guint i;
+    int priority;
+    worker_task *task;
+
+    if(threads == NULL){
+        return;
+    }
+
+    g_mutex_lock(&queue_mutex);
+    stopping = 1;
+    for(priority = WORKER_PRIORITY_OUTGOING + 1; priority < WORKER_PRIORITY_COUNT; priority++){
+        while((task = g_queue_pop_head(&queued_tasks[priority])) != NULL){
+            g_async_queue_push(finished_tasks, task);
+        }
+    }
+    g_cond_broadcast(&queue_cond);
+    g_mutex_unlock(&queue_mutex);
+
+    for(i=0; i<thread_count; i++){
+        g_thread_join(threads[i]);
+    }
+    g_free(threads);
+    threads = NULL;
+    thread_count = 0;
+
+    g_mutex_lock(&dispatch_mutex);
+    if(dispatch_source != 0){
+        g_source_remove(dispatch_source);
+    }
+    g_mutex_unlock(&dispatch_mutex);
+
+    dispatch_finished_tasks(NULL);
+
+    g_async_queue_unref(finished_tasks);
+    finished_tasks = NULL;
+}
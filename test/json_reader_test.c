@@ -0,0 +1,145 @@
+/*
+ * Pidgin Translator Plugin.
+ *
+ * Copyright (C) 2014 Sergio Balbuena <sbalbp@gmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file json_reader_test.c
+ * @brief Checks the JSON parser against the answers sent by the APYs and against malformed texts
+ */
+
+#include "json_reader.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Number of checks that failed
+ */
+static int failures = 0;
+
+/**
+ * @brief Reports a check that failed
+ *
+ * @param condition Result of the check
+ * @param description Description of the check
+ */
+static void check(int condition, const char *description){
+    if(!condition){
+        fprintf(stderr, "FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+/**
+ * @brief Parses a NUL-terminated text
+ *
+ * @param text The text
+ * @return The parsed value, which must be freed with json_free(), or NULL if the text is malformed
+ */
+static json_value* parse(const char *text){
+    return json_parse(text, strlen(text));
+}
+
+/**
+ * @brief Checks that the string a text parses to is the expected one
+ *
+ * @param text JSON text of a string
+ * @param expected The expected UTF-8 string
+ */
+static void check_string(const char *text, const char *expected){
+    json_value *value = parse(text);
+    const char *string = json_get_string(value);
+
+    if(string == NULL || strcmp(string, expected) != 0){
+        fprintf(stderr, "FAIL: %s parsed to \"%s\" instead of \"%s\"\n", text, string != NULL ? string : "(null)", expected);
+        failures++;
+    }
+
+    json_free(value);
+}
+
+/**
+ * @brief Checks the parsing of a translation answer and of a pair listing
+ */
+static void test_answers(void){
+    json_value *value, *data;
+
+    value = parse("{\"responseData\": {\"translatedText\": \"Hola mundo\"}, \"responseDetails\": null, \"responseStatus\": 200}");
+    check(value != NULL, "translation answer parses");
+    check(json_get_number(json_object_get(value, "responseStatus"), 0) == 200, "responseStatus is 200");
+    check(json_object_get(value, "responseDetails") != NULL
+          && json_object_get(value, "responseDetails")->type == JSON_NULL, "responseDetails is null");
+    data = json_object_get(value, "responseData");
+    check(data != NULL && strcmp(json_get_string(json_object_get(data, "translatedText")), "Hola mundo") == 0,
+          "translatedText is read");
+    check(json_object_get(value, "missing") == NULL, "missing members are NULL");
+    json_free(value);
+
+    value = parse("{\"responseData\": [{\"sourceLanguage\": \"eng\", \"targetLanguage\": \"spa\"},"
+                  " {\"sourceLanguage\": \"cat\", \"targetLanguage\": \"spa\"}], \"responseStatus\": 200}");
+    data = json_object_get(value, "responseData");
+    check(json_length(data) == 2, "pair listing has two pairs");
+    check(strcmp(json_get_string(json_object_get(json_array_get(data, 1), "sourceLanguage")), "cat") == 0,
+          "second pair is read");
+    check(json_array_get(data, 2) == NULL, "elements past the end are NULL");
+    json_free(value);
+
+    value = parse("[true, false, -1.5e2, 0]");
+    check(json_length(value) == 4, "array has four elements");
+    check(json_array_get(value, 0)->type == JSON_BOOLEAN && json_array_get(value, 0)->boolean, "true is read");
+    check(json_array_get(value, 1)->type == JSON_BOOLEAN && !json_array_get(value, 1)->boolean, "false is read");
+    check(json_get_number(json_array_get(value, 2), 0) == -150, "exponents are read");
+    json_free(value);
+}
+
+/**
+ * @brief Checks the escapes of the strings
+ */
+static void test_strings(void){
+    check_string("\"a\\\"b\\\\c\\/d\"", "a\"b\\c/d");
+    check_string("\"\\n\\t\\r\"", "\n\t\r");
+    check_string("\"caf\\u00e9\"", "caf\xc3\xa9");
+    check_string("\"\\ud83d\\ude00\"", "\xf0\x9f\x98\x80");
+    check_string("\"\\ud83dx\"", "\xef\xbf\xbdx");
+    check_string("\"\\ude00\"", "\xef\xbf\xbd");
+    check_string("\"a\\u0000b\"", "a\xef\xbf\xbd" "b");
+}
+
+/**
+ * @brief Checks that malformed texts are rejected
+ */
+static void test_malformed(void){
+    const char *texts[] = {"", "{", "[1,]", "{\"a\" 1}", "\"abc", "tru", "[1] x", "\"\\x\"", "\"\\u12\"", NULL};
+    json_value *value;
+    int i;
+
+    for(i=0; texts[i] != NULL; i++){
+        if((value = parse(texts[i])) != NULL){
+            fprintf(stderr, "FAIL: \"%s\" was accepted\n", texts[i]);
+            failures++;
+            json_free(value);
+        }
+    }
+}
+
+int main(void){
+    test_answers();
+    test_strings();
+    test_malformed();
+
+    return failures == 0 ? 0 : 1;
+}